@@ -0,0 +1,86 @@
+/*
+ * Copyright (c) 2026 Eddie Antonio Santos <hello@eddieantonio.ca>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/**
+ * @file base64.c
+ * @brief Reports how many megabytes per second base64_encode() can chew
+ * through.
+ *
+ * Usage: bench/base64 [MEGABYTES]
+ */
+
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "../src/base64.h"
+
+enum {
+    /* Same chunk size that print_image.c uses. */
+    CHUNK_LEN = 48 * 1024,
+    ROUNDS = 5,
+};
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char **argv) {
+    size_t megabytes = argc > 1 ? strtoul(argv[1], NULL, 10) : 64;
+    size_t length = megabytes * 1024 * 1024;
+
+    uint8_t *input = malloc(length);
+    char *output = malloc(base64_encoded_length(CHUNK_LEN));
+    if (input == NULL || output == NULL) {
+        fprintf(stderr, "base64: out of memory\n");
+        return 1;
+    }
+
+    /* Incompressible-looking bytes, like a JPEG. */
+    uint32_t state = 2463534242u;
+    for (size_t i = 0; i < length; i++) {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        input[i] = state;
+    }
+
+    double best = 0;
+    size_t checksum = 0;
+    for (int round = 0; round < ROUNDS; round++) {
+        double start = now();
+        for (size_t offset = 0; offset < length; offset += CHUNK_LEN) {
+            size_t chunk = length - offset < CHUNK_LEN ? length - offset : CHUNK_LEN;
+            checksum += base64_encode(input + offset, chunk, output);
+            checksum += (unsigned char) output[0];
+        }
+        double elapsed = now() - start;
+        double rate = length / elapsed / (1024 * 1024);
+        if (rate > best) {
+            best = rate;
+        }
+    }
+
+    printf("base64_encode: %zu MB, best of %d: %.1f MB/s (checksum %zu)\n",
+           megabytes, ROUNDS, best, checksum);
+
+    free(input);
+    free(output);
+    return 0;
+}
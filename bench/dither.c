@@ -0,0 +1,189 @@
+/*
+ * Copyright (c) 2026 Eddie Antonio Santos <hello@eddieantonio.ca>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+
+/**
+ * @file dither.c
+ * @brief Reports how many megapixels per second are matched to the palette
+ * with each kind of dithering, next to plain nearest-colour matching: first
+ * by dither_row() alone, then including formatting the escape sequences,
+ * which is the whole cost of printing a palette image once it's loaded.
+ *
+ * Usage: bench/dither [WIDTH HEIGHT]
+ */
+
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../src/libimgcat.h"
+#include "../src/load_image.h"
+#include "../src/output.h"
+#include "../src/quantize.h"
+
+enum {
+    ROUNDS = 5,
+    /* Each round repeats the image until it has taken at least this long. */
+    MIN_ROUND_MS = 50,
+};
+
+static const struct {
+    const char *name;
+    Format format;
+    Quantizer backend;
+} palettes[] = {
+    { "8", F_8_COLOR, Q_EXACT },
+    { "8 perceptual", F_8_COLOR, Q_PERCEPTUAL },
+    { "256", F_256_COLOR, Q_EXACT },
+    { "256 perceptual", F_256_COLOR, Q_PERCEPTUAL },
+};
+
+struct Case {
+    const struct Image *image;
+    Format format;
+    Quantizer backend;
+    Dither dither;
+    uint8_t *indices;
+    struct Output output;
+    bool failed;
+};
+
+typedef void (*RunFunc)(struct Case *);
+
+static double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static void run_dither_row(struct Case *c) {
+    const struct Image *image = c->image;
+    struct Ditherer ditherer;
+    if (!ditherer_init(&ditherer, c->dither, c->backend,
+                       c->format == F_8_COLOR ? 8 : 256, image->width)) {
+        c->failed = true;
+        return;
+    }
+    for (int y = 0; y < image->height; y++) {
+        dither_row(&ditherer, image->buffer + (size_t) y * image->width * 4, y, c->indices);
+    }
+    ditherer_free(&ditherer);
+}
+
+static void run_print(struct Case *c) {
+    PrintRequest request;
+    imgcat_request_init(&request, c->format);
+    request.filename = "(gradient)";
+    request.quantizer = c->backend;
+    request.dither = c->dither;
+    request.output = &c->output;
+    output_clear(&c->output);
+
+    /* Printing unloads the image, so print a copy. Copying is a fraction
+     * of printing, so it isn't worth leaving out. */
+    size_t size = (size_t) c->image->width * c->image->height * 4;
+    struct Image image = *c->image;
+    image.buffer = malloc(size);
+    if (image.buffer == NULL) {
+        c->failed = true;
+        return;
+    }
+    memcpy(image.buffer, c->image->buffer, size);
+    c->failed |= !print_decoded_image(&request, &image);
+}
+
+static double best_rate(RunFunc run, struct Case *c) {
+    double pixels = (double) c->image->width * c->image->height;
+    double best = 0;
+
+    /* The first round fills in the lazy tables, which the others reuse. */
+    for (int round = 0; round < ROUNDS; round++) {
+        double start = now_ms(), elapsed;
+        int runs = 0;
+        do {
+            run(c);
+            runs++;
+        } while ((elapsed = now_ms() - start) < MIN_ROUND_MS);
+
+        double rate = runs * pixels / elapsed / 1e3;
+        if (rate > best) {
+            best = rate;
+        }
+    }
+
+    return best;
+}
+
+static void compare(const char *title, RunFunc run, struct Case *c) {
+    printf("%s\n", title);
+    for (size_t i = 0; i < sizeof palettes / sizeof palettes[0]; i++) {
+        double rates[D_DIFFUSION + 1];
+        c->format = palettes[i].format;
+        c->backend = palettes[i].backend;
+        for (Dither dither = D_NONE; dither <= D_DIFFUSION; dither++) {
+            c->dither = dither;
+            rates[dither] = best_rate(run, c);
+        }
+        /* How many times longer than not dithering at all. */
+        printf("  %-14s %7.1f MP/s, ordered: %7.1f MP/s (%.1fx), diffusion: %7.1f MP/s (%.1fx)\n",
+               palettes[i].name, rates[D_NONE],
+               rates[D_ORDERED], rates[D_NONE] / rates[D_ORDERED],
+               rates[D_DIFFUSION], rates[D_NONE] / rates[D_DIFFUSION]);
+    }
+}
+
+int main(int argc, char **argv) {
+    /* About as many pixels as a big terminal full of half-height cells. */
+    int width = argc > 2 ? atoi(argv[1]) : 320;
+    int height = argc > 2 ? atoi(argv[2]) : 180;
+
+    /* Smooth gradients, which is where dithering matters, with a little
+     * noise, like a photo. */
+    struct Image image = { .width = width, .height = height, .depth = 4 };
+    image.buffer = malloc((size_t) width * height * 4);
+    struct Case c = { .image = &image, .indices = malloc(width) };
+    if (image.buffer == NULL || c.indices == NULL) {
+        fprintf(stderr, "dither: out of memory\n");
+        return 1;
+    }
+    srand(1);
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            uint8_t *pixel = image.buffer + ((size_t) y * width + x) * 4;
+            int noise = rand() % 9 - 4;
+            pixel[0] = (uint8_t) (x * 255 / width + noise);
+            pixel[1] = (uint8_t) (y * 255 / height + noise);
+            pixel[2] = (uint8_t) ((x + y) * 127 / (width + height) + noise);
+            pixel[3] = 0xFF;
+        }
+    }
+    output_init_memory(&c.output, NULL, 0);
+
+    printf("dither: %dx%d, best of %d\n", width, height, ROUNDS);
+    compare("dither_row():", run_dither_row, &c);
+    compare("print_decoded_image(), which also formats every cell:", run_print, &c);
+
+    free(image.buffer);
+    free(c.indices);
+    output_free(&c.output);
+    if (c.failed) {
+        fprintf(stderr, "dither: could not print\n");
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,270 @@
+/*
+ * Copyright (c) 2026 Eddie Antonio Santos <hello@eddieantonio.ca>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+
+
+/**
+ * @file gen_corpus.c
+ * @brief Writes the images that bench/stages is run on.
+ *
+ * Usage: bench/gen_corpus DIRECTORY
+ *
+ * Every combination of content, size, and encoding is written to
+ * DIRECTORY as CONTENT-SIZE.png and CONTENT-SIZE.jpg:
+ *
+ *  - photo: smooth gradients with a little grain, like a photograph;
+ *  - flat: blocks of a few solid colours with thin lines, like a
+ *    screenshot or a diagram;
+ *  - noisy: random pixels, the worst case for every stage.
+ *
+ * Images are generated a row at a time, and the same every time.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+#include <math.h>
+#include <setjmp.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* jpeglib.h needs size_t and FILE, but doesn't include anything itself. */
+#include <jpeglib.h>
+#include <png.h>
+
+#define TAU 6.2831853f
+
+enum Content { PHOTO, FLAT, NOISY };
+
+static const struct {
+    const char *name;
+    int width, height;
+} sizes[] = {
+    { "tiny",     48,    32   },
+    { "1080p",    1920,  1080 },
+    { "24mp",     6000,  4000 },
+    { "panorama", 12000, 2000 },
+};
+
+static const char *const content_names[] = { "photo", "flat", "noisy" };
+
+/* Solid colours for the flat images. */
+static const uint8_t palette[][3] = {
+    { 0xFF, 0xFF, 0xFF }, { 0xF0, 0xF0, 0xF0 }, { 0x20, 0x20, 0x28 },
+    { 0x2E, 0x86, 0xDE }, { 0xE7, 0x4C, 0x3C }, { 0x27, 0xAE, 0x60 },
+    { 0xF3, 0x9C, 0x12 }, { 0x8E, 0x44, 0xAD },
+};
+
+enum {
+    /* Decoding is about as fast at any level, and the noisy images take
+     * ages to compress any harder. */
+    PNG_COMPRESSION = 1,
+    JPEG_QUALITY = 90,
+    FLAT_BLOCK = 96,
+    FLAT_LINE_SPACING = 12,
+};
+
+/**
+ * Generates the rows of one image. The photo's waves are separable, so
+ * each one is a sum of products of per-column and per-row tables.
+ */
+struct Generator {
+    enum Content content;
+    int width, height;
+    uint32_t random;
+    float *column_sin, *column_cos;
+};
+
+static uint32_t next_random(struct Generator *generator) {
+    /* xorshift32 */
+    uint32_t x = generator->random;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return generator->random = x;
+}
+
+static uint8_t clamp(float value) {
+    return value < 0 ? 0 : value > 255 ? 255 : (uint8_t) value;
+}
+
+static bool generator_init(struct Generator *generator, enum Content content,
+                           int width, int height) {
+    *generator = (struct Generator) {
+        .content = content,
+        .width = width,
+        .height = height,
+        .random = 2463534242u,
+        .column_sin = malloc(3 * width * sizeof(float)),
+        .column_cos = malloc(3 * width * sizeof(float)),
+    };
+    if (generator->column_sin == NULL || generator->column_cos == NULL) {
+        return false;
+    }
+
+    /* Each channel gets a wave with its own horizontal frequency. */
+    const float frequencies[] = { 1.5f, 0.7f, 3.1f };
+    for (int c = 0; c < 3; c++) {
+        for (int x = 0; x < width; x++) {
+            float angle = TAU * frequencies[c] * x / width;
+            generator->column_sin[c * width + x] = sinf(angle);
+            generator->column_cos[c * width + x] = cosf(angle);
+        }
+    }
+    return true;
+}
+
+static void generator_free(struct Generator *generator) {
+    free(generator->column_sin);
+    free(generator->column_cos);
+}
+
+static void generate_row(struct Generator *generator, int y, uint8_t *row) {
+    const int width = generator->width;
+
+    switch (generator->content) {
+        case PHOTO: {
+            const float frequencies[] = { 0.5f, 1.1f, 2.3f };
+            const float amplitudes[] = { 70, 80, 60 };
+            for (int c = 0; c < 3; c++) {
+                float angle = TAU * frequencies[c] * y / generator->height;
+                float row_sin = sinf(angle), row_cos = cosf(angle);
+                const float *column_sin = generator->column_sin + c * width;
+                const float *column_cos = generator->column_cos + c * width;
+                for (int x = 0; x < width; x++) {
+                    /* sin(a + b) = sin a cos b + cos a sin b */
+                    float wave = column_sin[x] * row_cos + column_cos[x] * row_sin;
+                    float grain = (int) (next_random(generator) >> 29) - 4;
+                    row[x * 3 + c] = clamp(128 + amplitudes[c] * wave + grain);
+                }
+            }
+            break;
+        }
+        case FLAT: {
+            bool line = y % FLAT_LINE_SPACING == 0 && (y / FLAT_BLOCK) % 2 == 1;
+            for (int x = 0; x < width; x++) {
+                uint32_t block = (uint32_t) (x / FLAT_BLOCK) * 2654435761u
+                               ^ (uint32_t) (y / FLAT_BLOCK) * 40503u;
+                const uint8_t *colour = palette[line && x % FLAT_BLOCK > 8 ? 2 : block % 8];
+                memcpy(row + x * 3, colour, 3);
+            }
+            break;
+        }
+        case NOISY:
+            for (int x = 0; x < width; x++) {
+                uint32_t random = next_random(generator);
+                memcpy(row + x * 3, &random, 3);
+            }
+            break;
+    }
+}
+
+static bool write_png(FILE *file, struct Generator *generator, uint8_t *row) {
+    png_structp png = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+    png_infop info = png ? png_create_info_struct(png) : NULL;
+    if (info == NULL) {
+        png_destroy_write_struct(&png, NULL);
+        return false;
+    }
+    if (setjmp(png_jmpbuf(png))) {
+        png_destroy_write_struct(&png, &info);
+        return false;
+    }
+
+    png_init_io(png, file);
+    png_set_compression_level(png, PNG_COMPRESSION);
+    png_set_IHDR(png, info, generator->width, generator->height, 8,
+                 PNG_COLOR_TYPE_RGB, PNG_INTERLACE_NONE,
+                 PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
+    png_write_info(png, info);
+    for (int y = 0; y < generator->height; y++) {
+        generate_row(generator, y, row);
+        png_write_row(png, row);
+    }
+    png_write_end(png, NULL);
+    png_destroy_write_struct(&png, &info);
+    return true;
+}
+
+static bool write_jpeg(FILE *file, struct Generator *generator, uint8_t *row) {
+    struct jpeg_compress_struct jpeg;
+    struct jpeg_error_mgr error;
+
+    /* libjpeg's default error handler exits, which is fine here. */
+    jpeg.err = jpeg_std_error(&error);
+    jpeg_create_compress(&jpeg);
+    jpeg_stdio_dest(&jpeg, file);
+    jpeg.image_width = generator->width;
+    jpeg.image_height = generator->height;
+    jpeg.input_components = 3;
+    jpeg.in_color_space = JCS_RGB;
+    jpeg_set_defaults(&jpeg);
+    jpeg_set_quality(&jpeg, JPEG_QUALITY, TRUE);
+    jpeg_start_compress(&jpeg, TRUE);
+    for (int y = 0; y < generator->height; y++) {
+        JSAMPROW rows[1] = { row };
+        generate_row(generator, y, row);
+        jpeg_write_scanlines(&jpeg, rows, 1);
+    }
+    jpeg_finish_compress(&jpeg);
+    jpeg_destroy_compress(&jpeg);
+    return true;
+}
+
+static bool write_image(const char *directory, enum Content content, int size, bool jpeg) {
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/%s-%s.%s", directory, content_names[content],
+             sizes[size].name, jpeg ? "jpg" : "png");
+
+    struct Generator generator;
+    uint8_t *row = malloc((size_t) sizes[size].width * 3);
+    FILE *file = fopen(path, "wb");
+    bool success = row != NULL && file != NULL
+        && generator_init(&generator, content, sizes[size].width, sizes[size].height);
+    if (success) {
+        success = jpeg ? write_jpeg(file, &generator, row) : write_png(file, &generator, row);
+        generator_free(&generator);
+    }
+
+    if (file != NULL && fclose(file) != 0) {
+        success = false;
+    }
+    free(row);
+    if (!success) {
+        fprintf(stderr, "gen_corpus: could not write %s\n", path);
+        remove(path);
+    }
+    return success;
+}
+
+int main(int argc, char **argv) {
+    if (argc != 2) {
+        fprintf(stderr, "Usage: %s DIRECTORY\n", argv[0]);
+        return 2;
+    }
+
+    for (int content = PHOTO; content <= NOISY; content++) {
+        for (size_t size = 0; size < sizeof(sizes) / sizeof(sizes[0]); size++) {
+            if (!write_image(argv[1], content, size, false)
+                    || !write_image(argv[1], content, size, true)) {
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,119 @@
+/*
+ * Copyright (c) 2026 Eddie Antonio Santos <hello@eddieantonio.ca>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+
+/**
+ * @file interleave.c
+ * @brief Reports how many megapixels per second interleave_row() converts,
+ * for each kind of source, next to a naive pixel-at-a-time loop.
+ *
+ * Usage: bench/interleave [WIDTH HEIGHT]
+ */
+
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "../src/interleave.h"
+
+enum {
+    ROUNDS = 5,
+};
+
+static const char *const names[] = {
+    NULL, "grey", "grey+alpha", "rgb", "rgba",
+};
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* What load_image() used to do, minus CImg's accessor. */
+static void naive_row(const uint8_t *const planes[], int channels, int width,
+                      uint8_t *dest) {
+    for (int x = 0; x < width; x++) {
+        for (int c = 0; c < 3; c++) {
+            *dest++ = channels < 3 ? planes[0][x] : planes[c][x];
+        }
+        *dest++ = 0xFF;
+    }
+}
+
+typedef void (*RowFunc)(const uint8_t *const planes[], int channels, int width,
+                        uint8_t *dest);
+
+static double best_rate(RowFunc convert, uint8_t *const planes[], int channels,
+                        int width, int height, uint8_t *dest) {
+    size_t plane_size = (size_t) width * height;
+    double best = 0;
+
+    for (int round = 0; round < ROUNDS; round++) {
+        double start = now();
+        for (int y = 0; y < height; y++) {
+            const uint8_t *row[4];
+            for (int c = 0; c < channels; c++) {
+                row[c] = planes[c] + (size_t) y * width;
+            }
+            convert(row, channels, width, dest + (size_t) y * width * 4);
+        }
+        double rate = plane_size / (now() - start) / 1e6;
+        if (rate > best) {
+            best = rate;
+        }
+    }
+
+    return best;
+}
+
+int main(int argc, char **argv) {
+    int width = argc > 2 ? atoi(argv[1]) : 4000;
+    int height = argc > 2 ? atoi(argv[2]) : 3000;
+    size_t plane_size = (size_t) width * height;
+
+    uint8_t *planes[4];
+    for (int c = 0; c < 4; c++) {
+        planes[c] = malloc(plane_size);
+        if (planes[c] == NULL) {
+            fprintf(stderr, "interleave: out of memory\n");
+            return 1;
+        }
+        for (size_t i = 0; i < plane_size; i++) {
+            planes[c][i] = (uint8_t) (i * (c + 1));
+        }
+    }
+    uint8_t *dest = malloc(plane_size * 4);
+    if (dest == NULL) {
+        fprintf(stderr, "interleave: out of memory\n");
+        return 1;
+    }
+
+    printf("interleave_row: %dx%d, best of %d\n", width, height, ROUNDS);
+    for (int channels = 1; channels <= 4; channels++) {
+        double fast = best_rate(interleave_row, planes, channels, width, height, dest);
+        double naive = best_rate(naive_row, planes, channels, width, height, dest);
+        printf("  %-10s %8.1f MP/s (naive: %8.1f MP/s)\n",
+               names[channels], fast, naive);
+    }
+
+    for (int c = 0; c < 4; c++) {
+        free(planes[c]);
+    }
+    free(dest);
+    return 0;
+}
@@ -0,0 +1,99 @@
+/*
+ * Copyright (c) 2026 Eddie Antonio Santos <hello@eddieantonio.ca>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+
+/**
+ * @file resample.c
+ * @brief Reports how many source megapixels per second the area-average
+ * resampler gets through, when shrinking a big photo to terminal size.
+ *
+ * Usage: bench/resample [WIDTH HEIGHT]
+ */
+
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "../src/resample.h"
+
+enum {
+    ROUNDS = 3,
+};
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static double best_rate(const uint8_t *src, int width, int height,
+                        int dest_width, int dest_height, uint8_t *dest) {
+    double best = 0;
+
+    for (int round = 0; round < ROUNDS; round++) {
+        double start = now();
+        struct AreaResampler *resampler =
+            area_resampler_new(width, height, dest_width, dest_height);
+        for (int y = 0; y < height; y++) {
+            area_resampler_push(resampler, src + (size_t) y * width * 4, dest);
+        }
+        area_resampler_free(resampler);
+
+        double rate = (double) width * height / (now() - start) / 1e6;
+        if (rate > best) {
+            best = rate;
+        }
+    }
+
+    return best;
+}
+
+int main(int argc, char **argv) {
+    /* About 24 megapixels, like a camera. */
+    int width = argc > 2 ? atoi(argv[1]) : 6000;
+    int height = argc > 2 ? atoi(argv[2]) : 4000;
+    size_t size = (size_t) width * height * 4;
+
+    uint8_t *src = malloc(size);
+    uint8_t *dest = malloc(size);
+    if (src == NULL || dest == NULL) {
+        fprintf(stderr, "resample: out of memory\n");
+        return 1;
+    }
+    for (size_t i = 0; i < size; i++) {
+        src[i] = (uint8_t) (i * 2654435761u >> 24);
+    }
+
+    printf("area_resampler: %dx%d, best of %d\n", width, height, ROUNDS);
+    /* A whole-number ratio, and then a couple of awkward ones. */
+    const int sizes[][2] = {
+        { width / 40, height / 40 },
+        { 120, height * 120 / width },
+        { 333, height * 333 / width },
+    };
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        int dest_width = sizes[i][0] > 0 ? sizes[i][0] : 1;
+        int dest_height = sizes[i][1] > 0 ? sizes[i][1] : 1;
+        printf("  to %4dx%-4d %8.1f MP/s%s\n", dest_width, dest_height,
+               best_rate(src, width, height, dest_width, dest_height, dest),
+               width % dest_width == 0 && height % dest_height == 0 ? " (whole-number ratio)" : "");
+    }
+
+    free(src);
+    free(dest);
+    return 0;
+}
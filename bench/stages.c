@@ -0,0 +1,480 @@
+/*
+ * Copyright (c) 2026 Eddie Antonio Santos <hello@eddieantonio.ca>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+
+
+/**
+ * @file stages.c
+ * @brief Times every stage of printing each image, and writes the timings
+ * as JSON.
+ *
+ * Usage: bench/stages [-w COLUMNS] IMAGE... > results.json
+ *
+ * The streaming loader decodes, interleaves, and shrinks each row in one
+ * pass, so "load" times all three together, the way imgcat really does it.
+ * "decode", "interleave", and "resize" time each of them on its own, at the
+ * image's full size. The "render-" stages quantize and format the loaded
+ * image into memory, and "output" writes the result into a pipe.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../src/config.h"
+#include "../src/interleave.h"
+#include "../src/libimgcat.h"
+#include "../src/load_image.h"
+#include "../src/load_jpeg.h"
+#include "../src/load_png.h"
+#include "../src/output.h"
+#include "../src/resample.h"
+
+enum {
+    /* Every stage is timed this many times, and the best time is kept. */
+    ROUNDS = 5,
+    /* Cheap stages are repeated until a round takes at least this long. */
+    MIN_ROUND_MS = 50,
+    MAX_RUNS_PER_ROUND = 100000,
+};
+
+/**
+ * One image, and everything its stages need.
+ */
+struct Subject {
+    const char *name;
+    uint8_t *data;
+    size_t length;
+    /* The image at full size, as decoded. */
+    uint8_t *pixels;
+    int width, height, next_row;
+    /* Its red, green, and blue channels, each in a plane of their own. */
+    uint8_t *planes[3];
+    uint8_t *row;
+    /* The image as imgcat would load it, to be printed. */
+    struct Image loaded;
+    uint8_t *quantized;
+    /* What the current render- stage printed. */
+    Format format;
+    Blocks blocks;
+    Dither dither;
+    struct Output rendered;
+};
+
+static int columns = 160;
+
+static double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static bool is_png(const struct Subject *subject) {
+    return subject->length >= 8 && memcmp(subject->data, "\x89PNG\r\n\x1a\n", 8) == 0;
+}
+
+static bool is_jpeg(const struct Subject *subject) {
+    return subject->length >= 3 && memcmp(subject->data, "\xff\xd8\xff", 3) == 0;
+}
+
+/* A ScanlineSink that keeps every row, at full size. */
+
+static bool full_size_start(void *context, int width, int height,
+                            int *min_width, int *min_height) {
+    *min_width = width;
+    *min_height = height;
+    return true;
+}
+
+static bool full_size_size(void *context, int width, int height) {
+    struct Subject *subject = context;
+    if (subject->pixels == NULL) {
+        subject->pixels = malloc((size_t) width * height * 4);
+        subject->width = width;
+        subject->height = height;
+    }
+    subject->next_row = 0;
+    return subject->pixels != NULL
+        && width == subject->width && height == subject->height;
+}
+
+static void full_size_row(void *context, const uint8_t *row) {
+    struct Subject *subject = context;
+    size_t stride = (size_t) subject->width * 4;
+    if (subject->next_row < subject->height) {
+        memcpy(subject->pixels + subject->next_row++ * stride, row, stride);
+    }
+}
+
+/* The stages. Each returns false if it couldn't be run. */
+
+static bool run_decode(struct Subject *subject) {
+    const struct ScanlineSink sink = {
+        .start = full_size_start,
+        .size = full_size_size,
+        .row = full_size_row,
+        .context = subject,
+    };
+    if (is_png(subject)) {
+        return png_stream_memory(subject->data, subject->length, &sink);
+    } else if (is_jpeg(subject)) {
+        return jpeg_stream_memory(subject->data, subject->length, &sink);
+    }
+    return false;
+}
+
+static bool run_load(struct Subject *subject) {
+    struct LoadOpts opts = {
+        .max_width = columns,
+        .max_height = HEIGHT_UNSET,
+        .desired_width = WIDTH_UNSET,
+        .desired_height = HEIGHT_UNSET,
+        .preserve_aspect_ratio = true,
+    };
+    struct Image image;
+    if (!load_image_from_memory(subject->data, subject->length, &image, &opts)) {
+        return false;
+    }
+    if (subject->loaded.buffer != NULL) {
+        unload_image(&subject->loaded);
+    }
+    subject->loaded = image;
+    return true;
+}
+
+static bool run_interleave(struct Subject *subject) {
+    const uint8_t *planes[3];
+    for (int y = 0; y < subject->height; y++) {
+        for (int c = 0; c < 3; c++) {
+            planes[c] = subject->planes[c] + (size_t) y * subject->width;
+        }
+        interleave_row(planes, 3, subject->width, subject->row);
+    }
+    return true;
+}
+
+static bool run_resize(struct Subject *subject) {
+    struct AreaResampler *resampler =
+        area_resampler_new(subject->width, subject->height,
+                           subject->loaded.width, subject->loaded.height);
+    if (resampler == NULL) {
+        return false;
+    }
+    for (int y = 0; y < subject->height; y++) {
+        area_resampler_push(resampler,
+                            subject->pixels + (size_t) y * subject->width * 4,
+                            subject->loaded.buffer);
+    }
+    area_resampler_free(resampler);
+    return true;
+}
+
+static bool run_quantize_8(struct Subject *subject) {
+    const struct Image *image = &subject->loaded;
+    for (int y = 0; y < image->height; y++) {
+        quantize_row_8(image->buffer + (size_t) y * image->width * 4,
+                       image->width, subject->quantized);
+    }
+    return true;
+}
+
+static bool run_quantize_256(struct Subject *subject) {
+    const struct Image *image = &subject->loaded;
+    for (int y = 0; y < image->height; y++) {
+        quantize_row_256(Q_EXACT, image->buffer + (size_t) y * image->width * 4,
+                         image->width, subject->quantized);
+    }
+    return true;
+}
+
+static void init_request(const struct Subject *subject, PrintRequest *request) {
+    imgcat_request_init(request, subject->format);
+    request->filename = subject->name;
+    request->max_width = columns;
+    request->blocks = subject->blocks;
+    request->dither = subject->dither;
+    request->emission = E_DELTA;
+    request->output = (struct Output *) &subject->rendered;
+}
+
+static bool run_render(struct Subject *subject) {
+    PrintRequest request;
+    init_request(subject, &request);
+    output_clear(&subject->rendered);
+
+    /* Printing unloads the image, so print a copy. */
+    const struct Image *loaded = &subject->loaded;
+    size_t size = (size_t) loaded->width * loaded->height * 4;
+    struct Image image = *loaded;
+    image.buffer = malloc(size);
+    if (image.buffer == NULL) {
+        return false;
+    }
+    memcpy(image.buffer, loaded->buffer, size);
+    return print_decoded_image(&request, &image);
+}
+
+static bool run_render_iterm2(struct Subject *subject) {
+    PrintRequest request;
+    init_request(subject, &request);
+    request.data = subject->data;
+    request.data_length = subject->length;
+    output_clear(&subject->rendered);
+    return print_image(&request);
+}
+
+static void *drain(void *arg) {
+    int fd = *(int *) arg;
+    char buffer[64 * 1024];
+    ssize_t count;
+    while ((count = read(fd, buffer, sizeof buffer)) != 0) {
+        if (count < 0 && errno != EINTR) {
+            break;
+        }
+    }
+    return NULL;
+}
+
+static bool run_output(struct Subject *subject) {
+    int fds[2];
+    pthread_t drainer;
+    if (pipe(fds) == -1) {
+        return false;
+    }
+    if (pthread_create(&drainer, NULL, drain, &fds[0]) != 0) {
+        close(fds[0]);
+        close(fds[1]);
+        return false;
+    }
+
+    struct Output output;
+    output_init(&output, fds[1]);
+    const char *pos = subject->rendered.data;
+    const char *end = pos + subject->rendered.length;
+    /* Flush at the same points imgcat would. */
+    while (pos < end) {
+        const char *newline = memchr(pos, '\n', end - pos);
+        const char *next = newline != NULL ? newline + 1 : end;
+        output_write(&output, pos, next - pos);
+        if (output_should_flush(&output)) {
+            output_flush(&output);
+        }
+        pos = next;
+    }
+    bool success = output_flush(&output);
+    output_free(&output);
+
+    close(fds[1]);
+    pthread_join(drainer, NULL);
+    close(fds[0]);
+    return success;
+}
+
+/**
+ * Times one stage, in milliseconds per run, or returns a negative number if
+ * the stage failed.
+ */
+static double time_stage(bool (*run)(struct Subject *), struct Subject *subject) {
+    double start = now_ms();
+    if (!run(subject)) {
+        return -1;
+    }
+    /* The first run doubles as the first round. */
+    double best = now_ms() - start;
+    int runs = best > 0 ? (int) (MIN_ROUND_MS / best) + 1 : MAX_RUNS_PER_ROUND;
+    if (runs > MAX_RUNS_PER_ROUND) {
+        runs = MAX_RUNS_PER_ROUND;
+    }
+
+    for (int round = 1; round < ROUNDS; round++) {
+        start = now_ms();
+        for (int i = 0; i < runs; i++) {
+            run(subject);
+        }
+        double elapsed = (now_ms() - start) / runs;
+        if (elapsed < best) {
+            best = elapsed;
+        }
+    }
+    return best;
+}
+
+static bool first_result = true;
+
+static void report(const struct Subject *subject, const char *stage, double ms) {
+    if (ms < 0) {
+        fprintf(stderr, "stages: %s: %s failed\n", subject->name, stage);
+        return;
+    }
+    printf("%s\n    {\"image\": \"%s\", \"stage\": \"%s\", \"ms\": %.6f}",
+           first_result ? "" : ",", subject->name, stage, ms);
+    first_result = false;
+    fprintf(stderr, "  %-22s %10.3f ms\n", stage, ms);
+}
+
+static const struct {
+    const char *name;
+    Format format;
+    Blocks blocks;
+    Dither dither;
+} renders[] = {
+    { "render-8", F_8_COLOR, B_FULL, D_NONE },
+    { "render-8-half", F_8_COLOR, B_HALF, D_NONE },
+    { "render-8-ordered", F_8_COLOR, B_FULL, D_ORDERED },
+    { "render-8-diffusion", F_8_COLOR, B_FULL, D_DIFFUSION },
+    { "render-256", F_256_COLOR, B_FULL, D_NONE },
+    { "render-256-half", F_256_COLOR, B_HALF, D_NONE },
+    { "render-256-quadrant", F_256_COLOR, B_QUADRANT, D_NONE },
+    { "render-256-sextant", F_256_COLOR, B_SEXTANT, D_NONE },
+    { "render-256-ordered", F_256_COLOR, B_FULL, D_ORDERED },
+    { "render-256-diffusion", F_256_COLOR, B_FULL, D_DIFFUSION },
+    { "render-sixel", F_SIXEL, B_FULL, D_NONE },
+    { "render-sixel-diffusion", F_SIXEL, B_FULL, D_DIFFUSION },
+    { "render-kitty", F_KITTY, B_FULL, D_NONE },
+    { "render-true", F_TRUE_COLOR, B_FULL, D_NONE },
+    { "render-true-half", F_TRUE_COLOR, B_HALF, D_NONE },
+    { "render-true-quadrant", F_TRUE_COLOR, B_QUADRANT, D_NONE },
+    { "render-true-sextant", F_TRUE_COLOR, B_SEXTANT, D_NONE },
+};
+
+/**
+ * Makes everything the stages need, from the decoded image.
+ */
+static bool prepare(struct Subject *subject) {
+    size_t area = (size_t) subject->width * subject->height;
+    for (int c = 0; c < 3; c++) {
+        subject->planes[c] = malloc(area);
+        if (subject->planes[c] == NULL) {
+            return false;
+        }
+        for (size_t i = 0; i < area; i++) {
+            subject->planes[c][i] = subject->pixels[i * 4 + c];
+        }
+    }
+    subject->row = malloc((size_t) subject->width * 4);
+    subject->quantized = malloc(subject->loaded.width);
+    output_init_memory(&subject->rendered, NULL, 0);
+    return subject->row != NULL && subject->quantized != NULL;
+}
+
+static bool read_subject(const char *filename, struct Subject *subject) {
+    FILE *file = fopen(filename, "rb");
+    struct stat info;
+    if (file == NULL) {
+        return false;
+    }
+    if (fstat(fileno(file), &info) == -1
+            || (subject->data = malloc(info.st_size)) == NULL
+            || fread(subject->data, 1, info.st_size, file) != (size_t) info.st_size) {
+        fclose(file);
+        return false;
+    }
+    fclose(file);
+    subject->length = info.st_size;
+
+    const char *slash = strrchr(filename, '/');
+    subject->name = slash != NULL ? slash + 1 : filename;
+    return true;
+}
+
+static void free_subject(struct Subject *subject) {
+    free(subject->data);
+    free(subject->pixels);
+    for (int c = 0; c < 3; c++) {
+        free(subject->planes[c]);
+    }
+    free(subject->row);
+    free(subject->quantized);
+    if (subject->loaded.buffer != NULL) {
+        unload_image(&subject->loaded);
+    }
+    output_free(&subject->rendered);
+}
+
+static bool bench_image(const char *filename) {
+    struct Subject subject = { 0 };
+    bool success = read_subject(filename, &subject);
+    if (!success) {
+        fprintf(stderr, "stages: %s: %s\n", filename, strerror(errno));
+        return false;
+    }
+    fprintf(stderr, "%s\n", subject.name);
+
+    /* Loading first makes the image to print, and decoding the full-size
+     * image to resize. */
+    report(&subject, "load", time_stage(run_load, &subject));
+    double decoded = time_stage(run_decode, &subject);
+    report(&subject, "decode", decoded);
+    if (subject.loaded.buffer == NULL || decoded < 0 || !prepare(&subject)) {
+        free_subject(&subject);
+        return false;
+    }
+    report(&subject, "interleave", time_stage(run_interleave, &subject));
+    report(&subject, "resize", time_stage(run_resize, &subject));
+    report(&subject, "quantize-8", time_stage(run_quantize_8, &subject));
+    report(&subject, "quantize-256", time_stage(run_quantize_256, &subject));
+
+    for (size_t i = 0; i < sizeof renders / sizeof renders[0]; i++) {
+        subject.format = renders[i].format;
+        subject.blocks = renders[i].blocks;
+        subject.dither = renders[i].dither;
+        report(&subject, renders[i].name, time_stage(run_render, &subject));
+    }
+    /* What's left from the last render is the biggest output to write. */
+    report(&subject, "output", time_stage(run_output, &subject));
+
+    subject.format = F_ITERM2;
+    subject.blocks = B_FULL;
+    subject.dither = D_NONE;
+    report(&subject, "render-iterm2", time_stage(run_render_iterm2, &subject));
+
+    free_subject(&subject);
+    return true;
+}
+
+int main(int argc, char **argv) {
+    int c;
+    while ((c = getopt(argc, argv, "w:")) != -1) {
+        switch (c) {
+            case 'w':
+                columns = atoi(optarg);
+                break;
+            default:
+                return 2;
+        }
+    }
+    if (columns < 1 || optind == argc) {
+        fprintf(stderr, "Usage: %s [-w COLUMNS] IMAGE... > results.json\n", argv[0]);
+        return 2;
+    }
+
+    printf("{\n  \"version\": \"%s\",\n  \"columns\": %d,\n  \"results\": [",
+           PACKAGE_VERSION, columns);
+    int status = 0;
+    for (int i = optind; i < argc; i++) {
+        if (!bench_image(argv[i])) {
+            status = 1;
+        }
+    }
+    printf("\n  ]\n}\n");
+    return status;
+}
@@ -0,0 +1,85 @@
+/*
+ * Copyright (c) 2026 Eddie Antonio Santos <hello@eddieantonio.ca>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/**
+ * @file base64.c
+ * @brief Table-driven base64 encoder.
+ *
+ * Every three input bytes are two 12-bit halves, and each half is looked up
+ * in a table of 4096 pre-encoded character pairs. That's two lookups per
+ * three bytes, and no bit-twiddling per output character.
+ */
+
+#include <pthread.h>
+#include <string.h>
+
+#include "base64.h"
+
+static const char b64_encode_table[] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZ"
+    "abcdefghijklmnopqrstuvwxyz"
+    "0123456789+/";
+
+/* Two characters per entry, for every possible 12-bit value. */
+static char pair_table[4096][2];
+static pthread_once_t pair_table_once = PTHREAD_ONCE_INIT;
+
+static void build_pair_table(void) {
+    for (int i = 0; i < 4096; i++) {
+        pair_table[i][0] = b64_encode_table[i >> 6];
+        pair_table[i][1] = b64_encode_table[i & 0x3F];
+    }
+}
+
+size_t base64_encoded_length(size_t length) {
+    return (length + 2) / 3 * 4;
+}
+
+size_t base64_encode(const uint8_t *src, size_t length, char *dest) {
+    char *start = dest;
+    const uint8_t *end = src + length - length % 3;
+
+    pthread_once(&pair_table_once, build_pair_table);
+
+    for (; src < end; src += 3, dest += 4) {
+        uint32_t triple = (uint32_t) src[0] << 16 | (uint32_t) src[1] << 8 | src[2];
+        memcpy(dest, pair_table[triple >> 12], 2);
+        memcpy(dest + 2, pair_table[triple & 0xFFF], 2);
+    }
+
+    /* Pad the end, if needed. */
+    switch (length % 3) {
+        case 0:
+            /* No padding necessary: last character ended on byte boundary. */
+            break;
+        case 1:
+            dest[0] = b64_encode_table[src[0] >> 2];
+            dest[1] = b64_encode_table[(src[0] & 0x03) << 4];
+            dest[2] = '=';
+            dest[3] = '=';
+            dest += 4;
+            break;
+        case 2:
+            dest[0] = b64_encode_table[src[0] >> 2];
+            dest[1] = b64_encode_table[(src[0] & 0x03) << 4 | src[1] >> 4];
+            dest[2] = b64_encode_table[(src[1] & 0x0F) << 2];
+            dest[3] = '=';
+            dest += 4;
+            break;
+    }
+
+    return dest - start;
+}
@@ -0,0 +1,43 @@
+/*
+ * Copyright (c) 2026 Eddie Antonio Santos <hello@eddieantonio.ca>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/**
+ * @file base64.h
+ * @brief "Canonical" base64, as in Table 1 of RFC 4648.
+ */
+
+#ifndef BASE64_H
+#define BASE64_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * How many characters it takes to encode length bytes, including padding.
+ */
+size_t base64_encoded_length(size_t length);
+
+/**
+ * Encodes length bytes of src into dest, which must have room for
+ * base64_encoded_length(length) characters. Returns the number of characters
+ * written. No NUL terminator is written.
+ *
+ * Only the final call for a stream should be given a length that isn't a
+ * multiple of three, since that's when padding is added.
+ */
+size_t base64_encode(const uint8_t *src, size_t length, char *dest);
+
+#endif /* BASE64_H */
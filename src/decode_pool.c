@@ -0,0 +1,202 @@
+/*
+ * Copyright (c) 2026 Eddie Antonio Santos <hello@eddieantonio.ca>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+
+/**
+ * @file decode_pool.c
+ * @brief A fixed number of threads, decoding images a bounded distance ahead
+ * of the one being printed.
+ */
+
+#include <assert.h>
+#include <pthread.h>
+#include <stdlib.h>
+
+#include "decode_pool.h"
+#include "load_image.h"
+#include "profile.h"
+
+/**
+ * Holds a decoded image until it's that image's turn to be printed.
+ */
+struct DecodeSlot {
+    struct Image image;
+    bool success;
+    bool done;
+};
+
+/**
+ * Everything here is protected by lock.
+ */
+struct DecodePool {
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    const PrintRequest *requests;
+    int count;
+    /* The next image a worker should decode. */
+    int next_to_decode;
+    /* The next image to hand out; image i lives in slots[i % max_pending]. */
+    int next_to_take;
+    int max_pending;
+    struct DecodeSlot *slots;
+    /* Set when the pool is being freed. */
+    bool stopping;
+    int n_threads;
+    pthread_t *threads;
+};
+
+static void *decode_worker(void *arg);
+
+
+struct DecodePool *decode_pool_new(const PrintRequest *requests, int count,
+                                   int threads, int max_pending) {
+    assert(count > 0 && max_pending > 0);
+
+    /* Any more threads than slots would never have anything to do. */
+    if (threads > max_pending) {
+        threads = max_pending;
+    }
+    if (threads > count) {
+        threads = count;
+    }
+
+    struct DecodePool *pool = malloc(sizeof(struct DecodePool));
+    if (pool == NULL) {
+        return NULL;
+    }
+    *pool = (struct DecodePool) {
+        .requests = requests,
+        .count = count,
+        .next_to_decode = 0,
+        .next_to_take = 0,
+        .max_pending = max_pending,
+        .slots = calloc(max_pending, sizeof(struct DecodeSlot)),
+        .stopping = false,
+        .n_threads = 0,
+        .threads = calloc(threads > 0 ? threads : 1, sizeof(pthread_t)),
+    };
+    if (pool->slots == NULL || pool->threads == NULL) {
+        free(pool->slots);
+        free(pool->threads);
+        free(pool);
+        return NULL;
+    }
+
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->changed, NULL);
+
+    /* If no threads start at all, decode_pool_next() decodes by itself. */
+    for (; pool->n_threads < threads; pool->n_threads++) {
+        if (pthread_create(&pool->threads[pool->n_threads], NULL, decode_worker, pool) != 0) {
+            break;
+        }
+    }
+
+    return pool;
+}
+
+bool decode_pool_next(struct DecodePool *pool, struct Image *image) {
+    pthread_mutex_lock(&pool->lock);
+    int index = pool->next_to_take++;
+    assert(index < pool->count);
+    /* The previous image is gone, so its slot is free again. */
+    pthread_cond_broadcast(&pool->changed);
+
+    if (pool->n_threads == 0) {
+        pthread_mutex_unlock(&pool->lock);
+        return decode_image(&pool->requests[index], image);
+    }
+
+    struct DecodeSlot *slot = &pool->slots[index % pool->max_pending];
+    while (!slot->done) {
+        pthread_cond_wait(&pool->changed, &pool->lock);
+    }
+    *image = slot->image;
+    bool success = slot->success;
+    slot->done = false;
+    pthread_mutex_unlock(&pool->lock);
+
+    return success;
+}
+
+void decode_pool_free(struct DecodePool *pool) {
+    pthread_mutex_lock(&pool->lock);
+    pool->stopping = true;
+    pthread_cond_broadcast(&pool->changed);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (int i = 0; i < pool->n_threads; i++) {
+        pthread_join(pool->threads[i], NULL);
+    }
+
+    /* Images that were decoded, but never asked for. */
+    for (int i = 0; i < pool->max_pending; i++) {
+        if (pool->slots[i].done && pool->slots[i].success) {
+            unload_image(&pool->slots[i].image);
+        }
+    }
+
+    pthread_cond_destroy(&pool->changed);
+    pthread_mutex_destroy(&pool->lock);
+    free(pool->slots);
+    free(pool->threads);
+    free(pool);
+}
+
+/**
+ * Whether the next image may be decoded yet: it must not push the number of
+ * decoded images over max_pending, counting the one that was handed out last
+ * (it's still being printed).
+ */
+static bool may_decode_next(const struct DecodePool *pool) {
+    int oldest_held = pool->next_to_take > 0 ? pool->next_to_take - 1 : 0;
+    return pool->next_to_decode < oldest_held + pool->max_pending;
+}
+
+/**
+ * Takes images off the queue and decodes them, until there are none left.
+ */
+static void *decode_worker(void *arg) {
+    struct DecodePool *pool = arg;
+
+    profile_thread_name("decode");
+    pthread_mutex_lock(&pool->lock);
+    while (1) {
+        while (!pool->stopping && pool->next_to_decode < pool->count &&
+                !may_decode_next(pool)) {
+            pthread_cond_wait(&pool->changed, &pool->lock);
+        }
+        if (pool->stopping || pool->next_to_decode >= pool->count) {
+            break;
+        }
+
+        int index = pool->next_to_decode++;
+        pthread_mutex_unlock(&pool->lock);
+
+        struct Image image = { 0 };
+        bool success = decode_image(&pool->requests[index], &image);
+
+        pthread_mutex_lock(&pool->lock);
+        struct DecodeSlot *slot = &pool->slots[index % pool->max_pending];
+        slot->image = image;
+        slot->success = success;
+        slot->done = true;
+        pthread_cond_broadcast(&pool->changed);
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    return NULL;
+}
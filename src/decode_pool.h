@@ -0,0 +1,59 @@
+/*
+ * Copyright (c) 2026 Eddie Antonio Santos <hello@eddieantonio.ca>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+
+/**
+ * @file decode_pool.h
+ * @brief Decodes upcoming images on worker threads, handing them back in order.
+ *
+ * Usage:
+ *
+ * Create a pool for an array of requests with decode_pool_new(), then call
+ * decode_pool_next() once per request, printing (and unloading) each image
+ * before asking for the next one. Finally, call decode_pool_free().
+ */
+
+#ifndef DECODE_POOL_H
+#define DECODE_POOL_H
+
+#include <stdbool.h>
+
+#include "print_image.h"
+
+struct DecodePool;
+
+/**
+ * Starts up to threads workers decoding requests[0..count), never holding
+ * more than max_pending decoded images at once (counting the one that was
+ * most recently handed out). The requests must outlive the pool.
+ *
+ * Returns NULL if memory could not be allocated.
+ */
+struct DecodePool *decode_pool_new(const PrintRequest *requests, int count,
+                                   int threads, int max_pending);
+
+/**
+ * Waits for the next image, in the order of the requests. Returns false if it
+ * could not be loaded. The previous image must already be unloaded.
+ */
+bool decode_pool_next(struct DecodePool *pool, struct Image *image);
+
+/**
+ * Stops the workers, and unloads any images that were never handed out.
+ */
+void decode_pool_free(struct DecodePool *pool);
+
+#endif /* DECODE_POOL_H */
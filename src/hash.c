@@ -0,0 +1,103 @@
+/*
+ * Copyright (c) 2026 Eddie Antonio Santos <hello@eddieantonio.ca>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+
+/**
+ * @file hash.c
+ * @brief MurmurHash3_x64_128.
+ *
+ * See https://github.com/aappleby/smhasher/blob/master/src/MurmurHash3.cpp
+ */
+
+#include <string.h>
+
+#include "hash.h"
+
+static inline uint64_t rotl64(uint64_t x, int r) {
+    return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t fmix64(uint64_t k) {
+    k ^= k >> 33;
+    k *= UINT64_C(0xff51afd7ed558ccd);
+    k ^= k >> 33;
+    k *= UINT64_C(0xc4ceb9fe1a85ec53);
+    k ^= k >> 33;
+    return k;
+}
+
+/* Blocks are read little-endian, whatever the machine. */
+static inline uint64_t read_u64(const uint8_t *bytes) {
+    uint64_t value;
+    memcpy(&value, bytes, sizeof(value));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    value = __builtin_bswap64(value);
+#endif
+    return value;
+}
+
+struct Hash128 hash128(const void *data, size_t length, uint64_t seed) {
+    const uint64_t c1 = UINT64_C(0x87c37b91114253d5);
+    const uint64_t c2 = UINT64_C(0x4cf5ad432745937f);
+    const uint8_t *bytes = data;
+    const size_t blocks = length / 16;
+    uint64_t h1 = seed, h2 = seed;
+
+    for (size_t i = 0; i < blocks; i++, bytes += 16) {
+        uint64_t k1 = read_u64(bytes);
+        uint64_t k2 = read_u64(bytes + 8);
+
+        k1 *= c1; k1 = rotl64(k1, 31); k1 *= c2; h1 ^= k1;
+        h1 = rotl64(h1, 27); h1 += h2; h1 = h1 * 5 + 0x52dce729;
+
+        k2 *= c2; k2 = rotl64(k2, 33); k2 *= c1; h2 ^= k2;
+        h2 = rotl64(h2, 31); h2 += h1; h2 = h2 * 5 + 0x38495ab5;
+    }
+
+    /* The last 0 to 15 bytes. */
+    uint64_t k1 = 0, k2 = 0;
+    switch (length & 15) {
+        case 15: k2 ^= (uint64_t) bytes[14] << 48; /* fall through */
+        case 14: k2 ^= (uint64_t) bytes[13] << 40; /* fall through */
+        case 13: k2 ^= (uint64_t) bytes[12] << 32; /* fall through */
+        case 12: k2 ^= (uint64_t) bytes[11] << 24; /* fall through */
+        case 11: k2 ^= (uint64_t) bytes[10] << 16; /* fall through */
+        case 10: k2 ^= (uint64_t) bytes[9] << 8;   /* fall through */
+        case 9:  k2 ^= (uint64_t) bytes[8];
+                 k2 *= c2; k2 = rotl64(k2, 33); k2 *= c1; h2 ^= k2;
+                 /* fall through */
+        case 8:  k1 ^= (uint64_t) bytes[7] << 56;  /* fall through */
+        case 7:  k1 ^= (uint64_t) bytes[6] << 48;  /* fall through */
+        case 6:  k1 ^= (uint64_t) bytes[5] << 40;  /* fall through */
+        case 5:  k1 ^= (uint64_t) bytes[4] << 32;  /* fall through */
+        case 4:  k1 ^= (uint64_t) bytes[3] << 24;  /* fall through */
+        case 3:  k1 ^= (uint64_t) bytes[2] << 16;  /* fall through */
+        case 2:  k1 ^= (uint64_t) bytes[1] << 8;   /* fall through */
+        case 1:  k1 ^= (uint64_t) bytes[0];
+                 k1 *= c1; k1 = rotl64(k1, 31); k1 *= c2; h1 ^= k1;
+    }
+
+    h1 ^= length;
+    h2 ^= length;
+    h1 += h2;
+    h2 += h1;
+    h1 = fmix64(h1);
+    h2 = fmix64(h2);
+    h1 += h2;
+    h2 += h1;
+
+    return (struct Hash128) { .high = h1, .low = h2 };
+}
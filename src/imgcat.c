@@ -14,7 +14,7 @@
  * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
  */
 
-/* Feature-test macro for fileno(3), fdopen(3), and mkstemp(3), snprintf(3). */
+/* Feature-test macro for fileno(3) and snprintf(3). */
 #define _XOPEN_SOURCE 600
 #include <assert.h>
 #include <stdarg.h>
@@ -24,6 +24,8 @@
 #include <string.h>
 #include <err.h>
 #include <limits.h>
+#include <stdint.h>
+#include <inttypes.h>
 
 #include <getopt.h>
 #include <sys/ioctl.h>
@@ -34,6 +36,11 @@
 #include <term.h>
 
 #include "print_image.h"
+#include "decode_pool.h"
+#include "load_image.h"
+#include "profile.h"
+#include "render_cache.h"
+#include "server.h"
 #include "config.h"
 
 enum colors_t {
@@ -50,7 +57,18 @@ struct terminal_t {
     int height;
     unsigned colors;
     bool isatty;
+    /* Whether the terminal can repeat characters with REP (CSI n b). */
+    bool has_rep;
     Format optimum_format;
+    /* The size of a character cell, in pixels, for sizing sixel images. */
+    int cell_width;
+    int cell_height;
+};
+
+enum {
+    /* What a VT340 has, for terminals that don't say. */
+    DEFAULT_CELL_WIDTH = 10,
+    DEFAULT_CELL_HEIGHT = 20,
 };
 
 
@@ -62,17 +80,61 @@ static struct {
     bool should_resize;
     int width;
     int height;
-    bool use_half_height;
+    Blocks blocks;
     bool use_fake_terminal;
     bool should_preserve_aspect_ratio;
+    Quantizer quantizer;
+    Dither dither;
+    Emission emission;
+    bool detect_rep;
+    KittyMedium kitty_medium;
+    bool detect_kitty_medium;
+    bool use_compact_escapes;
+    size_t max_bytes;
+    int jobs;
+    int max_pending;
+    bool animate;
+    int plays;
+    bool use_cache;
+    const char *cache_directory;
+    size_t cache_size;
+    bool clear_cache;
+    bool show_cache_stats;
+    const char *serve_socket;
+    const char *connect_socket;
+    bool show_server_stats;
+    bool profile;
+    const char *trace_filename;
 } options = {
     .format = F_UNSET,          /* Default: autodetect highest fidelity. */
     .should_resize = true,      /* Default: yes! */
     .width = WIDTH_UNSET,
     .height = HEIGHT_UNSET,
-    .use_half_height = false,
+    .blocks = B_FULL,
     .use_fake_terminal = false,
-    .should_preserve_aspect_ratio = true
+    .should_preserve_aspect_ratio = true,
+    .quantizer = Q_EXACT,
+    .dither = D_NONE,
+    .emission = E_FULL,         /* Default: maximum compatibility. */
+    .detect_rep = false,
+    .kitty_medium = K_DIRECT,
+    .detect_kitty_medium = true,  /* Default: a file, if the terminal is right here. */
+    .use_compact_escapes = false,
+    .max_bytes = 0,             /* Default: no budget. */
+    .jobs = 0,                  /* Default: one per core. */
+    .max_pending = 0,           /* Default: one more than --jobs. */
+    .animate = false,
+    .plays = 0,                 /* Default: as many as the image asks. */
+    .use_cache = false,
+    .cache_directory = NULL,    /* Default: $XDG_CACHE_HOME/imgcat. */
+    .cache_size = 64 << 20,
+    .clear_cache = false,
+    .show_cache_stats = false,
+    .serve_socket = NULL,
+    .connect_socket = NULL,     /* Default: $IMGCAT_SOCKET, if set. */
+    .show_server_stats = false,
+    .profile = false,
+    .trace_filename = NULL
 };
 
 /**
@@ -83,30 +145,63 @@ static struct terminal_t real_terminal = {
     .height = HEIGHT_UNSET,
     .colors = 0,
     .isatty = false,
-    .optimum_format = F_8_COLOR
+    .has_rep = false,
+    .optimum_format = F_8_COLOR,
+    .cell_width = DEFAULT_CELL_WIDTH,
+    .cell_height = DEFAULT_CELL_HEIGHT,
 };
 
 /**
  * Fake terminal used in --x-terminal-override.
  */
-static struct terminal_t fake_terminal = { 0 };
+static struct terminal_t fake_terminal = {
+    .cell_width = DEFAULT_CELL_WIDTH,
+    .cell_height = DEFAULT_CELL_HEIGHT,
+};
 
-/* Global temporary filename for dumping stdin into.  */
-static char tempfile_name[PATH_MAX + NAME_MAX + 1];
-static char tempfile_name_template[NAME_MAX + 1];
+/* The name used for an image piped in on stdin. */
+static const char stdin_name[] = "(standard input)";
 
 /* Long options */
 static struct option long_options[] = {
     /* Options affecting output colour depth. */
     { "depth",                 required_argument,      NULL,    'd'  },
+    { "perceptual",               no_argument,         NULL,    'e'  },
+    { "dither",                   optional_argument,   NULL,    'i'  },
 
     /* Options affecting size. */
     { "no-resize",                no_argument,         NULL,    'R'  },
     { "width",                    required_argument,   NULL,    'w'  },
     { "height",                   required_argument,   NULL,    'r'  },
     { "half-height",              no_argument,         NULL,    'H'  },
+    { "blocks",                   required_argument,   NULL,    'b'  },
     { "no-preserve-aspect-ratio", no_argument,         NULL,    'P'  },
 
+    /* Options affecting animations. */
+    { "animate",                  optional_argument,   NULL,    'a'  },
+
+    /* Options affecting the escape sequences. */
+    { "compress",                 optional_argument,   NULL,    'C'  },
+    { "compact",                  no_argument,         NULL,    'c'  },
+    { "transmit",                 required_argument,   NULL,    't'  },
+    { "max-bytes",                required_argument,   NULL,    'B'  },
+
+    /* Options affecting performance. */
+    { "jobs",                     required_argument,   NULL,    'j'  },
+    { "max-pending",              required_argument,   NULL,    'M'  },
+
+    /* Options affecting the render cache. */
+    { "cache",                    optional_argument,   NULL,    'k'  },
+    { "no-cache",                 no_argument,         NULL,    'n'  },
+    { "cache-size",               required_argument,   NULL,    's'  },
+    { "clear-cache",              no_argument,         NULL,    'X'  },
+    { "cache-stats",              no_argument,         NULL,    'S'  },
+
+    /* Options for rendering in a long-running server. */
+    { "serve",                    required_argument,   NULL,    'D'  },
+    { "connect",                  required_argument,   NULL,    'L'  },
+    { "server-stats",             no_argument,         NULL,    'T'  },
+
     /* Abbreviated options. */
     { "8",      no_argument, (int*) &options.format,    F_8_COLOR    },
     { "ansi",   no_argument, (int*) &options.format,    F_8_COLOR    },
@@ -114,6 +209,8 @@ static struct option long_options[] = {
     { "true",   no_argument, (int*) &options.format,    F_TRUE_COLOR },
     { "24bit",  no_argument, (int*) &options.format,    F_TRUE_COLOR },
     { "iterm2", no_argument, (int*) &options.format,    F_ITERM2     },
+    { "sixel",  no_argument, (int*) &options.format,    F_SIXEL      },
+    { "kitty",  no_argument, (int*) &options.format,    F_KITTY      },
 
     /* Common options. */
     { "help",           no_argument,            NULL,           'h'  },
@@ -123,20 +220,30 @@ static struct option long_options[] = {
     /* These flags are EXPLICITLY undocumented, as they are for development
      * use only, and can change or be removed at any time. */
     { "x-terminal-override", required_argument, NULL,           'x'  },
+    { "x-quantizer",         required_argument, NULL,           'Q'  },
+    { "x-profile",           optional_argument, NULL,           'p'  },
 
     { NULL,             0,                      NULL,           0    }
 };
 
 
-/** Returns the filename of the image to open. */
-static const char* parse_args(int argc, char **argv);
+/** Returns how many images were named, and points *images at them. */
+static int parse_args(int argc, char **argv, char ***images);
 static void bad_usage(const char *msg, ...) __attribute__((noreturn));
 static void fatal_error(int code, const char *msg, ...) __attribute__((noreturn));
 static void determine_terminal_capabilities();
+static bool is_local_session(void);
 static void determine_optimum_color_format(struct terminal_t *);
 static void set_fake_terminal(const char *);
 static void usage(FILE *dest);
-static const char *dump_stdin_into_tempfile();
+static uint8_t *read_stdin_into_memory(size_t *length);
+static int count_jobs(void);
+static struct RenderCache *open_render_cache(void);
+static struct ServerConnection *connect_to_server(void);
+static void print_stats(struct RenderCache *cache, struct ServerConnection *server);
+static int print_all(PrintRequest *requests, int count, int jobs, int max_pending,
+                     struct RenderCache *cache, struct ServerConnection *server);
+static void finish_profile(void);
 
 /* Set first thing in main(). */
 static char const* program_name;
@@ -145,21 +252,69 @@ static char const* program_name;
 int main(int argc, char **argv) {
     int desired_width = WIDTH_UNSET;
     int desired_height = HEIGHT_UNSET;
-    bool status;
-    const char *image_name;
+    int n_images;
+    char **image_names;
+    char *stdin_names[] = { (char *) stdin_name };
+    uint8_t *image_data = NULL;
+    size_t image_data_length = 0;
     Format color_format = F_UNSET;
     struct terminal_t* terminal;
     program_name = argv[0];
 
-    image_name = parse_args(argc, argv);
-    if (image_name == NULL) {
+    n_images = parse_args(argc, argv, &image_names);
+
+    if (options.profile) {
+        profile_start(options.trace_filename);
+    }
+
+    if (options.serve_socket != NULL) {
+        if (n_images > 0) {
+            bad_usage("--serve renders images for other imgcats, not %s", image_names[0]);
+        }
+        if (!server_run(options.serve_socket, count_jobs())) {
+            fatal_error(EX_UNAVAILABLE, "could not serve on %s: %s",
+                        options.serve_socket, strerror(errno));
+        }
+        finish_profile();
+        return EXIT_SUCCESS;
+    }
+
+    /* Tidying up the cache, or checking on it or the server, doesn't need
+     * an image. */
+    struct RenderCache *cache = NULL;
+    if (options.use_cache || options.clear_cache || options.show_cache_stats) {
+        cache = open_render_cache();
+    }
+    if (options.clear_cache && !render_cache_clear(cache)) {
+        fatal_error(EX_IOERR, "could not clear the cache: %s", strerror(errno));
+    }
+    struct ServerConnection *server = connect_to_server();
+    if (n_images == 0 && (options.clear_cache || options.show_cache_stats
+                          || options.show_server_stats)) {
+        print_stats(cache, server);
+        if (cache != NULL) {
+            render_cache_close(cache);
+        }
+        if (server != NULL) {
+            server_disconnect(server);
+        }
+        return EXIT_SUCCESS;
+    }
+    if (!options.use_cache && cache != NULL) {
+        render_cache_close(cache);
+        cache = NULL;
+    }
+
+    if (n_images == 0) {
         if (isatty(fileno(stdin))) {
             /* No image is specified on the command line, and there's nothing
              * redirected to stdin. */
             bad_usage("Must specify an image file.");
         } else {
             /* There's an image redirected to stdin. */
-            image_name = dump_stdin_into_tempfile();
+            image_data = read_stdin_into_memory(&image_data_length);
+            image_names = stdin_names;
+            n_images = 1;
         }
     }
 
@@ -194,25 +349,243 @@ int main(int argc, char **argv) {
         color_format = terminal->optimum_format;
     }
 
+    /* Sixel and kitty images are sized in pixels, not character cells. */
+    int max_width = terminal->width, max_height = terminal->height;
+    if (color_format == F_SIXEL || color_format == F_KITTY) {
+        max_width *= terminal->cell_width;
+        max_height *= terminal->cell_height;
+        desired_width *= terminal->cell_width;
+        desired_height *= terminal->cell_height;
+    }
+
+    /* Only use REP when the terminal says it knows what it is. */
+    Emission emission = options.emission;
+    if (options.detect_rep && terminal->has_rep) {
+        emission = E_DELTA_REP;
+    }
+
+    /* Only a terminal on this machine, reading our stdout itself, will read
+     * (and delete) the file. */
+    KittyMedium kitty_medium = options.kitty_medium;
+    if (options.detect_kitty_medium) {
+        kitty_medium = isatty(STDOUT_FILENO) && is_local_session() ? K_FILE : K_DIRECT;
+    }
+
+    int jobs = count_jobs();
+
+    /* Keep enough images on hand that every worker can be decoding one. */
+    int max_pending = options.max_pending;
+    if (max_pending == 0) {
+        max_pending = jobs + 1;
+    }
+
     PrintRequest request = (PrintRequest) {
-        .filename = image_name,
+        .filename = NULL,
+        .data = image_data,
+        .data_length = image_data_length,
         .desired_width = desired_width,
         .desired_height = desired_height,
-        .max_width = terminal->width,
-        .max_height = terminal->height,
-        .half_height = options.use_half_height,
+        .max_width = max_width,
+        .max_height = max_height,
+        .blocks = options.blocks,
         .format = color_format,
-        .preserve_aspect_ratio = options.should_preserve_aspect_ratio
+        .preserve_aspect_ratio = options.should_preserve_aspect_ratio,
+        .quantizer = options.quantizer,
+        .dither = options.dither,
+        .emission = emission,
+        .kitty_medium = kitty_medium,
+        .compact_escapes = options.use_compact_escapes,
+        .max_bytes = options.max_bytes,
+        .jobs = jobs,
+        .animate = options.animate,
+        .plays = options.plays,
+        .output_fd = STDOUT_FILENO
     };
-    status = print_image(&request);
+    PrintRequest *requests = malloc(n_images * sizeof(PrintRequest));
+    if (requests == NULL) {
+        fatal_error(EX_OSERR, "could not allocate memory for %d images", n_images);
+    }
+    for (int i = 0; i < n_images; i++) {
+        requests[i] = request;
+        requests[i].filename = image_names[i];
+    }
+
+    int failures = print_all(requests, n_images, jobs, max_pending, cache, server);
+    free(requests);
+    free(image_data);
 
-    if (!status) {
-        bad_usage("Failed to open image: %s", image_name);
+    print_stats(cache, server);
+    if (cache != NULL) {
+        render_cache_close(cache);
+    }
+    if (server != NULL) {
+        server_disconnect(server);
+    }
+    finish_profile();
+
+    if (failures > 0) {
+        usage(stderr);
+        return EX_USAGE;
     }
 
     return EXIT_SUCCESS;
 }
 
+/**
+ * Prints every image, in order, complaining about those that can't be opened.
+ * While one image is being printed, the next few are decoded in the
+ * background. Returns how many images could not be printed.
+ */
+static int print_all(PrintRequest *requests, int count, int jobs, int max_pending,
+                     struct RenderCache *cache, struct ServerConnection *server) {
+    struct DecodePool *pool = NULL;
+    int failures = 0;
+
+    /* iTerm2 images are passed through without decoding them, a lone image
+     * has nothing to be decoded alongside, animations are decoded as
+     * they're played, images with a budget are decoded again at whatever
+     * size fits, and cached or served images needn't be decoded here
+     * at all. */
+    if (count > 1 && requests[0].format != F_ITERM2 && !requests[0].animate
+            && requests[0].max_bytes == 0 && cache == NULL && server == NULL) {
+        pool = decode_pool_new(requests, count, jobs, max_pending);
+    }
+
+    for (int i = 0; i < count; i++) {
+        bool success;
+        enum ServerResult served = SERVER_UNAVAILABLE;
+
+        /* If the server can't help, print it here instead. */
+        if (server != NULL) {
+            served = server_print(server, &requests[i]);
+        }
+
+        if (served != SERVER_UNAVAILABLE) {
+            success = served == SERVER_PRINTED;
+        } else if (pool != NULL) {
+            struct Image image;
+            success = decode_pool_next(pool, &image)
+                && print_decoded_image(&requests[i], &image);
+        } else if (cache != NULL) {
+            success = render_cache_print(cache, &requests[i]);
+        } else {
+            success = print_image(&requests[i]);
+        }
+
+        if (!success) {
+            fprintf(stderr, "%s: Failed to open image: %s\n",
+                    program_name, requests[i].filename);
+            failures++;
+        }
+    }
+
+    if (pool != NULL) {
+        decode_pool_free(pool);
+    }
+    return failures;
+}
+
+/**
+ * How many threads to use: one per core, unless told otherwise.
+ */
+static int count_jobs(void) {
+    if (options.jobs > 0) {
+        return options.jobs;
+    }
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    return cores > 0 ? (int) cores : 1;
+}
+
+/**
+ * Opens the cache named by --cache, or else the one in the user's cache
+ * directory (per the XDG Base Directory Specification).
+ */
+static struct RenderCache *open_render_cache(void) {
+    char directory[PATH_MAX];
+    const char *xdg_cache_home = getenv("XDG_CACHE_HOME");
+    const char *home = getenv("HOME");
+    int length;
+
+    if (options.cache_directory != NULL) {
+        length = snprintf(directory, sizeof(directory), "%s", options.cache_directory);
+    } else if (xdg_cache_home != NULL && xdg_cache_home[0] == '/') {
+        length = snprintf(directory, sizeof(directory), "%s/imgcat", xdg_cache_home);
+    } else if (home != NULL && home[0] != '\0') {
+        length = snprintf(directory, sizeof(directory), "%s/.cache/imgcat", home);
+    } else {
+        fatal_error(EX_CONFIG, "could not find a cache directory: try --cache=DIR");
+    }
+    if (length < 0 || (size_t) length >= sizeof(directory)) {
+        fatal_error(EX_CONFIG, "cache directory name is too long");
+    }
+
+    struct RenderCache *cache = render_cache_open(directory, options.cache_size);
+    if (cache == NULL) {
+        fatal_error(EX_CANTCREAT, "could not open cache %s: %s",
+                    directory, strerror(errno));
+    }
+    return cache;
+}
+
+/**
+ * Connects to the server named by --connect or $IMGCAT_SOCKET, if any.
+ * Images are printed here if there's no server listening, unless the
+ * user explicitly wanted to hear from it.
+ */
+static struct ServerConnection *connect_to_server(void) {
+    const char *socket_path = options.connect_socket;
+    if (socket_path == NULL) {
+        socket_path = getenv("IMGCAT_SOCKET");
+    }
+    if (socket_path == NULL || socket_path[0] == '\0') {
+        if (options.show_server_stats) {
+            bad_usage("--server-stats needs --connect=SOCKET");
+        }
+        return NULL;
+    }
+
+    struct ServerConnection *server = server_connect(socket_path);
+    if (server == NULL && options.show_server_stats) {
+        fatal_error(EX_UNAVAILABLE, "could not connect to %s: %s",
+                    socket_path, strerror(errno));
+    }
+    return server;
+}
+
+/**
+ * Prints the statistics asked for by --cache-stats and --server-stats.
+ */
+static void print_stats(struct RenderCache *cache, struct ServerConnection *server) {
+    if (options.show_cache_stats) {
+        struct RenderCacheStats stats;
+        if (!render_cache_stats(cache, &stats)) {
+            fatal_error(EX_IOERR, "could not read cache stats: %s", strerror(errno));
+        }
+
+        printf("hits: %" PRIu64 "\n", stats.hits);
+        printf("misses: %" PRIu64 "\n", stats.misses);
+        printf("entries: %" PRIu64 "\n", stats.entries);
+        printf("bytes: %" PRIu64 "\n", stats.bytes);
+    }
+
+    if (options.show_server_stats) {
+        fflush(stdout);
+        if (!server_print_stats(server, STDOUT_FILENO)) {
+            fatal_error(EX_UNAVAILABLE, "could not get the server's stats");
+        }
+    }
+}
+
+/**
+ * Prints what --x-profile measured, and writes the trace.
+ */
+static void finish_profile(void) {
+    if (!profile_finish()) {
+        fprintf(stderr, "%s: could not write trace to %s: %s\n",
+                program_name, options.trace_filename, strerror(errno));
+    }
+}
+
 /**
  * Get the color capability from the terminfo database.
  */
@@ -232,6 +605,39 @@ static int get_terminal_colours() {
     return tigetnum("colors");
 }
 
+/**
+ * Whether terminfo says the terminal supports REP. Must be called after
+ * get_terminal_colours() has loaded the terminal's entry.
+ */
+static bool get_terminal_has_rep() {
+    const char *rep = tigetstr("rep");
+    return rep != NULL && rep != (char *) -1;
+}
+
+/**
+ * Whether stdout goes straight to a terminal on this machine: not over ssh,
+ * and not through tmux or screen, which don't pass kitty graphics through.
+ */
+static bool is_local_session(void) {
+    return getenv("SSH_CONNECTION") == NULL && getenv("SSH_CLIENT") == NULL
+        && getenv("SSH_TTY") == NULL && getenv("TMUX") == NULL && getenv("STY") == NULL;
+}
+
+/**
+ * Whether stdout is a terminal that shows kitty graphics: kitty, WezTerm, or
+ * Ghostty. Their variables are inherited by everything started inside them,
+ * including tmux and screen; so for kitty, TERM has to say so, too.
+ */
+static bool has_kitty_graphics(void) {
+    const char *term = getenv("TERM"), *program = getenv("TERM_PROGRAM");
+    if (getenv("TMUX") != NULL || getenv("STY") != NULL) {
+        return false;
+    }
+    return (term != NULL && strcmp(term, "xterm-kitty") == 0 && getenv("KITTY_WINDOW_ID") != NULL)
+        || (term != NULL && strcmp(term, "xterm-ghostty") == 0)
+        || (program != NULL && strcmp(program, "WezTerm") == 0);
+}
+
 /**
  * Determines the terminal's capabilities:
  * its optimum colour depth and dimensions.
@@ -252,12 +658,20 @@ static void determine_terminal_capabilities() {
     assert(ioctl(stdout_fd, TIOCGWINSZ, &ws) != -1);
     real_terminal.width = ws.ws_col;
     real_terminal.height = ws.ws_row;
+    /* Not every terminal fills in its size in pixels. */
+    if (ws.ws_col > 0 && ws.ws_xpixel >= ws.ws_col && ws.ws_row > 0 && ws.ws_ypixel >= ws.ws_row) {
+        real_terminal.cell_width = ws.ws_xpixel / ws.ws_col;
+        real_terminal.cell_height = ws.ws_ypixel / ws.ws_row;
+    }
 
     real_terminal.colors = get_terminal_colours();
+    real_terminal.has_rep = get_terminal_has_rep();
 
     /* ITERM_SESSION_ID is exported in iTerm2 sessions. */
     if (getenv("ITERM_SESSION_ID") != NULL) {
         real_terminal.optimum_format = F_ITERM2;
+    } else if (has_kitty_graphics()) {
+        real_terminal.optimum_format = F_KITTY;
     } else {
         /* Otherwise, determine the capability from the reported colours. */
         determine_optimum_color_format(&real_terminal);
@@ -283,45 +697,49 @@ static void determine_optimum_color_format(struct terminal_t *terminal) {
 }
 
 /**
- * Removes the temporary file. Intended to be the atexit() callback.
+ * Slurps all of stdin into a malloc'd buffer, using as few read(2) calls as
+ * possible. The image is decoded straight from this buffer, since CImg can't
+ * load from a pipe by name (it likes to close and reopen the file it's
+ * reading, which discards header data when reading from /dev/stdin).
  */
-static void unlink_tempfile(void) {
-    remove(tempfile_name);
-}
-
-/**
- * This is necessary because CImg likes to close and reopen the file it's
- * reading, which discards header data when reading from /dev/stdin.
- */
-static const char *dump_stdin_into_tempfile() {
-    int byte;
-
-    /* Set up the mutable buffer for mkstemp() to do its magic. */
-    strncpy(tempfile_name_template, "imgcat.XXXXXXXX", NAME_MAX);
-    snprintf(tempfile_name, PATH_MAX + NAME_MAX, "%s/%s", P_tmpdir, tempfile_name_template);
-
-    int output_fd = mkstemp(tempfile_name);
-    if (output_fd == -1) {
-        fatal_error(EX_TEMPFAIL, "could not create temporary file: %s",
-                    strerror(errno));
+static uint8_t *read_stdin_into_memory(size_t *length) {
+    /* Start big enough for most pictures, and double as needed. */
+    size_t capacity = 1024 * 1024;
+    size_t used = 0;
+    int64_t start = profile_now();
+    uint8_t *buffer = malloc(capacity);
+    if (buffer == NULL) {
+        fatal_error(EX_OSERR, "could not allocate memory for stdin");
     }
 
-    FILE *output = fdopen(output_fd, "wb");
-    if (output == NULL) {
-        fatal_error(EX_IOERR, "could not open temporary file: %s",
-                    strerror(errno));
-    }
+    while (1) {
+        if (used == capacity) {
+            capacity *= 2;
+            uint8_t *bigger = realloc(buffer, capacity);
+            if (bigger == NULL) {
+                fatal_error(EX_OSERR, "could not allocate memory for stdin");
+            }
+            buffer = bigger;
+        }
 
-    /* TODO: do something better than a byte-for-byte file transfer. */
-    while ((byte = getchar()) != EOF) {
-        fputc(byte, output);
+        ssize_t bytes_read = read(STDIN_FILENO, buffer + used, capacity - used);
+        if (bytes_read == 0) {
+            break;
+        } else if (bytes_read < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            fatal_error(EX_IOERR, "could not read stdin: %s", strerror(errno));
+        }
+        used += bytes_read;
     }
-    fclose(output);
 
-    /* Remove the file at ordinary exit. */
-    atexit(unlink_tempfile);
+    profile_add(P_READ, start);
+    profile_count(P_BYTES_READ, used);
+    profile_span("read", start, stdin_name);
 
-    return tempfile_name;
+    *length = used;
+    return buffer;
 }
 
 static void usage(FILE *dest) {
@@ -329,8 +747,19 @@ static void usage(FILE *dest) {
     fprintf(dest, "Usage:\n");
     fprintf(dest,
             "\t%s"  " [--width=<columns> --height=<rows>|--no-resize] [--no-preserve-aspect-ratio]\n"
-            "\t%*c" " [--half-height] [--depth=(8|256|24bit|iterm2)] IMAGE\n",
-            program_name, field_width, ' ');
+            "\t%*c" " [--half-height|--blocks=(full|half|quadrant|sextant)]\n"
+            "\t%*c" " [--depth=(8|256|24bit|iterm2|sixel|kitty)]\n"
+            "\t%*c" " [--perceptual] [--dither[=(diffusion|ordered|none)]] [--animate[=N]]\n"
+            "\t%*c" " [--compact] [--compress[=(auto|rep|norep)]] [--max-bytes=SIZE]\n"
+            "\t%*c" " [--transmit=(auto|direct|file|shm)] [--jobs=N] [--max-pending=N]\n"
+            "\t%*c" " [--cache[=DIR]|--no-cache] [--cache-size=SIZE] [--clear-cache]\n"
+            "\t%*c" " [--cache-stats] [--connect=SOCKET [--server-stats]]\n"
+            "\t%*c" " IMAGE...\n",
+            program_name, field_width, ' ', field_width, ' ', field_width, ' ',
+            field_width, ' ', field_width, ' ', field_width, ' ', field_width, ' ',
+            field_width, ' ');
+    fprintf(dest, "\t"
+            "%s --serve=SOCKET [--jobs=N]\n", program_name);
     fprintf(dest, "\t"
             "%s --version\n", program_name);
     fprintf(dest, "\t"
@@ -376,20 +805,161 @@ static Format parse_format(const char *arg) {
         return F_8_COLOR;
     } else if (argeq("iterm2")) {
         return F_ITERM2;
+    } else if (argeq("sixel")) {
+        return F_SIXEL;
+    } else if (argeq("kitty")) {
+        return F_KITTY;
     }
 
     return F_UNSET;
 #   undef argeq
 }
 
-static const char* parse_args(int argc, char **argv) {
+/**
+ * Parses the --compress string. Returns true if it was understood.
+ */
+static bool parse_compression(const char *arg) {
+#   define argeq(b)     (strncmp(arg, (b), (sizeof(b))) == 0)
+
+    options.emission = E_DELTA;
+    options.detect_rep = false;
+
+    if (arg == NULL || argeq("auto")) {
+        options.detect_rep = true;
+    } else if (argeq("rep")) {
+        options.emission = E_DELTA_REP;
+    } else if (argeq("norep")) {
+        /* Nothing else to do. */
+    } else {
+        return false;
+    }
+
+    return true;
+#   undef argeq
+}
+
+/**
+ * Parses the --transmit string. Returns true if it was understood.
+ */
+static bool parse_kitty_medium(const char *arg) {
+#   define argeq(b)     (strncmp(arg, (b), (sizeof(b))) == 0)
+
+    options.detect_kitty_medium = false;
+
+    if (argeq("auto")) {
+        options.detect_kitty_medium = true;
+    } else if (argeq("direct")) {
+        options.kitty_medium = K_DIRECT;
+    } else if (argeq("file")) {
+        options.kitty_medium = K_FILE;
+    } else if (argeq("shm")) {
+        options.kitty_medium = K_SHARED_MEMORY;
+    } else {
+        return false;
+    }
+
+    return true;
+#   undef argeq
+}
+
+/**
+ * Parses the --blocks string. Returns true if it was understood.
+ */
+static bool parse_blocks(const char *arg, Blocks *blocks) {
+#   define argeq(b)     (strncmp(arg, (b), (sizeof(b))) == 0)
+
+    if (argeq("full")) {
+        *blocks = B_FULL;
+    } else if (argeq("half")) {
+        *blocks = B_HALF;
+    } else if (argeq("quadrant")) {
+        *blocks = B_QUADRANT;
+    } else if (argeq("sextant")) {
+        *blocks = B_SEXTANT;
+    } else {
+        return false;
+    }
+
+    return true;
+#   undef argeq
+}
+
+/**
+ * Parses the --dither string. Returns true if it was understood.
+ */
+static bool parse_dither(const char *arg, Dither *dither) {
+#   define argeq(b)     (strncmp(arg, (b), (sizeof(b))) == 0)
+
+    if (arg == NULL || argeq("diffusion")) {
+        *dither = D_DIFFUSION;
+    } else if (argeq("ordered")) {
+        *dither = D_ORDERED;
+    } else if (argeq("none")) {
+        *dither = D_NONE;
+    } else {
+        return false;
+    }
+
+    return true;
+#   undef argeq
+}
+
+/**
+ * Parses the --cache-size string: a number of bytes, optionally followed by
+ * K, M, or G (powers of 1024). Returns true if it was understood.
+ */
+static bool parse_size(const char *arg, size_t *size) {
+    char *end;
+    errno = 0;
+    unsigned long long value = strtoull(arg, &end, 10);
+    if (end == arg || arg[0] == '-' || errno != 0) {
+        return false;
+    }
+
+    int shift = 0;
+    switch (*end) {
+        case 'K': case 'k': shift = 10; end++; break;
+        case 'M': case 'm': shift = 20; end++; break;
+        case 'G': case 'g': shift = 30; end++; break;
+    }
+    if (*end != '\0' || value > (SIZE_MAX >> shift)) {
+        return false;
+    }
+
+    *size = (size_t) value << shift;
+    return true;
+}
+
+/**
+ * Parses the --x-quantizer string. Returns true if it was understood.
+ */
+static bool parse_quantizer(const char *arg, Quantizer *quantizer) {
+#   define argeq(b)     (strncmp(arg, (b), (sizeof(b))) == 0)
+
+    if (argeq("exact")) {
+        *quantizer = Q_EXACT;
+    } else if (argeq("table")) {
+        *quantizer = Q_TABLE;
+    } else if (argeq("tree")) {
+        *quantizer = Q_TREE;
+    } else if (argeq("perceptual")) {
+        *quantizer = Q_PERCEPTUAL;
+    } else {
+        return false;
+    }
+
+    return true;
+#   undef argeq
+}
+
+static int parse_args(int argc, char **argv, char ***images) {
     int c;
     /* Disable getopt_long from printing to stderr. */
     extern int opterr;
     opterr = 0;
 
     while (1) {
-        c = getopt_long(argc, argv, "w:r:d:PRHhv", long_options, NULL);
+        c = getopt_long(argc, argv, "w:r:d:C::cj:a::PRHhv", long_options, NULL);
         if (c == -1) {
             break;
         }
@@ -411,13 +981,23 @@ static const char* parse_args(int argc, char **argv) {
                 }
                 break;
 
-            case 'd': /* --depth=(8|ansi|256|24bit|true|iterm2) */
+            case 'd': /* --depth=(8|ansi|256|24bit|true|iterm2|sixel|kitty) */
                 options.format = parse_format(optarg);
                 if (options.format == F_UNSET) {
                     bad_usage("Unknown output format: %s", optarg);
                 }
                 break;
 
+            case 'e': /* --perceptual */
+                options.quantizer = Q_PERCEPTUAL;
+                break;
+
+            case 'i': /* --dither[=(diffusion|ordered|none)] */
+                if (!parse_dither(optarg, &options.dither)) {
+                    bad_usage("Unknown dither: %s", optarg);
+                }
+                break;
+
             case 'P': /* --no-preserve-aspect-ratio */
                 options.should_preserve_aspect_ratio = false;
                 break;
@@ -427,7 +1007,104 @@ static const char* parse_args(int argc, char **argv) {
                 break;
 
             case 'H': /* --half-height */
-                options.use_half_height = true;
+                options.blocks = B_HALF;
+                break;
+
+            case 'b': /* --blocks=(full|half|quadrant|sextant) */
+                if (!parse_blocks(optarg, &options.blocks)) {
+                    bad_usage("Unknown blocks: %s", optarg);
+                }
+                break;
+
+            case 'a': /* --animate[=N] */
+                options.animate = true;
+                if (optarg != NULL) {
+                    options.plays = (int)strtol(optarg, NULL, 10);
+                    if (options.plays < 1) {
+                        bad_usage("Animations must play a positive number of times, not '%s'",
+                                  optarg);
+                    }
+                }
+                break;
+
+            case 'c': /* --compact */
+                options.use_compact_escapes = true;
+                break;
+
+            case 'j': /* --jobs */
+                options.jobs = (int)strtol(optarg, NULL, 10);
+                if (options.jobs < 1) {
+                    bad_usage("Jobs must be a positive integer, not '%s'",
+                              optarg);
+                }
+                break;
+
+            case 'M': /* --max-pending */
+                options.max_pending = (int)strtol(optarg, NULL, 10);
+                if (options.max_pending < 1) {
+                    bad_usage("Max pending must be a positive integer, not '%s'",
+                              optarg);
+                }
+                break;
+
+            case 'k': /* --cache[=DIR] */
+                options.use_cache = true;
+                if (optarg != NULL) {
+                    if (optarg[0] == '\0') {
+                        bad_usage("Cache directory must not be empty");
+                    }
+                    options.cache_directory = optarg;
+                }
+                break;
+
+            case 'n': /* --no-cache */
+                options.use_cache = false;
+                break;
+
+            case 'B': /* --max-bytes */
+                if (!parse_size(optarg, &options.max_bytes) || options.max_bytes == 0) {
+                    bad_usage("Maximum bytes must be a positive number of bytes, not '%s'",
+                              optarg);
+                }
+                break;
+
+            case 's': /* --cache-size */
+                if (!parse_size(optarg, &options.cache_size)) {
+                    bad_usage("Cache size must be a number of bytes, not '%s'",
+                              optarg);
+                }
+                break;
+
+            case 'X': /* --clear-cache */
+                options.clear_cache = true;
+                break;
+
+            case 'S': /* --cache-stats */
+                options.show_cache_stats = true;
+                break;
+
+            case 'D': /* --serve */
+                options.serve_socket = optarg;
+                break;
+
+            case 'L': /* --connect */
+                options.connect_socket = optarg;
+                break;
+
+            case 'T': /* --server-stats */
+                options.show_server_stats = true;
+                break;
+
+            case 'C': /* --compress[=(auto|rep|norep)] */
+                if (!parse_compression(optarg)) {
+                    bad_usage("Unknown compression: %s", optarg);
+                }
+                break;
+
+            case 't': /* --transmit=(auto|direct|file|shm) */
+                if (!parse_kitty_medium(optarg)) {
+                    bad_usage("Unknown transmission medium: %s", optarg);
+                }
                 break;
 
             case 'h': /* --help */
@@ -445,6 +1122,17 @@ static const char* parse_args(int argc, char **argv) {
                 set_fake_terminal(optarg);
                 break;
 
+            case 'Q': /* --x-quantizer=(exact|table|tree|perceptual) */
+                if (!parse_quantizer(optarg, &options.quantizer)) {
+                    bad_usage("Unknown quantizer: %s", optarg);
+                }
+                break;
+
+            case 'p': /* --x-profile[=TRACE] */
+                options.profile = true;
+                options.trace_filename = optarg;
+                break;
+
             case 0:
                 /* Set an abbreviated option like --8, --ansi, --256. */
                 break;
@@ -456,13 +1144,10 @@ static const char* parse_args(int argc, char **argv) {
         }
     }
 
-    if (argc == optind) {
-        /* This means getopt() has exhausted all of argv and has not found a
-         * valid image name argument. */
-        return NULL;
-    } else {
-        return argv[optind];
-    }
+    /* Everything getopt() didn't consume is an image name. If there are
+     * none, the image is expected on stdin. */
+    *images = argv + optind;
+    return argc - optind;
 }
 
 
@@ -0,0 +1,107 @@
+/*
+ * Copyright (c) 2026 Eddie Antonio Santos <hello@eddieantonio.ca>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+
+/**
+ * @file interleave.c
+ * @brief Planar to interleaved conversion, sixteen pixels at a time.
+ */
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "interleave.h"
+
+enum {
+    OPAQUE = 0xFF,
+};
+
+/**
+ * The one kernel behind every variant. When it's inlined with alpha == NULL,
+ * or with red == green == blue, the compiler drops what isn't needed.
+ */
+static inline void interleave(const uint8_t *red, const uint8_t *green,
+                              const uint8_t *blue, const uint8_t *alpha,
+                              int width, uint8_t *dest) {
+    int x = 0;
+
+#if defined(__SSE2__)
+    const __m128i opaque = _mm_set1_epi8((char) OPAQUE);
+    for (; x + 16 <= width; x += 16, dest += 64) {
+        __m128i r = _mm_loadu_si128((const __m128i *) (red + x));
+        __m128i g = _mm_loadu_si128((const __m128i *) (green + x));
+        __m128i b = _mm_loadu_si128((const __m128i *) (blue + x));
+        __m128i a = alpha ? _mm_loadu_si128((const __m128i *) (alpha + x)) : opaque;
+
+        /* Bytes into RG and BA pairs, then pairs into whole pixels. */
+        __m128i rg_lo = _mm_unpacklo_epi8(r, g), rg_hi = _mm_unpackhi_epi8(r, g);
+        __m128i ba_lo = _mm_unpacklo_epi8(b, a), ba_hi = _mm_unpackhi_epi8(b, a);
+        _mm_storeu_si128((__m128i *) (dest + 0), _mm_unpacklo_epi16(rg_lo, ba_lo));
+        _mm_storeu_si128((__m128i *) (dest + 16), _mm_unpackhi_epi16(rg_lo, ba_lo));
+        _mm_storeu_si128((__m128i *) (dest + 32), _mm_unpacklo_epi16(rg_hi, ba_hi));
+        _mm_storeu_si128((__m128i *) (dest + 48), _mm_unpackhi_epi16(rg_hi, ba_hi));
+    }
+#endif
+
+    /* Scalar fallback, and the leftovers from the vector loop. */
+    for (; x < width; x++, dest += 4) {
+        dest[0] = red[x];
+        dest[1] = green[x];
+        dest[2] = blue[x];
+        dest[3] = alpha ? alpha[x] : OPAQUE;
+    }
+}
+
+static void interleave_grey(const uint8_t *const planes[], int width, uint8_t *dest) {
+    interleave(planes[0], planes[0], planes[0], NULL, width, dest);
+}
+
+static void interleave_grey_alpha(const uint8_t *const planes[], int width, uint8_t *dest) {
+    interleave(planes[0], planes[0], planes[0], planes[1], width, dest);
+}
+
+static void interleave_rgb(const uint8_t *const planes[], int width, uint8_t *dest) {
+    interleave(planes[0], planes[1], planes[2], NULL, width, dest);
+}
+
+static void interleave_rgba(const uint8_t *const planes[], int width, uint8_t *dest) {
+    interleave(planes[0], planes[1], planes[2], planes[3], width, dest);
+}
+
+void interleave_row(const uint8_t *const planes[], int channels, int width,
+                    uint8_t *dest) {
+    assert(channels >= 1);
+
+    switch (channels) {
+        case 1:
+            interleave_grey(planes, width, dest);
+            break;
+        case 2:
+            interleave_grey_alpha(planes, width, dest);
+            break;
+        case 3:
+            interleave_rgb(planes, width, dest);
+            break;
+        default:
+            interleave_rgba(planes, width, dest);
+            break;
+    }
+}
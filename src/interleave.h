@@ -0,0 +1,51 @@
+/*
+ * Copyright (c) 2026 Eddie Antonio Santos <hello@eddieantonio.ca>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+
+/**
+ * @file interleave.h
+ * @brief Converts rows of planar channels into rows of 32bpp pixels.
+ *
+ * CImg keeps each channel in its own plane, but an Image wants all four
+ * bytes of a pixel side by side. These convert a whole row at a time.
+ */
+
+#ifndef INTERLEAVE_H
+#define INTERLEAVE_H
+
+#ifdef __cplusplus
+#include <cstdint>
+extern "C" {
+#else
+#include <stdint.h>
+#endif
+
+/**
+ * Interleaves one row of width pixels from planes[0] to planes[channels - 1]
+ * into dest, which must have room for 4 * width bytes.
+ *
+ *  - 1 channel is grey: copied into R, G, and B; alpha is opaque.
+ *  - 2 channels are grey and alpha.
+ *  - 3 channels are R, G, and B; alpha is opaque.
+ *  - 4 (or more) channels are R, G, B, and alpha; the rest are ignored.
+ */
+void interleave_row(const uint8_t *const planes[], int channels, int width,
+                    uint8_t *dest);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+#endif /* INTERLEAVE_H */
@@ -0,0 +1,211 @@
+/*
+ * Copyright (c) 2026 Eddie Antonio Santos <hello@eddieantonio.ca>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+
+/**
+ * @file kitty.c
+ * @brief Sends an image's pixels as they are, by whichever medium is cheapest.
+ *
+ * A terminal on the same machine can read the pixels straight out of a
+ * temporary file or a shared memory object, so only its name has to go
+ * through the tty. Otherwise, the pixels are compressed and sent base64
+ * encoded, in as many escape sequences as it takes.
+ */
+
+/* Feature-test macro for mkstemp(3) and shm_open(3). */
+#define _XOPEN_SOURCE 700
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "kitty.h"
+#include "base64.h"
+#include "config.h"
+#include "load_image.h"
+#include "output.h"
+
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+enum {
+    /* The protocol allows at most this many base64 characters per escape
+     * sequence... */
+    CHUNK_LEN = 4096,
+    /* ...which is this many bytes. */
+    CHUNK_BYTES = CHUNK_LEN / 4 * 3,
+    /* Long enough for "\033_Ga=T,f=32,s=2147483647,v=2147483647,..." */
+    MAX_CONTROL_LEN = 128,
+};
+
+/* The terminal only deletes temporary files with this in their names. */
+static const char file_template[] = "tty-graphics-protocol-imgcat-XXXXXX";
+
+static bool write_all(int fd, const uint8_t *data, size_t length) {
+    while (length > 0) {
+        ssize_t written = write(fd, data, length);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        data += written;
+        length -= written;
+    }
+    return true;
+}
+
+static size_t image_size(const struct Image *image) {
+    return (size_t) image->width * image->height * image->depth;
+}
+
+/**
+ * Writes the pixels to a new temporary file, whose path is written to path.
+ */
+static bool write_file(const struct Image *image, char path[PATH_MAX]) {
+    const char *directory = getenv("TMPDIR");
+    if (directory == NULL || directory[0] == '\0') {
+        directory = "/tmp";
+    }
+    int length = snprintf(path, PATH_MAX, "%s/%s", directory, file_template);
+    if (length < 0 || length >= PATH_MAX) {
+        return false;
+    }
+
+    int fd = mkstemp(path);
+    if (fd == -1) {
+        return false;
+    }
+    bool success = write_all(fd, image->buffer, image_size(image));
+    if (close(fd) != 0 || !success) {
+        unlink(path);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Copies the pixels into a new shared memory object, whose name is written
+ * to name.
+ */
+static bool write_shared_memory(const struct Image *image, char name[PATH_MAX]) {
+    static unsigned counter = 0;
+    const size_t size = image_size(image);
+
+    snprintf(name, PATH_MAX, "/tty-graphics-protocol-imgcat-%ld-%u", (long) getpid(),
+             __atomic_fetch_add(&counter, 1, __ATOMIC_RELAXED));
+    int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd == -1) {
+        return false;
+    }
+
+    void *memory = MAP_FAILED;
+    if (ftruncate(fd, size) == 0) {
+        memory = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+    if (memory == MAP_FAILED) {
+        shm_unlink(name);
+        return false;
+    }
+
+    memcpy(memory, image->buffer, size);
+    munmap(memory, size);
+    return true;
+}
+
+/**
+ * Appends one escape sequence: the control data, then the payload, base64
+ * encoded.
+ */
+static void print_command(const char *control, const void *payload, size_t length,
+                          struct Output *output) {
+    output_puts(output, "\033_G");
+    output_puts(output, control);
+    output_puts(output, ";");
+    if (output_reserve(output, base64_encoded_length(length))) {
+        output->length += base64_encode(payload, length, output->data + output->length);
+    }
+    output_puts(output, "\033\\");
+}
+
+/**
+ * Sends the pixels in the escape sequences themselves: compressed if
+ * possible, and split into chunks the terminal will accept.
+ */
+static void print_direct(const struct Image *image, struct Output *output) {
+    const uint8_t *payload = image->buffer;
+    size_t length = image_size(image);
+    const char *compression = "";
+    char control[MAX_CONTROL_LEN];
+
+#ifdef HAVE_ZLIB
+    /* Speed matters more than size here: even the fastest level shrinks
+     * the pixels (and their alpha channel) a lot. */
+    uLongf compressed_length = compressBound(length);
+    uint8_t *compressed = malloc(compressed_length);
+    if (compressed != NULL
+            && compress2(compressed, &compressed_length, payload, length, Z_BEST_SPEED) == Z_OK) {
+        payload = compressed;
+        length = compressed_length;
+        compression = ",o=z";
+    }
+#endif
+
+    for (size_t offset = 0; offset == 0 || offset < length; offset += CHUNK_BYTES) {
+        size_t chunk = length - offset < CHUNK_BYTES ? length - offset : CHUNK_BYTES;
+        int more = offset + chunk < length;
+        if (offset == 0) {
+            snprintf(control, sizeof(control), "a=T,f=32,s=%d,v=%d,q=2%s,m=%d",
+                     image->width, image->height, compression, more);
+        } else {
+            snprintf(control, sizeof(control), "m=%d", more);
+        }
+        print_command(control, payload + offset, chunk, output);
+    }
+
+#ifdef HAVE_ZLIB
+    free(compressed);
+#endif
+}
+
+bool kitty_print(const struct Image *image, KittyMedium medium, struct Output *output) {
+    char control[MAX_CONTROL_LEN];
+    char name[PATH_MAX];
+
+    if (medium == K_DIRECT) {
+        print_direct(image, output);
+    } else {
+        bool shared = medium == K_SHARED_MEMORY;
+        if (shared ? !write_shared_memory(image, name) : !write_file(image, name)) {
+            return false;
+        }
+        snprintf(control, sizeof(control), "a=T,f=32,s=%d,v=%d,q=2,t=%c,S=%zu",
+                 image->width, image->height, shared ? 's' : 't', image_size(image));
+        print_command(control, name, strlen(name), output);
+    }
+
+    /* Like iTerm2, leave the cursor on the line after the image. */
+    output_puts(output, "\n");
+    return true;
+}
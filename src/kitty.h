@@ -0,0 +1,44 @@
+/*
+ * Copyright (c) 2026 Eddie Antonio Santos <hello@eddieantonio.ca>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+
+/**
+ * @file kitty.h
+ * @brief Prints images with the kitty graphics protocol.
+ *
+ * https://sw.kovidgoyal.net/kitty/graphics-protocol/
+ */
+
+#ifndef KITTY_H
+#define KITTY_H
+
+#include "print_image.h"
+
+struct Image;
+struct Output;
+
+/**
+ * Appends an image (32bpp, as in struct Image) to output, as one kitty
+ * graphics escape sequence, followed by a new line. The pixels are sent by
+ * medium. Returns false, having appended nothing, if they couldn't be
+ * written there (say, because /dev/shm is full).
+ *
+ * With K_FILE and K_SHARED_MEMORY, only a few dozen bytes are appended, no
+ * matter how big the image is.
+ */
+bool kitty_print(const struct Image *image, KittyMedium medium, struct Output *output);
+
+#endif /* KITTY_H */
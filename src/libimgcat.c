@@ -0,0 +1,188 @@
+/*
+ * Copyright (c) 2026 Eddie Antonio Santos <hello@eddieantonio.ca>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+
+/**
+ * @file libimgcat.c
+ * @brief print_image(), pointed at a buffer instead of stdout.
+ */
+
+/* Feature-test macro for fstat(2). */
+#define _XOPEN_SOURCE 600
+#include <errno.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "libimgcat.h"
+#include "output.h"
+
+enum {
+    /* How much to read from a descriptor whose size isn't known up front. */
+    INITIAL_INPUT_CAPACITY = 64 * 1024,
+};
+
+struct ImgcatContext {
+    /* What imgcat_render() renders into. */
+    struct Output output;
+    /* What imgcat_read_image() reads into. */
+    uint8_t *input;
+    size_t input_capacity;
+};
+
+static bool render(PrintRequest *request, struct Output *output);
+static bool reserve_input(struct ImgcatContext *context, size_t capacity);
+
+
+struct ImgcatContext *imgcat_context_new(void) {
+    struct ImgcatContext *context = calloc(1, sizeof(struct ImgcatContext));
+    if (context == NULL) {
+        return NULL;
+    }
+
+    output_init_memory(&context->output, NULL, 0);
+    return context;
+}
+
+void imgcat_context_free(struct ImgcatContext *context) {
+    if (context == NULL) {
+        return;
+    }
+
+    output_free(&context->output);
+    free(context->input);
+    free(context);
+}
+
+void imgcat_request_init(PrintRequest *request, Format format) {
+    *request = (PrintRequest) {
+        .filename = NULL,
+        .data = NULL,
+        .data_length = 0,
+        .max_width = WIDTH_UNSET,
+        .max_height = HEIGHT_UNSET,
+        .desired_width = WIDTH_UNSET,
+        .desired_height = HEIGHT_UNSET,
+        .blocks = B_FULL,
+        .preserve_aspect_ratio = true,
+        .format = format,
+        .quantizer = Q_EXACT,
+        .dither = D_NONE,
+        .emission = E_FULL,
+        .kitty_medium = K_DIRECT,
+        .compact_escapes = false,
+        .max_bytes = 0,
+        .jobs = 1,
+        .animate = false,
+        .plays = 0,
+        .output_fd = -1,
+        .output = NULL,
+        .bytes_written = 0,
+    };
+}
+
+bool imgcat_read_image(struct ImgcatContext *context, int fd, PrintRequest *request) {
+    struct stat st;
+    size_t length = 0;
+
+    /* Regular files can be read in one go; anything else, just start
+     * reading. Either way, there's room to notice end-of-file. */
+    size_t expected = INITIAL_INPUT_CAPACITY;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+        expected = (size_t) st.st_size + 1;
+    }
+    if (!reserve_input(context, expected)) {
+        return false;
+    }
+
+    while (1) {
+        if (length == context->input_capacity
+                && !reserve_input(context, context->input_capacity * 2)) {
+            return false;
+        }
+
+        ssize_t bytes_read = read(fd, context->input + length,
+                                  context->input_capacity - length);
+        if (bytes_read == 0) {
+            break;
+        } else if (bytes_read < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        length += bytes_read;
+    }
+
+    request->data = context->input;
+    request->data_length = length;
+    return true;
+}
+
+bool imgcat_render(struct ImgcatContext *context, PrintRequest *request,
+                   const char **output, size_t *length) {
+    output_clear(&context->output);
+    if (!render(request, &context->output)) {
+        return false;
+    }
+
+    *output = context->output.data;
+    *length = context->output.length;
+    return true;
+}
+
+bool imgcat_render_into(PrintRequest *request, char *buffer, size_t capacity,
+                        size_t *length) {
+    struct Output output;
+
+    output_init_memory(&output, buffer, capacity);
+    bool success = render(request, &output);
+    if (output.failed) {
+        errno = ENOBUFS;
+    }
+    *length = output.length;
+    output_free(&output);
+    return success;
+}
+
+/**
+ * Prints the image into output, which must be an in-memory Output.
+ */
+static bool render(PrintRequest *request, struct Output *output) {
+    PrintRequest in_memory = *request;
+    in_memory.output = output;
+    in_memory.animate = false;
+
+    bool success = print_image(&in_memory) && !output->failed;
+    request->bytes_written = in_memory.bytes_written;
+    return success;
+}
+
+static bool reserve_input(struct ImgcatContext *context, size_t capacity) {
+    if (capacity <= context->input_capacity) {
+        return true;
+    }
+
+    uint8_t *input = realloc(context->input, capacity);
+    if (input == NULL) {
+        errno = ENOMEM;
+        return false;
+    }
+
+    context->input = input;
+    context->input_capacity = capacity;
+    return true;
+}
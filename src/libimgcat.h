@@ -0,0 +1,92 @@
+/*
+ * Copyright (c) 2026 Eddie Antonio Santos <hello@eddieantonio.ca>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+
+/**
+ * @file libimgcat.h
+ * @brief Render images to escape sequences in memory, from any thread.
+ *
+ * Usage:
+ *
+ * Create one ImgcatContext per thread with imgcat_context_new(). Fill in a
+ * PrintRequest with imgcat_request_init(), then point it at the image: set
+ * its filename, its data and data_length, or read the image from a file
+ * descriptor with imgcat_read_image(). Then render it with imgcat_render()
+ * (into memory owned by the context) or imgcat_render_into() (into your own
+ * buffer). Finally, imgcat_context_free() the context.
+ *
+ * Contexts keep the rendered output and the read image between calls, so
+ * those two buffers only grow rather than being allocated per image; decoding,
+ * resizing, and formatting still allocate their own memory every render.
+ * Different contexts may be used on different threads at the same time; a
+ * single context may not.
+ * Animations are never played: only their first frame is rendered.
+ */
+
+#ifndef LIBIMGCAT_H
+#define LIBIMGCAT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "print_image.h"
+
+struct ImgcatContext;
+
+/**
+ * Returns a new context, or NULL if memory ran out.
+ */
+struct ImgcatContext *imgcat_context_new(void);
+
+/**
+ * Frees the context, and everything it has rendered or read.
+ */
+void imgcat_context_free(struct ImgcatContext *context);
+
+/**
+ * Sets every field of request to its default, for the given format: shrink
+ * to fit the desired size (if any) preserving the aspect ratio, with
+ * complete escape sequences, formatted on the calling thread.
+ */
+void imgcat_request_init(PrintRequest *request, Format format);
+
+/**
+ * Reads an encoded image from fd until end-of-file into the context, and
+ * points request->data at it. It stays valid until the next call to
+ * imgcat_read_image() with this context. Returns false (and sets errno) if
+ * fd could not be read.
+ */
+bool imgcat_read_image(struct ImgcatContext *context, int fd, PrintRequest *request);
+
+/**
+ * Renders the image into memory owned by the context, and points *output at
+ * the *length bytes that would have been printed. They stay valid until the
+ * next render with this context. Returns false if the image could not be
+ * rendered.
+ */
+bool imgcat_render(struct ImgcatContext *context, PrintRequest *request,
+                   const char **output, size_t *length);
+
+/**
+ * Like imgcat_render(), but renders into the capacity bytes of buffer, so no
+ * context is needed. If they're not enough, returns false and sets errno to
+ * ENOBUFS.
+ */
+bool imgcat_render_into(PrintRequest *request, char *buffer, size_t capacity,
+                        size_t *length);
+
+#endif /* LIBIMGCAT_H */
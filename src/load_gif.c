@@ -0,0 +1,543 @@
+/*
+ * Copyright (c) 2026 Eddie Antonio Santos <hello@eddieantonio.ca>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+
+/**
+ * @file load_gif.c
+ * @brief A small GIF87a/GIF89a decoder.
+ *
+ * See https://www.w3.org/Graphics/GIF/spec-gif89a.txt
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "load_gif.h"
+
+enum {
+    /* LZW codes are at most 12 bits. */
+    MAX_CODES = 4096,
+    /* Block introducers and labels. */
+    EXTENSION = 0x21,
+    IMAGE_DESCRIPTOR = 0x2C,
+    TRAILER = 0x3B,
+    GRAPHIC_CONTROL = 0xF9,
+    APPLICATION = 0xFF,
+};
+
+/* What happens to a frame's rectangle before the next frame is drawn. */
+enum Disposal {
+    DISPOSE_NONE = 0,
+    DISPOSE_KEEP = 1,
+    DISPOSE_BACKGROUND = 2,
+    DISPOSE_PREVIOUS = 3,
+};
+
+/**
+ * A rectangle of the canvas, already clipped to it.
+ */
+struct Rect {
+    int left, top, width, height;
+};
+
+struct GifDecoder {
+    const uint8_t *data;
+    size_t length;
+    /* Where the next block starts... */
+    size_t pos;
+    /* ...and where the first one does, for gif_rewind(). */
+    size_t first_block;
+    int width, height;
+    uint8_t global_palette[256][3];
+    int global_colours;
+    int loop_count;
+    int frames;
+    uint8_t *canvas;
+    /* The canvas from before the last frame, for DISPOSE_PREVIOUS. */
+    uint8_t *saved;
+    /* How to clean up after the last frame. */
+    enum Disposal dispose;
+    struct Rect dispose_rect;
+};
+
+/**
+ * The graphic control extension that applies to the next frame.
+ */
+struct FrameControl {
+    int delay;
+    int transparent;
+    enum Disposal disposal;
+};
+
+/**
+ * Reads LZW codes out of a series of data sub-blocks.
+ */
+struct BitReader {
+    const uint8_t *data;
+    size_t length, pos;
+    /* Bytes left in the current sub-block. */
+    int block_left;
+    uint32_t bits;
+    int n_bits;
+    bool ended;
+};
+
+static uint16_t read_u16(const uint8_t *bytes) {
+    return bytes[0] | bytes[1] << 8;
+}
+
+static size_t canvas_bytes(const struct GifDecoder *gif) {
+    return (size_t) gif->width * gif->height * 4;
+}
+
+/**
+ * Skips data sub-blocks up to and including the terminator. Returns false
+ * if the data ran out first.
+ */
+static bool skip_sub_blocks(struct GifDecoder *gif) {
+    while (gif->pos < gif->length) {
+        uint8_t size = gif->data[gif->pos++];
+        if (size == 0) {
+            return true;
+        }
+        gif->pos += size;
+    }
+    return false;
+}
+
+bool is_gif(const uint8_t *data, size_t length) {
+    return length >= 6 && (memcmp(data, "GIF87a", 6) == 0 ||
+                           memcmp(data, "GIF89a", 6) == 0);
+}
+
+struct GifDecoder *gif_decoder_new(const uint8_t *data, size_t length) {
+    /* The header, and the logical screen descriptor. */
+    if (length < 13 || !is_gif(data, length)) {
+        return NULL;
+    }
+
+    struct GifDecoder *gif = calloc(1, sizeof(struct GifDecoder));
+    if (gif == NULL) {
+        return NULL;
+    }
+    gif->data = data;
+    gif->length = length;
+    gif->width = read_u16(data + 6);
+    gif->height = read_u16(data + 8);
+    gif->loop_count = GIF_NO_LOOP;
+    gif->pos = 13;
+
+    uint8_t flags = data[10];
+    if (flags & 0x80) {
+        gif->global_colours = 2 << (flags & 0x07);
+        if (gif->pos + 3 * gif->global_colours > length) {
+            free(gif);
+            return NULL;
+        }
+        memcpy(gif->global_palette, data + gif->pos, 3 * gif->global_colours);
+        gif->pos += 3 * gif->global_colours;
+    }
+    gif->first_block = gif->pos;
+
+    if (gif->width == 0 || gif->height == 0) {
+        free(gif);
+        return NULL;
+    }
+    gif->canvas = calloc(canvas_bytes(gif), 1);
+    if (gif->canvas == NULL) {
+        free(gif);
+        return NULL;
+    }
+
+    return gif;
+}
+
+void gif_decoder_free(struct GifDecoder *gif) {
+    free(gif->canvas);
+    free(gif->saved);
+    free(gif);
+}
+
+void gif_decoder_size(const struct GifDecoder *gif, int *width, int *height) {
+    *width = gif->width;
+    *height = gif->height;
+}
+
+const uint8_t *gif_canvas(const struct GifDecoder *gif) {
+    return gif->canvas;
+}
+
+int gif_loop_count(const struct GifDecoder *gif) {
+    return gif->loop_count;
+}
+
+void gif_rewind(struct GifDecoder *gif) {
+    gif->pos = gif->first_block;
+    gif->frames = 0;
+    gif->dispose = DISPOSE_NONE;
+    memset(gif->canvas, 0, canvas_bytes(gif));
+}
+
+/**
+ * Cleans up after the previous frame, as it asked.
+ */
+static void dispose_previous_frame(struct GifDecoder *gif) {
+    const struct Rect *rect = &gif->dispose_rect;
+    const size_t stride = (size_t) gif->width * 4;
+
+    switch (gif->dispose) {
+        case DISPOSE_BACKGROUND:
+            /* Browsers clear to transparent, rather than the background
+             * colour, and so do we. */
+            for (int y = rect->top; y < rect->top + rect->height; y++) {
+                memset(gif->canvas + y * stride + rect->left * 4, 0, rect->width * 4);
+            }
+            break;
+        case DISPOSE_PREVIOUS:
+            for (int y = rect->top; y < rect->top + rect->height; y++) {
+                size_t offset = y * stride + rect->left * 4;
+                memcpy(gif->canvas + offset, gif->saved + offset, rect->width * 4);
+            }
+            break;
+        case DISPOSE_NONE:
+        case DISPOSE_KEEP:
+            break;
+    }
+    gif->dispose = DISPOSE_NONE;
+}
+
+static void read_graphic_control(struct GifDecoder *gif, struct FrameControl *control) {
+    /* Block size (always 4), flags, delay, transparent index, terminator. */
+    if (gif->pos + 6 > gif->length || gif->data[gif->pos] != 4) {
+        return;
+    }
+    const uint8_t *block = gif->data + gif->pos + 1;
+    control->disposal = (block[0] >> 2) & 0x07;
+    if (control->disposal > DISPOSE_PREVIOUS) {
+        control->disposal = DISPOSE_NONE;
+    }
+    /* Hundredths of a second. */
+    control->delay = read_u16(block + 1) * 10;
+    control->transparent = (block[0] & 0x01) ? block[3] : -1;
+}
+
+static void read_application(struct GifDecoder *gif) {
+    /* The loop count lives in the NETSCAPE2.0 extension's first sub-block:
+     * 1, then the count as a little-endian u16. */
+    static const char netscape[] = "\013NETSCAPE2.0\003\001";
+    const size_t magic_length = sizeof(netscape) - 1;
+
+    if (gif->pos + magic_length + 2 <= gif->length &&
+            memcmp(gif->data + gif->pos, netscape, magic_length) == 0) {
+        gif->loop_count = read_u16(gif->data + gif->pos + magic_length);
+    }
+}
+
+static int read_byte(struct BitReader *reader) {
+    while (reader->block_left == 0) {
+        if (reader->pos >= reader->length) {
+            return -1;
+        }
+        reader->block_left = reader->data[reader->pos++];
+        if (reader->block_left == 0) {
+            /* The terminator. */
+            reader->ended = true;
+            return -1;
+        }
+    }
+    if (reader->pos >= reader->length) {
+        return -1;
+    }
+    reader->block_left--;
+    return reader->data[reader->pos++];
+}
+
+/* Returns the next code, or -1 when the data runs out. */
+static int read_code(struct BitReader *reader, int code_size) {
+    while (reader->n_bits < code_size) {
+        int byte = read_byte(reader);
+        if (byte < 0) {
+            return -1;
+        }
+        reader->bits |= (uint32_t) byte << reader->n_bits;
+        reader->n_bits += 8;
+    }
+    int code = reader->bits & ((1 << code_size) - 1);
+    reader->bits >>= code_size;
+    reader->n_bits -= code_size;
+    return code;
+}
+
+/**
+ * Where decoded pixels go: the frame's rectangle, one row after another (or
+ * in four passes, if interlaced).
+ */
+struct PixelWriter {
+    struct GifDecoder *gif;
+    const uint8_t (*palette)[3];
+    int colours, transparent;
+    /* The frame's own rectangle, which may hang off the canvas. */
+    int left, top, width, height;
+    int x, y, pass;
+    bool interlaced;
+};
+
+/* Each pass of an interlaced image: the first row, and the step. */
+static const int interlace_start[] = { 0, 4, 2, 1 };
+static const int interlace_step[] = { 8, 8, 4, 2 };
+
+/* Returns false once the frame is full. */
+static bool write_pixel(struct PixelWriter *writer, uint8_t index) {
+    struct GifDecoder *gif = writer->gif;
+
+    if (writer->y >= writer->height) {
+        return false;
+    }
+
+    int x = writer->left + writer->x, y = writer->top + writer->y;
+    if (index != writer->transparent && x < gif->width && y < gif->height) {
+        uint8_t *pixel = gif->canvas + ((size_t) y * gif->width + x) * 4;
+        if (index < writer->colours) {
+            memcpy(pixel, writer->palette[index], 3);
+        } else {
+            /* Out of the palette: make it black, like browsers do. */
+            memset(pixel, 0, 3);
+        }
+        pixel[3] = 0xFF;
+    }
+
+    if (++writer->x < writer->width) {
+        return true;
+    }
+    writer->x = 0;
+    if (!writer->interlaced) {
+        writer->y++;
+        return writer->y < writer->height;
+    }
+
+    writer->y += interlace_step[writer->pass];
+    while (writer->y >= writer->height && writer->pass < 3) {
+        writer->pass++;
+        writer->y = interlace_start[writer->pass];
+    }
+    return writer->y < writer->height;
+}
+
+/**
+ * Decompresses the frame's image data onto the canvas. Stops early, without
+ * complaint, if the data is cut off or corrupt.
+ */
+static void decode_lzw(struct PixelWriter *writer, int min_code_size,
+                       struct BitReader *reader) {
+    uint16_t prefix[MAX_CODES];
+    uint8_t suffix[MAX_CODES];
+    uint8_t stack[MAX_CODES];
+
+    const int clear = 1 << min_code_size, end = clear + 1;
+    int code_size = min_code_size + 1;
+    int next = clear + 2;
+    int previous = -1;
+    uint8_t first = 0;
+
+    for (int i = 0; i < clear; i++) {
+        prefix[i] = 0;
+        suffix[i] = i;
+    }
+
+    while (1) {
+        int code = read_code(reader, code_size);
+        if (code < 0 || code == end) {
+            return;
+        }
+        if (code == clear) {
+            code_size = min_code_size + 1;
+            next = clear + 2;
+            previous = -1;
+            continue;
+        }
+
+        if (previous < 0) {
+            if (code > clear) {
+                return;
+            }
+            first = suffix[code];
+            previous = code;
+            if (!write_pixel(writer, first)) {
+                return;
+            }
+            continue;
+        }
+
+        /* Unwind the code's string onto the stack, last byte first. */
+        int in = code, depth = 0;
+        if (code > next || (code == next && next >= MAX_CODES)) {
+            return;
+        } else if (code == next) {
+            /* The KwKwK case: the string isn't in the table yet, but it's
+             * the previous string plus its own first byte. */
+            stack[depth++] = first;
+            code = previous;
+        }
+        while (code > end) {
+            stack[depth++] = suffix[code];
+            code = prefix[code];
+        }
+        first = suffix[code];
+        stack[depth++] = first;
+
+        while (depth > 0) {
+            if (!write_pixel(writer, stack[--depth])) {
+                return;
+            }
+        }
+
+        if (next < MAX_CODES) {
+            prefix[next] = previous;
+            suffix[next] = first;
+            next++;
+            if (next == 1 << code_size && code_size < 12) {
+                code_size++;
+            }
+        }
+        previous = in;
+    }
+}
+
+/**
+ * Reads an image descriptor (the introducer has already been read) and
+ * draws the frame. Returns false if the data ran out.
+ */
+static bool read_frame(struct GifDecoder *gif, const struct FrameControl *control) {
+    if (gif->pos + 9 > gif->length) {
+        return false;
+    }
+    const uint8_t *descriptor = gif->data + gif->pos;
+    struct PixelWriter writer = {
+        .gif = gif,
+        .palette = (const uint8_t (*)[3]) gif->global_palette,
+        .colours = gif->global_colours,
+        .transparent = control->transparent,
+        .left = read_u16(descriptor),
+        .top = read_u16(descriptor + 2),
+        .width = read_u16(descriptor + 4),
+        .height = read_u16(descriptor + 6),
+        .interlaced = descriptor[8] & 0x40,
+    };
+    gif->pos += 9;
+
+    if (descriptor[8] & 0x80) {
+        writer.colours = 2 << (descriptor[8] & 0x07);
+        if (gif->pos + 3 * writer.colours > gif->length) {
+            return false;
+        }
+        writer.palette = (const uint8_t (*)[3]) (gif->data + gif->pos);
+        gif->pos += 3 * writer.colours;
+    }
+
+    if (gif->pos >= gif->length) {
+        return false;
+    }
+    int min_code_size = gif->data[gif->pos++];
+    if (min_code_size < 1 || min_code_size > 11) {
+        return false;
+    }
+
+    /* The part of the canvas this frame covers. */
+    struct Rect rect = { writer.left, writer.top, 0, 0 };
+    if (writer.left < gif->width && writer.top < gif->height) {
+        rect.width = writer.left + writer.width > gif->width
+            ? gif->width - writer.left : writer.width;
+        rect.height = writer.top + writer.height > gif->height
+            ? gif->height - writer.top : writer.height;
+    }
+
+    if (control->disposal == DISPOSE_PREVIOUS) {
+        if (gif->saved == NULL) {
+            gif->saved = malloc(canvas_bytes(gif));
+        }
+        if (gif->saved != NULL) {
+            memcpy(gif->saved, gif->canvas, canvas_bytes(gif));
+        }
+    }
+
+    struct BitReader reader = {
+        .data = gif->data,
+        .length = gif->length,
+        .pos = gif->pos,
+    };
+    if (writer.width > 0 && writer.height > 0) {
+        decode_lzw(&writer, min_code_size, &reader);
+    }
+    /* Skip whatever's left after the end code, including the rest of the
+     * current sub-block. */
+    gif->pos = reader.pos + reader.block_left;
+    if (!reader.ended) {
+        skip_sub_blocks(gif);
+    }
+
+    gif->dispose = control->disposal;
+    if (gif->dispose == DISPOSE_PREVIOUS && gif->saved == NULL) {
+        /* Nothing to go back to. */
+        gif->dispose = DISPOSE_NONE;
+    }
+    gif->dispose_rect = rect;
+    return true;
+}
+
+enum GifStatus gif_next_frame(struct GifDecoder *gif, int *delay) {
+    struct FrameControl control = { 0, -1, DISPOSE_NONE };
+    /* Anything broken after the first frame just ends the animation. */
+    const enum GifStatus broken = gif->frames > 0 ? GIF_END : GIF_ERROR;
+
+    while (gif->pos < gif->length) {
+        switch (gif->data[gif->pos++]) {
+            case EXTENSION:
+                if (gif->pos >= gif->length) {
+                    return broken;
+                }
+                switch (gif->data[gif->pos++]) {
+                    case GRAPHIC_CONTROL:
+                        read_graphic_control(gif, &control);
+                        break;
+                    case APPLICATION:
+                        read_application(gif);
+                        break;
+                }
+                if (!skip_sub_blocks(gif)) {
+                    return broken;
+                }
+                break;
+
+            case IMAGE_DESCRIPTOR:
+                /* Only now, so that the last frame stays on the canvas. */
+                dispose_previous_frame(gif);
+                if (!read_frame(gif, &control)) {
+                    return broken;
+                }
+                gif->frames++;
+                *delay = control.delay;
+                return GIF_FRAME;
+
+            case TRAILER:
+                return gif->frames > 0 ? GIF_END : GIF_ERROR;
+
+            default:
+                return broken;
+        }
+    }
+
+    return broken;
+}
@@ -0,0 +1,106 @@
+/*
+ * Copyright (c) 2026 Eddie Antonio Santos <hello@eddieantonio.ca>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+
+/**
+ * @file load_gif.h
+ * @brief Decodes GIFs one frame at a time, including animations.
+ *
+ * Frames are composited onto a full-size RGBA canvas, honouring each
+ * frame's transparency and disposal method, so the canvas always looks like
+ * what a browser would show at that point in the animation.
+ *
+ * Usage:
+ *
+ * Create a GifDecoder with gif_decoder_new(), then call gif_next_frame()
+ * until it says the animation is over; after each frame, the canvas is in
+ * gif_canvas(). To play it again, call gif_rewind(). Finally, call
+ * gif_decoder_free().
+ */
+
+#ifndef LOAD_GIF_H
+#define LOAD_GIF_H
+
+#ifdef __cplusplus
+#include <cstddef>
+#include <cstdint>
+extern "C" {
+#else
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#endif
+
+enum GifStatus {
+    /* Another frame was composited onto the canvas. */
+    GIF_FRAME,
+    /* There are no more frames. */
+    GIF_END,
+    /* The file is not a GIF, or is broken before its first frame. */
+    GIF_ERROR,
+};
+
+/* The loop count when the GIF doesn't say to loop at all. */
+enum { GIF_NO_LOOP = -1 };
+
+struct GifDecoder;
+
+/**
+ * Returns true if the data starts like a GIF.
+ */
+bool is_gif(const uint8_t *data, size_t length);
+
+/**
+ * Reads the GIF's header. The data is not copied, so it must outlive the
+ * decoder. Returns NULL if it isn't a GIF, or memory could not be allocated.
+ */
+struct GifDecoder *gif_decoder_new(const uint8_t *data, size_t length);
+
+void gif_decoder_size(const struct GifDecoder *, int *width, int *height);
+
+/**
+ * Composites the next frame onto the canvas. Sets delay to how long it should
+ * be shown, in milliseconds, as stated in the file (which may be zero).
+ *
+ * A GIF that is cut off part way through ends early, rather than failing,
+ * just like it would in a browser. Once it has ended, the canvas still holds
+ * the last frame.
+ */
+enum GifStatus gif_next_frame(struct GifDecoder *, int *delay);
+
+/**
+ * The composited image so far: 32bpp RGBA, the size of the whole GIF.
+ */
+const uint8_t *gif_canvas(const struct GifDecoder *);
+
+/**
+ * How many times the animation should be played after the first time,
+ * where 0 is forever, or GIF_NO_LOOP. Only known once the frame before the
+ * loop count has been decoded (in practice, from the first frame onward).
+ */
+int gif_loop_count(const struct GifDecoder *);
+
+/**
+ * Starts over from an empty canvas, before the first frame.
+ */
+void gif_rewind(struct GifDecoder *);
+
+void gif_decoder_free(struct GifDecoder *);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+#endif /* LOAD_GIF_H */
@@ -15,6 +15,8 @@
  */
 
 #include <cassert>
+#include <cerrno>
+#include <cstdio>
 #include <cstdlib>
 #include <cstdbool>
 #include <cstdint>
@@ -22,28 +24,209 @@
 #include <iostream>
 #include <algorithm>
 
+#include <sys/stat.h>
+#include <unistd.h>
+
 #include "cimg_config.h"
 #define cimg_verbosity  0
 #define cimg_display    0
 #include "CImg.h"
 
+#include "interleave.h"
+#include "load_gif.h"
 #include "load_image.h"
+#include "load_jpeg.h"
+#include "load_png.h"
+#include "profile.h"
+#include "resample.h"
 /**
  * red/L*, blue/a*, green/b*, and alpha.
  */
 const int COLOUR_DEPTH = 4;
 
 namespace {
-void maybe_resize(cimg_library::CImg<unsigned char>&, const LoadOpts&);
+void fit_to_terminal(int width, LoadOpts&);
+bool target_size(int width, int height, const LoadOpts&,
+                 int *new_width, int *new_height);
+void final_size(int width, int height, LoadOpts&, int *new_width, int *new_height);
+bool image_bytes(int width, int height, size_t *bytes);
+bool is_png(const uint8_t *data, size_t length);
+bool is_jpeg(const uint8_t *data, size_t length);
+bool stream_file(const char *filename, Image *, LoadOpts *);
+bool stream_memory(const uint8_t *data, size_t length, Image *, LoadOpts *);
+uint8_t *read_whole_file(std::FILE *, size_t *length);
+bool load_gif(const uint8_t *data, size_t length, Image *, LoadOpts *);
+bool scale_pixels(const uint8_t *pixels, int src_width, int src_height,
+                  int width, int height, Image *);
+bool decode_from_memory(cimg_library::CImg<unsigned char>&,
+                        const uint8_t *data, size_t length);
+bool flatten_image(cimg_library::CImg<unsigned char>&, int width, int height,
+                   Image *);
+bool load_file(const char *filename, Image *, LoadOpts *);
+bool load_memory(const uint8_t *data, size_t length, Image *, LoadOpts *);
+
+/**
+ * Takes rows from a streaming decoder, and shrinks them (if need be) straight
+ * into the Image's buffer. Only the output and a couple of rows are ever in
+ * memory, no matter how big the source image is.
+ */
+struct Stream {
+    LoadOpts *options;
+    /* The size of the finished image... */
+    int width, height;
+    /* ...of the rows coming from the decoder... */
+    int src_width, src_height;
+    /* ...and of the image, as stated in its header. */
+    int full_width, full_height;
+    int rows;
+    uint8_t *buffer;
+    AreaResampler *resampler;
+};
+
+bool stream_start(void *, int width, int height, int *min_width, int *min_height);
+bool stream_size(void *, int width, int height);
+void stream_row(void *, const uint8_t *row);
+bool stream_finish(Stream&, bool success, Image *);
 }
 
 
 // TODO: Take "max width", "pixel ratio", "colour space".
 // TODO: colour space transformation?
 bool load_image(const char *filename, Image *image, struct LoadOpts* options) {
+    int64_t start = profile_now();
+    bool success = load_file(filename, image, options);
+    profile_add(P_DECODE, start);
+    return success;
+}
+
+bool load_image_from_memory(const uint8_t *data, size_t length,
+                            Image *image, struct LoadOpts* options) {
+    int64_t start = profile_now();
+    bool success = load_memory(data, length, image, options);
+    profile_add(P_DECODE, start);
+    return success;
+}
+
+void unload_image(Image *image) {
+    assert(image->buffer != nullptr);
+    free(image->buffer);
+    image->buffer = nullptr;
+    image->width = 0;
+    image->height = 0;
+}
+
+struct Animation {
+    GifDecoder *gif;
+    /* The file's contents, if we read it ourselves. */
+    uint8_t *contents;
+    /* The size of the GIF, and the size every frame is resized to. */
+    int src_width, src_height;
+    int width, height;
+};
+
+struct Animation *load_animation(const char *filename, struct LoadOpts* options) {
+    std::FILE *file = std::fopen(filename, "rb");
+    if (file == nullptr) {
+        return nullptr;
+    }
+
+    size_t length;
+    int64_t start = profile_now();
+    uint8_t *contents = read_whole_file(file, &length);
+    std::fclose(file);
+    profile_add(P_READ, start);
+    if (contents != nullptr) {
+        profile_count(P_BYTES_READ, length);
+    }
+    if (contents == nullptr) {
+        return nullptr;
+    }
+
+    Animation *animation = load_animation_from_memory(contents, length, options);
+    if (animation == nullptr) {
+        free(contents);
+        return nullptr;
+    }
+    animation->contents = contents;
+    return animation;
+}
+
+struct Animation *load_animation_from_memory(const uint8_t *data, size_t length,
+                                             struct LoadOpts* options) {
+    GifDecoder *gif = gif_decoder_new(data, length);
+    if (gif == nullptr) {
+        return nullptr;
+    }
+
+    Animation *animation = (Animation *) calloc(1, sizeof(Animation));
+    if (animation == nullptr) {
+        gif_decoder_free(gif);
+        return nullptr;
+    }
+    animation->gif = gif;
+    gif_decoder_size(gif, &animation->src_width, &animation->src_height);
+    final_size(animation->src_width, animation->src_height, *options,
+               &animation->width, &animation->height);
+
+    /* Frames are redrawn in place, which only works if the whole thing is
+     * on the screen; so unlike a still image, it's shrunk to fit. */
+    if (options->max_height > 0 && animation->height > options->max_height) {
+        double ratio = (double) options->max_height / animation->height;
+        animation->width = std::max((int) (ratio * animation->width), 1);
+        animation->height = options->max_height;
+    }
+    profile_image(animation->src_width, animation->src_height,
+                  animation->src_width, animation->src_height,
+                  animation->width, animation->height);
+    return animation;
+}
+
+bool animation_next_frame(struct Animation *animation, int *delay) {
+    int64_t start = profile_now();
+    bool success = gif_next_frame(animation->gif, delay) == GIF_FRAME;
+    profile_add(P_DECODE, start);
+    return success;
+}
+
+bool animation_render(struct Animation *animation, struct Image *image) {
+    int64_t start = profile_now();
+    bzero(image, sizeof(struct Image));
+    bool success = scale_pixels(gif_canvas(animation->gif),
+                                animation->src_width, animation->src_height,
+                                animation->width, animation->height, image);
+    profile_add(P_DECODE, start);
+    return success;
+}
+
+int animation_loop_count(const struct Animation *animation) {
+    return gif_loop_count(animation->gif);
+}
+
+void animation_rewind(struct Animation *animation) {
+    gif_rewind(animation->gif);
+}
+
+void unload_animation(struct Animation *animation) {
+    gif_decoder_free(animation->gif);
+    free(animation->contents);
+    free(animation);
+}
+
+namespace {
+bool load_file(const char *filename, Image *image, LoadOpts *options) {
     /* Zero-out the struct. */
     bzero(image, sizeof(struct Image));
 
+    struct stat info;
+    if (profile_enabled() && stat(filename, &info) == 0) {
+        profile_count(P_BYTES_READ, info.st_size);
+    }
+
+    /* PNGs and JPEGs don't need to be decoded in one piece. */
+    if (stream_file(filename, image, options)) {
+        return true;
+    }
+
     cimg_library::CImg<unsigned char> img;
     try {
         img.assign(filename);
@@ -52,21 +235,54 @@ bool load_image(const char *filename, Image *image, struct LoadOpts* options) {
         return false;
     }
 
-    assert(img.data() != nullptr);
+    int width, height;
+    final_size(img.width(), img.height(), *options, &width, &height);
+    profile_image(img.width(), img.height(), img.width(), img.height(), width, height);
+    return flatten_image(img, width, height, image);
+}
 
-    /* XXX: Set the desired width when the image is too wide  */
-    if ((options->desired_width <= 0) &&
-            (img.width() > options->max_width)) {
-        options->desired_width = options->max_width;
+bool load_memory(const uint8_t *data, size_t length, Image *image,
+                 LoadOpts *options) {
+    /* Zero-out the struct. */
+    bzero(image, sizeof(struct Image));
+
+    if (stream_memory(data, length, image, options)) {
+        return true;
     }
 
-    /* The image may be resized smaller. */
-    maybe_resize(img, *options);
+    cimg_library::CImg<unsigned char> img;
+    if (!decode_from_memory(img, data, length)) {
+        return false;
+    }
+
+    int width, height;
+    final_size(img.width(), img.height(), *options, &width, &height);
+    profile_image(img.width(), img.height(), img.width(), img.height(), width, height);
+    return flatten_image(img, width, height, image);
+}
+
+/**
+ * Resizes the decoded image to width x height, and copies it into the
+ * Image's 32bpp buffer.
+ *
+ * Shrinking (by far the most common case) area-averages straight from the
+ * planes, so only the shrunk rows are ever interleaved.
+ */
+bool flatten_image(cimg_library::CImg<unsigned char>& img, int width, int height,
+                   Image *image) {
+    assert(img.data() != nullptr);
+
+    const bool same_size = width == img.width() && height == img.height();
+    const bool shrink = !same_size && width <= img.width() && height <= img.height();
+    if (!same_size && !shrink) {
+        /* Growing in either direction is left to CImg. */
+        img.resize(width, height);
+    }
 
     /* Determine the number of bytes of the image. */
-    int size = img.width() * img.height() * COLOUR_DEPTH;
-    if (size < COLOUR_DEPTH) {
-        /* The image is too small! */
+    size_t size;
+    if (!image_bytes(width, height, &size)) {
+        /* The image is too small, or impossibly big! */
         return false;
     }
 
@@ -86,95 +302,496 @@ bool load_image(const char *filename, Image *image, struct LoadOpts* options) {
      * individual pixel is cache-local (processor caches don't like it
      * when you hop around memory for each datum).
      */
-    uint8_t *pos = buffer;
-    const auto greyscale = img.spectrum() < 3;
-    for (int y = 0; y < img.height(); y++) {
-        for (int x = 0; x < img.width(); x++) {
-            if (greyscale) {
-                /* Copy the grey channel three times. */
-                *pos++ = img(x, y);
-                *pos++ = img(x, y);
-                *pos++ = img(x, y);
-            } else {
-                /* Copy each channel independently. */
-                *pos++ = img(x, y, 0, 0);
-                *pos++ = img(x, y, 0, 1);
-                *pos++ = img(x, y, 0, 2);
+    const int channels = std::min(img.spectrum(), 4);
+    const uint8_t *planes[4];
+
+    /* Grey is copied into all three colour channels, and without an alpha
+     * channel, every pixel is opaque. */
+    if (shrink) {
+        int64_t start = profile_now();
+        AreaResampler *resampler = area_resampler_new(img.width(), img.height(),
+                                                      width, height);
+        if (resampler == nullptr) {
+            free(buffer);
+            return false;
+        }
+
+        for (int y = 0; y < img.height(); y++) {
+            for (int c = 0; c < channels; c++) {
+                planes[c] = img.data(0, y, 0, c);
+            }
+            area_resampler_push_planes(resampler, planes, channels, buffer);
+        }
+
+        area_resampler_free(resampler);
+        profile_move(P_DECODE, P_RESIZE, start);
+    } else {
+        uint8_t *pos = buffer;
+        for (int y = 0; y < height; y++) {
+            for (int c = 0; c < channels; c++) {
+                planes[c] = img.data(0, y, 0, c);
             }
-            /* The alpha channel is currently ignored,
-             * so let every pixel be opaque. */
-            /* TODO: handle transparency? */
-            *pos++ = 0xFF;
+            interleave_row(planes, channels, width, pos);
+            pos += (size_t) width * COLOUR_DEPTH;
         }
+        /* Assert we've processed the entire image. */
+        assert(pos == buffer + size);
     }
-    /* Assert we've processed the entire image. */
-    assert(pos == buffer + size);
 
-    image->width = img.width();
-    image->height = img.height();
+    image->width = width;
+    image->height = height;
     image->buffer = buffer;
     image->depth = COLOUR_DEPTH;
     return true;
 }
 
-void unload_image(Image *image) {
-    assert(image->buffer != nullptr);
-    free(image->buffer);
-    image->buffer = nullptr;
-    image->width = 0;
-    image->height = 0;
+/**
+ * Resizes a 32bpp image to width x height, into a newly allocated buffer.
+ */
+bool scale_pixels(const uint8_t *pixels, int src_width, int src_height,
+                  int width, int height, Image *image) {
+    const size_t src_stride = (size_t) src_width * COLOUR_DEPTH;
+
+    if (width > src_width || height > src_height) {
+        /* Growing is left to CImg, which wants the channels in planes. */
+        cimg_library::CImg<unsigned char> img;
+        img.assign(src_width, src_height, 1, COLOUR_DEPTH);
+        for (int y = 0; y < src_height; y++) {
+            const uint8_t *pixel = pixels + src_stride * y;
+            for (int x = 0; x < src_width; x++, pixel += COLOUR_DEPTH) {
+                for (int c = 0; c < COLOUR_DEPTH; c++) {
+                    *img.data(x, y, 0, c) = pixel[c];
+                }
+            }
+        }
+        return flatten_image(img, width, height, image);
+    }
+
+    size_t size;
+    if (!image_bytes(width, height, &size)) {
+        return false;
+    }
+    uint8_t *buffer = (uint8_t*) malloc(size);
+    if (buffer == nullptr) {
+        return false;
+    }
+
+    if (width == src_width && height == src_height) {
+        memcpy(buffer, pixels, size);
+    } else {
+        int64_t start = profile_now();
+        AreaResampler *resampler = area_resampler_new(src_width, src_height,
+                                                      width, height);
+        if (resampler == nullptr) {
+            free(buffer);
+            return false;
+        }
+        for (int y = 0; y < src_height; y++) {
+            area_resampler_push(resampler, pixels + src_stride * y, buffer);
+        }
+        area_resampler_free(resampler);
+        profile_move(P_DECODE, P_RESIZE, start);
+    }
+
+    image->width = width;
+    image->height = height;
+    image->buffer = buffer;
+    image->depth = COLOUR_DEPTH;
+    return true;
 }
 
-namespace {
-void maybe_resize(cimg_library::CImg<unsigned char>& img, const LoadOpts& options) {
+/**
+ * Loads the first frame of a GIF.
+ */
+bool load_gif(const uint8_t *data, size_t length, Image *image, LoadOpts *options) {
+    GifDecoder *gif = gif_decoder_new(data, length);
+    if (gif == nullptr) {
+        return false;
+    }
+
+    int delay, src_width, src_height, width, height;
+    bool success = gif_next_frame(gif, &delay) == GIF_FRAME;
+    if (success) {
+        gif_decoder_size(gif, &src_width, &src_height);
+        final_size(src_width, src_height, *options, &width, &height);
+        profile_image(src_width, src_height, src_width, src_height, width, height);
+        success = scale_pixels(gif_canvas(gif), src_width, src_height,
+                               width, height, image);
+    }
+
+    gif_decoder_free(gif);
+    return success;
+}
+
+/**
+ * Reads everything left in the file into a malloc'd buffer. Returns NULL if
+ * it can't be read, or is empty.
+ */
+uint8_t *read_whole_file(std::FILE *file, size_t *length) {
+    size_t capacity = 64 * 1024, used = 0;
+    uint8_t *buffer = (uint8_t*) malloc(capacity);
+
+    while (buffer != nullptr) {
+        used += std::fread(buffer + used, 1, capacity - used, file);
+        if (used < capacity) {
+            break;
+        }
+        capacity *= 2;
+        uint8_t *bigger = (uint8_t*) realloc(buffer, capacity);
+        if (bigger == nullptr) {
+            free(buffer);
+        }
+        buffer = bigger;
+    }
+
+    if (buffer != nullptr && (std::ferror(file) || used == 0)) {
+        free(buffer);
+        return nullptr;
+    }
+    *length = used;
+    return buffer;
+}
+
+/**
+ * Decodes via a temporary file, for formats that CImg can only load by
+ * filename (which, for some formats, means handing the file to an external
+ * converter).
+ */
+bool decode_via_tempfile(cimg_library::CImg<unsigned char>& img,
+                         const uint8_t *data, size_t length) {
+    char filename[] = P_tmpdir "/imgcat.XXXXXXXX";
+    int fd = mkstemp(filename);
+    if (fd == -1) {
+        return false;
+    }
+
+    const uint8_t *pos = data;
+    size_t remaining = length;
+    while (remaining > 0) {
+        ssize_t written = write(fd, pos, remaining);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        pos += written;
+        remaining -= written;
+    }
+    close(fd);
+
+    bool success = remaining == 0;
+    if (success) {
+        try {
+            img.assign(filename);
+        } catch (cimg_library::CImgIOException& ex) {
+            success = false;
+        }
+    }
+
+    std::remove(filename);
+    return success;
+}
+
+bool is_png(const uint8_t *data, size_t length) {
+    static const uint8_t png_magic[] = { 0x89, 'P', 'N', 'G' };
+    return length >= sizeof(png_magic)
+        && memcmp(data, png_magic, sizeof(png_magic)) == 0;
+}
+
+bool is_jpeg(const uint8_t *data, size_t length) {
+    static const uint8_t jpeg_magic[] = { 0xFF, 0xD8 };
+    return length >= sizeof(jpeg_magic)
+        && memcmp(data, jpeg_magic, sizeof(jpeg_magic)) == 0;
+}
+
+/**
+ * Streams the file through libpng or libjpeg, if it's a PNG or a JPEG, or
+ * decodes it ourselves if it's a GIF. Returns false if it's none of those, or
+ * the image should be left to CImg.
+ */
+bool stream_file(const char *filename, Image *image, LoadOpts *options) {
+    std::FILE *file = std::fopen(filename, "rb");
+    if (file == nullptr) {
+        return false;
+    }
+
+    uint8_t magic[8];
+    size_t length = std::fread(magic, 1, sizeof(magic), file);
+    std::rewind(file);
+
+    Stream stream = { options };
+    ScanlineSink sink = { stream_start, stream_size, stream_row, &stream };
+    bool success = false;
+    if (is_gif(magic, length)) {
+        size_t file_length;
+        uint8_t *data = read_whole_file(file, &file_length);
+        success = data != nullptr && load_gif(data, file_length, image, options);
+        free(data);
+    }
+#ifdef cimg_use_png
+    if (is_png(magic, length)) {
+        success = stream_finish(stream, png_stream_file(file, &sink), image);
+    }
+#endif
+#ifdef cimg_use_jpeg
+    if (is_jpeg(magic, length)) {
+        success = stream_finish(stream, jpeg_stream_file(file, &sink), image);
+    }
+#endif
+
+    std::fclose(file);
+    return success;
+}
+
+bool stream_memory(const uint8_t *data, size_t length, Image *image,
+                   LoadOpts *options) {
+    Stream stream = { options };
+    ScanlineSink sink = { stream_start, stream_size, stream_row, &stream };
+    if (is_gif(data, length)) {
+        return load_gif(data, length, image, options);
+    }
+#ifdef cimg_use_png
+    if (is_png(data, length)) {
+        return stream_finish(stream, png_stream_memory(data, length, &sink), image);
+    }
+#endif
+#ifdef cimg_use_jpeg
+    if (is_jpeg(data, length)) {
+        return stream_finish(stream, jpeg_stream_memory(data, length, &sink), image);
+    }
+#endif
+    return false;
+}
+
+bool stream_start(void *context, int width, int height,
+                  int *min_width, int *min_height) {
+    Stream *stream = (Stream *) context;
+    stream->full_width = width;
+    stream->full_height = height;
+
+    /* Figure out the final size from the full size, exactly like it would
+     * be figured out after a full-size decode. */
+    final_size(width, height, *stream->options, &stream->width, &stream->height);
+
+    /* Growing needs the whole image; leave that to CImg. */
+    if (stream->width > width || stream->height > height) {
+        return false;
+    }
+
+    *min_width = stream->width;
+    *min_height = stream->height;
+    return true;
+}
+
+bool stream_size(void *context, int width, int height) {
+    Stream *stream = (Stream *) context;
+    size_t bytes;
+
+    assert(width >= stream->width && height >= stream->height);
+    stream->src_width = width;
+    stream->src_height = height;
+
+    if (!image_bytes(stream->width, stream->height, &bytes)) {
+        return false;
+    }
+    stream->buffer = (uint8_t*) malloc(bytes);
+    if (stream->buffer == nullptr) {
+        return false;
+    }
+
+    if (width != stream->width || height != stream->height) {
+        stream->resampler = area_resampler_new(width, height,
+                                               stream->width, stream->height);
+        if (stream->resampler == nullptr) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void stream_row(void *context, const uint8_t *row) {
+    Stream *stream = (Stream *) context;
+
+    if (stream->rows >= stream->src_height) {
+        return;
+    }
+
+    if (stream->resampler != nullptr) {
+        int64_t start = profile_now();
+        area_resampler_push(stream->resampler, row, stream->buffer);
+        profile_move(P_DECODE, P_RESIZE, start);
+    } else {
+        size_t stride = (size_t) stream->width * COLOUR_DEPTH;
+        memcpy(stream->buffer + stride * stream->rows, row, stride);
+    }
+    stream->rows++;
+}
+
+/**
+ * Hands the buffer over to the image if every row made it, and cleans up.
+ */
+bool stream_finish(Stream& stream, bool success, Image *image) {
+    if (stream.resampler != nullptr) {
+        area_resampler_free(stream.resampler);
+    }
+
+    success = success && stream.buffer != nullptr
+        && stream.rows == stream.src_height;
+    if (!success) {
+        free(stream.buffer);
+        return false;
+    }
+
+    profile_image(stream.full_width, stream.full_height,
+                  stream.src_width, stream.src_height, stream.width, stream.height);
+    image->width = stream.width;
+    image->height = stream.height;
+    image->buffer = stream.buffer;
+    image->depth = COLOUR_DEPTH;
+    return true;
+}
+
+bool decode_from_memory(cimg_library::CImg<unsigned char>& img,
+                        const uint8_t *data, size_t length) {
+    bool png = false, jpeg = false;
+
+    if (length == 0) {
+        return false;
+    }
+
+    /* CImg can decode these two straight from a FILE*, so there's no need
+     * to touch the disk. */
+#ifdef cimg_use_png
+    png = is_png(data, length);
+#endif
+#ifdef cimg_use_jpeg
+    jpeg = is_jpeg(data, length);
+#endif
+    if (!png && !jpeg) {
+        return decode_via_tempfile(img, data, length);
+    }
+
+    /* fmemopen() only reads from the buffer, despite the void *. */
+    std::FILE *file = fmemopen(const_cast<uint8_t *>(data), length, "rb");
+    if (file == nullptr) {
+        return decode_via_tempfile(img, data, length);
+    }
+
+    bool success = true;
+    try {
+        if (png) {
+            img.load_png(file);
+        } else {
+            img.load_jpeg(file);
+        }
+    } catch (cimg_library::CImgException& ex) {
+        success = false;
+    }
+
+    std::fclose(file);
+    return success && !img.is_empty();
+}
+
+/**
+ * Set the desired width when the image is too wide for the terminal.
+ */
+void fit_to_terminal(int width, LoadOpts& options) {
+    /* XXX: Set the desired width when the image is too wide  */
+    if ((options.desired_width <= 0) &&
+            (width > options.max_width)) {
+        options.desired_width = options.max_width;
+    }
+}
+
+/**
+ * Figures out the size a freshly decoded image should end up.
+ */
+void final_size(int width, int height, LoadOpts& options,
+                int *new_width, int *new_height) {
+    fit_to_terminal(width, options);
+    *new_width = width;
+    *new_height = height;
+    target_size(width, height, options, new_width, new_height);
+
+    if (options.halves_across > 0) {
+        *new_width = std::max((int) ((int64_t) *new_width * options.halves_across / 2), 1);
+    }
+    if (options.halves_down > 0) {
+        *new_height = std::max((int) ((int64_t) *new_height * options.halves_down / 2), 1);
+    }
+}
+
+/**
+ * Computes width * height * COLOUR_DEPTH in 64 bits, without overflowing.
+ * Returns false if the image is empty, or its size can't even be counted.
+ */
+bool image_bytes(int width, int height, size_t *bytes) {
+    size_t pixels;
+    if (width <= 0 || height <= 0) {
+        return false;
+    }
+    return !__builtin_mul_overflow((size_t) width, (size_t) height, &pixels)
+        && !__builtin_mul_overflow(pixels, (size_t) COLOUR_DEPTH, bytes);
+}
+
+/**
+ * Figures out what size an image of the given size should be resized to,
+ * without needing its pixels. Returns false if it should be left alone.
+ */
+bool target_size(int width, int height, const LoadOpts& options,
+                 int *new_width_out, int *new_height_out) {
     bool resize_width = options.desired_width > 0;
     bool resize_height = options.desired_height > 0;
+    int new_width, new_height;
 
     if (resize_width && resize_height) {
         /* Make sure the image is never smaller than 1x1 pixels. */
-        int new_width = std::max(options.desired_width, 1);
-        int new_height = std::max(options.desired_height, 1);
+        new_width = std::max(options.desired_width, 1);
+        new_height = std::max(options.desired_height, 1);
 
         /* Resize preserving aspect ratio. */
         if (options.preserve_aspect_ratio) {
             int max_width = new_width;
             int max_height = new_height;
-            new_width = img.width();
-            new_height = img.height();
+            new_width = width;
+            new_height = height;
 
             if (new_width > max_width) {
                 new_width = max_width;
-                double ratio = ((double) img.height()) / img.width();
+                double ratio = ((double) height) / width;
                 /* Scale height, ensuring it's at least 1px. */
                 new_height = std::max((int) (ratio * (double) new_width), 1);
             }
 
             if (new_height > max_height) {
                 new_height = max_height;
-                double ratio = ((double) img.width()) / img.height();
+                double ratio = ((double) width) / height;
                 /* Scale width, ensuring it's at least 1px. */
                 new_width = std::max((int) (ratio * (double) new_height), 1);
             }
         }
-
-        img.resize(new_width, new_height);
     } else if (resize_width) {
         /* Only resize if the image is strictly greater than the source width. */
-        if (img.width() <= options.max_width) {
-            return;
+        if (width <= options.max_width) {
+            return false;
         }
-        int new_width = options.desired_width;
-        double ratio = ((double) img.height()) / img.width();
+        new_width = options.desired_width;
+        double ratio = ((double) height) / width;
         /* Scale height, ensuring it's at least 1px. */
-        int new_height = std::max((int) (ratio * (double) new_width), 1);
-        img.resize(new_width, new_height);
+        new_height = std::max((int) (ratio * (double) new_width), 1);
     } else if (resize_height) {
         /* Resize without affecting aspect ratio. */
-        int new_height = options.desired_height;
-        double ratio = ((double) img.width()) / img.height();
+        new_height = options.desired_height;
+        double ratio = ((double) width) / height;
         /* Scale width, ensuring it's at least 1px. */
-        int new_width = std::max((int) (ratio * (double) new_height), 1);
-        img.resize(new_width, new_height);
+        new_width = std::max((int) (ratio * (double) new_height), 1);
+    } else {
+        return false;
     }
+
+    *new_width_out = new_width;
+    *new_height_out = new_height;
+    return true;
 }
 }
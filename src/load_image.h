@@ -19,9 +19,11 @@
 
 
 #ifdef __cplusplus
+#include <cstddef>
 #include <cstdint>
 extern "C" {
 #else
+#include <stddef.h>
 #include <stdint.h>
 #endif
 
@@ -33,8 +35,8 @@ extern const int colour_depth;
 /**
  * Contains an image's pixel data and its dimensions. The buffer is always 32
  * bits per pixel: the first three bytes are "colour" channels (either red,
- * blue, green or L*, a*, b*) and the final byte is the alpha channel (not
- * implemented).
+ * blue, green or L*, a*, b*) and the final byte is the alpha channel (opaque
+ * for images without one; not used when printing yet).
  *
  * Usage:
  *
@@ -56,6 +58,10 @@ struct LoadOpts {
     int desired_width;
     int desired_height;
     bool preserve_aspect_ratio;
+    /* Once it's fitted, the size is scaled by this many halves across and
+     * down, for pixels that aren't square (like a quadrant block's, which
+     * are half as wide as they're high). 0 is the same as 2: left alone. */
+    int halves_across, halves_down;
 };
 
 /**
@@ -64,11 +70,67 @@ struct LoadOpts {
  */
 bool load_image(const char *filename, struct Image *image, struct LoadOpts*);
 
+/**
+ * Like load_image(), but decodes an encoded image (e.g., a PNG file) that has
+ * already been read into memory. The data is not modified or retained.
+ */
+bool load_image_from_memory(const uint8_t *data, size_t length,
+                            struct Image *image, struct LoadOpts*);
+
 /**
  * Frees memory of the loaded image.
  */
 void unload_image(struct Image *image);
 
+/**
+ * An animated image (for now, only GIFs), decoded and resized one frame at a
+ * time.
+ *
+ * Usage:
+ *
+ * Open it with load_animation() or load_animation_from_memory(). Then, for
+ * each frame, call animation_next_frame() to decode it, and (unless you'd
+ * rather skip it) animation_render() to get it resized, just as
+ * load_image() would have. After the last frame, animation_rewind() starts
+ * over. Finally, call unload_animation().
+ */
+struct Animation;
+
+/**
+ * Opens the file as an animation. Returns NULL if it isn't one.
+ *
+ * Unlike load_image(), max_height is honoured: frames are shrunk to be no
+ * more than max_height pixels tall.
+ */
+struct Animation *load_animation(const char *filename, struct LoadOpts*);
+
+/**
+ * Like load_animation(), but the data is already in memory. The data must
+ * outlive the animation.
+ */
+struct Animation *load_animation_from_memory(const uint8_t *data, size_t length,
+                                             struct LoadOpts*);
+
+/**
+ * Decodes the next frame, and sets delay to how long it should be shown, in
+ * milliseconds. Returns false if there are no more frames.
+ */
+bool animation_next_frame(struct Animation *, int *delay);
+
+/**
+ * Resizes the current frame into image; free it with unload_image().
+ */
+bool animation_render(struct Animation *, struct Image *image);
+
+/**
+ * How many more times the animation asks to be played after the first time,
+ * where 0 means forever and -1 means it doesn't ask to be repeated.
+ */
+int animation_loop_count(const struct Animation *);
+
+void animation_rewind(struct Animation *);
+void unload_animation(struct Animation *);
+
 #ifdef __cplusplus
 }
 #endif /* __cplusplus */
@@ -0,0 +1,190 @@
+/*
+ * Copyright (c) 2026 Eddie Antonio Santos <hello@eddieantonio.ca>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+
+/**
+ * @file load_jpeg.c
+ * @brief Scaled, streaming JPEG decoding, straight through libjpeg.
+ */
+
+#include <setjmp.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "cimg_config.h"
+
+#ifdef cimg_use_jpeg
+#include <jpeglib.h>
+
+#include "load_jpeg.h"
+
+struct JpegStream {
+    struct jpeg_decompress_struct info;
+    struct jpeg_error_mgr error;
+    /* libjpeg's default is to exit(); instead, jump back here. */
+    jmp_buf escape;
+};
+
+static void escape_error(j_common_ptr info) {
+    struct JpegStream *stream = (struct JpegStream *) info->client_data;
+    longjmp(stream->escape, 1);
+}
+
+static void ignore_message(j_common_ptr info) {
+    /* Corrupt-data warnings are none of the terminal's business. */
+}
+
+/**
+ * Widens a row of grey or RGB pixels to RGBA.
+ */
+static void expand_row(const uint8_t *src, int channels, int width, uint8_t *dest) {
+    for (int x = 0; x < width; x++, src += channels, dest += 4) {
+        dest[0] = src[0];
+        dest[1] = src[channels == 1 ? 0 : 1];
+        dest[2] = src[channels == 1 ? 0 : 2];
+        dest[3] = 0xFF;
+    }
+}
+
+/**
+ * Does all the work, once the source has been set. Always destroys the
+ * decompressor.
+ */
+static bool jpeg_stream(struct JpegStream *stream, const struct ScanlineSink *sink) {
+    struct jpeg_decompress_struct *info = &stream->info;
+    /* volatile, since they're modified between setjmp() and longjmp(). */
+    uint8_t *volatile row = NULL;
+    uint8_t *volatile rgba = NULL;
+
+    if (setjmp(stream->escape)) {
+        jpeg_destroy_decompress(info);
+        free(row);
+        free(rgba);
+        return false;
+    }
+
+    jpeg_read_header(info, TRUE);
+
+    /* libjpeg only knows how to convert to these from the usual colour
+     * spaces; CMYK and friends are left to CImg. */
+    switch (info->jpeg_color_space) {
+        case JCS_GRAYSCALE:
+            info->out_color_space = JCS_GRAYSCALE;
+            break;
+        case JCS_YCbCr:
+        case JCS_RGB:
+#ifdef JCS_EXTENSIONS
+            /* libjpeg-turbo can write RGBA rows itself. */
+            info->out_color_space = JCS_EXT_RGBX;
+#else
+            info->out_color_space = JCS_RGB;
+#endif
+            break;
+        default:
+            longjmp(stream->escape, 1);
+    }
+
+    int min_width, min_height;
+    if (!sink->start(sink->context, info->image_width, info->image_height,
+                     &min_width, &min_height)) {
+        longjmp(stream->escape, 1);
+    }
+
+    /* Try the smallest scale first. */
+    info->scale_num = 1;
+    for (int denominator = 8; denominator >= 1; denominator /= 2) {
+        info->scale_denom = denominator;
+        jpeg_calc_output_dimensions(info);
+        if ((int) info->output_width >= min_width &&
+                (int) info->output_height >= min_height) {
+            break;
+        }
+    }
+
+    if (!sink->size(sink->context, info->output_width, info->output_height)) {
+        longjmp(stream->escape, 1);
+    }
+
+    jpeg_start_decompress(info);
+
+    const int width = info->output_width, channels = info->output_components;
+    row = malloc((size_t) width * channels);
+    if (channels != 4) {
+        rgba = malloc((size_t) width * 4);
+    }
+    if (row == NULL || (channels != 4 && rgba == NULL)) {
+        longjmp(stream->escape, 1);
+    }
+
+    while (info->output_scanline < info->output_height) {
+        JSAMPROW scanline = row;
+        jpeg_read_scanlines(info, &scanline, 1);
+        if (channels == 4) {
+            sink->row(sink->context, row);
+        } else {
+            expand_row(row, channels, width, rgba);
+            sink->row(sink->context, rgba);
+        }
+    }
+    jpeg_finish_decompress(info);
+
+    jpeg_destroy_decompress(info);
+    free(row);
+    free(rgba);
+    return true;
+}
+
+static struct JpegStream *jpeg_stream_new(void) {
+    struct JpegStream *stream = calloc(1, sizeof(struct JpegStream));
+    if (stream == NULL) {
+        return NULL;
+    }
+
+    stream->info.err = jpeg_std_error(&stream->error);
+    stream->error.error_exit = escape_error;
+    stream->error.output_message = ignore_message;
+    stream->info.client_data = stream;
+    jpeg_create_decompress(&stream->info);
+    return stream;
+}
+
+bool jpeg_stream_file(FILE *file, const struct ScanlineSink *sink) {
+    struct JpegStream *stream = jpeg_stream_new();
+    if (stream == NULL) {
+        return false;
+    }
+
+    jpeg_stdio_src(&stream->info, file);
+    bool success = jpeg_stream(stream, sink);
+    free(stream);
+    return success;
+}
+
+bool jpeg_stream_memory(const uint8_t *data, size_t length,
+                        const struct ScanlineSink *sink) {
+    struct JpegStream *stream = jpeg_stream_new();
+    if (stream == NULL) {
+        return false;
+    }
+
+    jpeg_mem_src(&stream->info, (unsigned char *) data, length);
+    bool success = jpeg_stream(stream, sink);
+    free(stream);
+    return success;
+}
+
+#endif /* cimg_use_jpeg */
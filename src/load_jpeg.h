@@ -0,0 +1,64 @@
+/*
+ * Copyright (c) 2026 Eddie Antonio Santos <hello@eddieantonio.ca>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+
+/**
+ * @file load_jpeg.h
+ * @brief Streams JPEGs, at reduced size, using libjpeg's DCT scaling.
+ *
+ * libjpeg can produce a 1/2, 1/4, or 1/8 scale image almost for free while
+ * decoding, by throwing away high-frequency DCT coefficients. When the image
+ * is going to be shrunk to fit in the terminal anyway, this saves most of
+ * the time and memory that a full-size decode would take. Rows are handed
+ * to a ScanlineSink as they're decoded, so only one row is ever held here.
+ *
+ * Only available when libjpeg is (i.e., when cimg_use_jpeg is defined).
+ */
+
+#ifndef LOAD_JPEG_H
+#define LOAD_JPEG_H
+
+#include "scanline.h"
+
+#ifdef __cplusplus
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+extern "C" {
+#else
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#endif
+
+/**
+ * Decodes the JPEG in file, at the smallest scale (1/8, 1/4, 1/2, or 1) that
+ * is still at least the sink's minimum size. The file is not closed.
+ * Returns false if the image could not be decoded, or the sink stopped it.
+ */
+bool jpeg_stream_file(FILE *file, const struct ScanlineSink *sink);
+
+/**
+ * Like jpeg_stream_file(), but for a JPEG that's already in memory.
+ */
+bool jpeg_stream_memory(const uint8_t *data, size_t length,
+                        const struct ScanlineSink *sink);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+#endif /* LOAD_JPEG_H */
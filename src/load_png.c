@@ -0,0 +1,162 @@
+/*
+ * Copyright (c) 2026 Eddie Antonio Santos <hello@eddieantonio.ca>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+
+/**
+ * @file load_png.c
+ * @brief Streaming PNG decoding, straight through libpng.
+ */
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "cimg_config.h"
+
+#ifdef cimg_use_png
+#include <png.h>
+
+#include "load_png.h"
+
+enum {
+    /* How much of the file to hand to libpng at a time. */
+    CHUNK_LEN = 64 * 1024,
+};
+
+struct PngStream {
+    const struct ScanlineSink *sink;
+    int height, rows;
+    bool finished;
+};
+
+static void silent_error(png_structp png, png_const_charp message) {
+    png_longjmp(png, 1);
+}
+
+static void silent_warning(png_structp png, png_const_charp message) {
+    /* Nothing to see here. */
+}
+
+/**
+ * Called once the header has been read: ask libpng for 8-bit RGBA rows, no
+ * matter what's in the file.
+ */
+static void on_info(png_structp png, png_infop info) {
+    struct PngStream *stream = png_get_progressive_ptr(png);
+    const struct ScanlineSink *sink = stream->sink;
+    png_uint_32 width, height;
+    int bit_depth, colour_type, interlace;
+
+    png_get_IHDR(png, info, &width, &height, &bit_depth, &colour_type,
+                 &interlace, NULL, NULL);
+    if (interlace != PNG_INTERLACE_NONE || width > INT32_MAX || height > INT32_MAX) {
+        png_error(png, "cannot stream this PNG");
+    }
+
+    /* Palettes, low bit depths, and tRNS all become 8-bit channels. */
+    png_set_expand(png);
+    png_set_strip_16(png);
+    if (!(colour_type & PNG_COLOR_MASK_COLOR)) {
+        png_set_gray_to_rgb(png);
+    }
+    /* Only adds alpha if there isn't any already. */
+    png_set_filler(png, 0xFF, PNG_FILLER_AFTER);
+    png_read_update_info(png, info);
+
+    if (png_get_rowbytes(png, info) != (size_t) width * 4) {
+        png_error(png, "unexpected row size");
+    }
+
+    int min_width, min_height;
+    if (!sink->start(sink->context, width, height, &min_width, &min_height) ||
+            !sink->size(sink->context, width, height)) {
+        png_error(png, "stopped by sink");
+    }
+    stream->height = height;
+}
+
+static void on_row(png_structp png, png_bytep row, png_uint_32 y, int pass) {
+    struct PngStream *stream = png_get_progressive_ptr(png);
+
+    /* Without interlacing, every row comes exactly once, in order. */
+    if (row != NULL && stream->rows < stream->height) {
+        stream->sink->row(stream->sink->context, row);
+        stream->rows++;
+    }
+}
+
+static void on_end(png_structp png, png_infop info) {
+    struct PngStream *stream = png_get_progressive_ptr(png);
+    stream->finished = true;
+}
+
+/**
+ * Feeds either the file or the buffer to libpng, whichever is given.
+ */
+static bool png_stream(FILE *file, const uint8_t *data, size_t length,
+                       const struct ScanlineSink *sink) {
+    struct PngStream stream = { .sink = sink };
+    png_bytep volatile chunk = NULL;
+
+    png_structp png = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL,
+                                             silent_error, silent_warning);
+    if (png == NULL) {
+        return false;
+    }
+    png_infop info = png_create_info_struct(png);
+    if (info == NULL) {
+        png_destroy_read_struct(&png, NULL, NULL);
+        return false;
+    }
+
+    if (setjmp(png_jmpbuf(png))) {
+        png_destroy_read_struct(&png, &info, NULL);
+        free(chunk);
+        return false;
+    }
+
+    png_set_progressive_read_fn(png, &stream, on_info, on_row, on_end);
+
+    if (file == NULL) {
+        png_process_data(png, info, (png_bytep) data, length);
+    } else {
+        chunk = malloc(CHUNK_LEN);
+        if (chunk == NULL) {
+            png_error(png, "out of memory");
+        }
+        size_t bytes_read;
+        while (!stream.finished && (bytes_read = fread(chunk, 1, CHUNK_LEN, file)) > 0) {
+            png_process_data(png, info, chunk, bytes_read);
+        }
+    }
+
+    png_destroy_read_struct(&png, &info, NULL);
+    free(chunk);
+
+    /* A truncated file just stops short, without an error. */
+    return stream.finished && stream.rows == stream.height;
+}
+
+bool png_stream_file(FILE *file, const struct ScanlineSink *sink) {
+    return png_stream(file, NULL, 0, sink);
+}
+
+bool png_stream_memory(const uint8_t *data, size_t length,
+                       const struct ScanlineSink *sink) {
+    return png_stream(NULL, data, length, sink);
+}
+
+#endif /* cimg_use_png */
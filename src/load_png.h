@@ -0,0 +1,61 @@
+/*
+ * Copyright (c) 2026 Eddie Antonio Santos <hello@eddieantonio.ca>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+
+/**
+ * @file load_png.h
+ * @brief Streams PNGs a row at a time, using libpng's progressive reader.
+ *
+ * Only available when libpng is (i.e., when cimg_use_png is defined).
+ */
+
+#ifndef LOAD_PNG_H
+#define LOAD_PNG_H
+
+#include "scanline.h"
+
+#ifdef __cplusplus
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+extern "C" {
+#else
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#endif
+
+/**
+ * Decodes the PNG in file, handing each row to the sink as soon as it's
+ * decoded. The file is not closed. Returns false if the image could not be
+ * decoded, or the sink stopped it.
+ *
+ * Interlaced PNGs can't be streamed, since the last pass touches every row;
+ * they are refused.
+ */
+bool png_stream_file(FILE *file, const struct ScanlineSink *sink);
+
+/**
+ * Like png_stream_file(), but for a PNG that's already in memory.
+ */
+bool png_stream_memory(const uint8_t *data, size_t length,
+                       const struct ScanlineSink *sink);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+#endif /* LOAD_PNG_H */
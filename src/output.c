@@ -0,0 +1,183 @@
+/*
+ * Copyright (c) 2026 Eddie Antonio Santos <hello@eddieantonio.ca>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/**
+ * @file output.c
+ * @brief Buffered output with one write(2) per flush.
+ */
+
+/* Feature-test macro for poll(2) */
+#define _XOPEN_SOURCE 600
+#include <errno.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "output.h"
+#include "profile.h"
+
+enum {
+    /* Start big enough for a modest row of true color cells. */
+    INITIAL_CAPACITY = 16 * 1024,
+    /* Flushing at roughly this size keeps the buffer cache-sized, while
+     * still writing many rows per system call. */
+    FLUSH_THRESHOLD = 64 * 1024,
+};
+
+enum {
+    /* Output.fd for outputs that don't write to a file descriptor. */
+    NO_FD = -1,
+};
+
+void output_init(struct Output *output, int fd) {
+    *output = (struct Output) {
+        .fd = fd,
+        .sink = NULL,
+        .data = NULL,
+        .length = 0,
+        .capacity = 0,
+        .bytes_written = 0,
+        .borrowed = false,
+        .failed = false,
+    };
+}
+
+void output_init_memory(struct Output *output, char *buffer, size_t capacity) {
+    output_init(output, NO_FD);
+    if (buffer != NULL) {
+        output->data = buffer;
+        output->capacity = capacity;
+        output->borrowed = true;
+    }
+}
+
+void output_init_sink(struct Output *output, struct Output *sink) {
+    output_init(output, NO_FD);
+    output->sink = sink;
+}
+
+void output_free(struct Output *output) {
+    if (!output->borrowed) {
+        free(output->data);
+    }
+    output->data = NULL;
+    output->length = output->capacity = 0;
+}
+
+void output_clear(struct Output *output) {
+    output->length = 0;
+    output->bytes_written = 0;
+    output->failed = false;
+}
+
+bool output_reserve(struct Output *output, size_t n) {
+    if (output->failed) {
+        return false;
+    }
+    if (output->length + n <= output->capacity) {
+        return true;
+    } else if (output->borrowed) {
+        output->failed = true;
+        return false;
+    }
+
+    size_t new_capacity = output->capacity ? output->capacity : INITIAL_CAPACITY;
+    while (new_capacity < output->length + n) {
+        new_capacity *= 2;
+    }
+
+    char *data = realloc(output->data, new_capacity);
+    if (data == NULL) {
+        output->failed = true;
+        return false;
+    }
+
+    output->data = data;
+    output->capacity = new_capacity;
+    return true;
+}
+
+bool output_should_flush(const struct Output *output) {
+    return output->length >= FLUSH_THRESHOLD;
+}
+
+/**
+ * Waits until fd is writable again. Only needed if somebody handed us a
+ * non-blocking stdout.
+ */
+static void wait_until_writable(int fd) {
+    struct pollfd pfd = { .fd = fd, .events = POLLOUT };
+    while (poll(&pfd, 1, -1) == -1 && errno == EINTR) {
+        /* Try again. */
+    }
+}
+
+/**
+ * Moves everything buffered to the end of the sink.
+ */
+static bool flush_to_sink(struct Output *output) {
+    struct Output *sink = output->sink;
+
+    if (!output->failed) {
+        output_write(sink, output->data, output->length);
+        if (sink->failed) {
+            output->failed = true;
+        } else {
+            output->bytes_written += output->length;
+        }
+    }
+
+    output->length = 0;
+    return !output->failed;
+}
+
+bool output_flush(struct Output *output) {
+    if (output->sink != NULL) {
+        return flush_to_sink(output);
+    } else if (output->fd == NO_FD) {
+        /* Everything stays in memory. */
+        return !output->failed;
+    }
+
+    const char *pos = output->data;
+    size_t remaining = output->length;
+    int64_t start = profile_now();
+
+    while (remaining > 0 && !output->failed) {
+        ssize_t written = write(output->fd, pos, remaining);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                wait_until_writable(output->fd);
+                continue;
+            }
+            output->failed = true;
+            break;
+        }
+        /* Partial writes are fine: just go around again. */
+        pos += written;
+        remaining -= written;
+        output->bytes_written += written;
+    }
+
+    profile_add(P_WRITE, start);
+    profile_count(P_BYTES_WRITTEN, pos - output->data);
+    profile_span("write", start, NULL);
+
+    output->length = 0;
+    return !output->failed;
+}
@@ -0,0 +1,107 @@
+/*
+ * Copyright (c) 2026 Eddie Antonio Santos <hello@eddieantonio.ca>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/**
+ * @file output.h
+ * @brief A growable byte buffer that is flushed straight to a file descriptor.
+ *
+ * Usage:
+ *
+ * Initialize an Output with output_init(), append to it as much as you like,
+ * then call output_flush() whenever it's a good time to write (e.g., at the
+ * end of a row once output_should_flush() says so). Finally, call
+ * output_free().
+ *
+ * An Output can also collect everything in memory (output_init_memory()),
+ * in which case flushing does nothing; or be flushed into such an Output
+ * (output_init_sink()), rather than into a file descriptor.
+ */
+
+#ifndef OUTPUT_H
+#define OUTPUT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+
+struct Output {
+    /* Where flushed bytes go: a file descriptor, or else the sink. With
+     * neither, the output is kept in data. */
+    int fd;
+    struct Output *sink;
+    char *data;
+    size_t length, capacity;
+    /* Running total of bytes that have made it to fd or the sink. */
+    size_t bytes_written;
+    /* Set when data belongs to the caller, so it can't be grown or freed. */
+    bool borrowed;
+    /* Set when memory ran out or fd stopped accepting writes. Once set,
+     * everything else is silently discarded. */
+    bool failed;
+};
+
+void output_init(struct Output *output, int fd);
+void output_free(struct Output *output);
+
+/**
+ * Initializes an Output that keeps everything in memory. If buffer is NULL,
+ * memory is allocated as needed; otherwise, everything is written to buffer,
+ * and the Output fails if it needs more than capacity bytes.
+ */
+void output_init_memory(struct Output *output, char *buffer, size_t capacity);
+
+/**
+ * Initializes an Output that is flushed by appending to sink.
+ */
+void output_init_sink(struct Output *output, struct Output *sink);
+
+/**
+ * Forgets everything buffered and any failure, but keeps the memory, so the
+ * Output can be used again.
+ */
+void output_clear(struct Output *output);
+
+/**
+ * Makes room for at least n more bytes. Returns false if that's impossible.
+ */
+bool output_reserve(struct Output *output, size_t n);
+
+/**
+ * Writes out everything buffered so far, retrying on partial writes, EINTR,
+ * and EAGAIN. Returns false if the bytes could not be written. Does nothing
+ * to an in-memory Output.
+ */
+bool output_flush(struct Output *output);
+
+/**
+ * True when enough has been buffered that it's worth paying for a write(2).
+ */
+bool output_should_flush(const struct Output *output);
+
+/* Appending is on the hot path, so only growing the buffer is out of line. */
+static inline void output_write(struct Output *output, const void *bytes, size_t n) {
+    if (output->length + n > output->capacity && !output_reserve(output, n)) {
+        return;
+    }
+    memcpy(output->data + output->length, bytes, n);
+    output->length += n;
+}
+
+static inline void output_puts(struct Output *output, const char *string) {
+    output_write(output, string, strlen(string));
+}
+
+#endif /* OUTPUT_H */
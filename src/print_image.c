@@ -19,115 +19,1566 @@
  * suitable.
  */
 
+/* Feature-test macro for mmap(2) and posix_madvise(2). */
+#define _XOPEN_SOURCE 600
 #include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <math.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
 
 #include "print_image.h"
+#include "base64.h"
+#include "kitty.h"
 #include "load_image.h"
+#include "output.h"
+#include "profile.h"
+#include "quantize.h"
+#include "sixel.h"
 
-#include "rgbtree.h"
+enum {
+    /* How many bytes to base64 encode at a time. This is a multiple of three,
+     * so that no padding is added until the very end, and encodes to 64 KiB.
+     */
+    BASE64_CHUNK_LEN = 48 * 1024,
+
+    /* Cells are formatted into a buffer that is **at least** this big: an
+     * escape sequence with both layers ("\033[38;2;000;000;000;48;2;000;
+     * 000;000m"), the glyph, and slack for the whole-Snippet copies. */
+    MAX_CELL_LEN = 64,
+
+    /* When formatting in parallel, lines are handed out in bands of at most
+     * this many lines... */
+    MAX_BAND_LINES = 32,
+    /* ...and each thread should get at least this many bands, so that a slow
+     * band doesn't leave the others idle. */
+    BANDS_PER_JOB = 4,
+    /* Workers may only get this many bands per thread ahead of the band
+     * being written, which bounds how much output is held in memory. */
+    SLOTS_PER_JOB = 2,
+
+    /* --max-bytes estimates an image's size by formatting at most this many
+     * of its lines (or sixel bands), evenly spread out. */
+    SAMPLE_LINES = 16,
+    /* ...each pixel of which is averaged from at most this many by this
+     * many of the decoded image's pixels. */
+    MAX_SAMPLE_GRID = 4,
+    /* If the image printed is over the budget, or under it by more than
+     * 1/BUDGET_SLACK of it, it's printed narrower or wider at most this many
+     * times. */
+    MAX_BUDGET_RETRIES = 3,
+    BUDGET_SLACK = 10,
+
+    /* The most rows of pixels a cell can show (a sextant's). */
+    MAX_BLOCK_ROWS = 3,
+
+    /* Frames of an animation with a shorter delay than this (in ms) are
+     * shown for the default instead, just like browsers do. */
+    MIN_FRAME_DELAY = 20,
+    DEFAULT_FRAME_DELAY = 100,
+    /* For PrintRequest.plays: keep playing until interrupted. */
+    PLAY_FOREVER = -1,
+};
+
+/* Also used to index the escape tables. */
+enum layer {
+    BACKGROUND, FOREGROUND
+};
+
+/* The glyph printed in half-height mode. In UTF-8, it's three bytes long. */
+static const char upper_half_block[] = "▀";
+
+/* How many pixels across and down each of Blocks shows in a cell; and how
+ * many of them, in halves, there are to each of B_HALF's (which B_FULL's
+ * are the same size as), since the image is fitted in those. */
+static const struct {
+    int columns, rows;
+    int halves_across, halves_down;
+} block_shapes[] = {
+    [B_FULL] = { 1, 1, 2, 2 },
+    [B_HALF] = { 1, 2, 2, 2 },
+    [B_QUADRANT] = { 2, 2, 4, 2 },
+    [B_SEXTANT] = { 2, 3, 4, 3 },
+};
+
+/* The quadrant and sextant glyphs, by mask. Bit i of the mask is the ith
+ * pixel of the cell, left to right, then top to bottom; it's set where the
+ * glyph shows the foreground colour. */
+static const char *const quadrant_glyphs[16] = {
+    " ", "▘", "▝", "▀", "▖", "▌", "▞", "▛", "▗", "▚", "▐", "▜", "▄", "▙", "▟", "█",
+};
+static const char *const sextant_glyphs[64] = {
+    " ", "🬀", "🬁", "🬂", "🬃", "🬄", "🬅", "🬆", /* 0 to 7 */
+    "🬇", "🬈", "🬉", "🬊", "🬋", "🬌", "🬍", "🬎", /* 8 to 15 */
+    "🬏", "🬐", "🬑", "🬒", "🬓", "▌", "🬔", "🬕", /* 16 to 23 */
+    "🬖", "🬗", "🬘", "🬙", "🬚", "🬛", "🬜", "🬝", /* 24 to 31 */
+    "🬞", "🬟", "🬠", "🬡", "🬢", "🬣", "🬤", "🬥", /* 32 to 39 */
+    "🬦", "🬧", "▐", "🬨", "🬩", "🬪", "🬫", "🬬", /* 40 to 47 */
+    "🬭", "🬮", "🬯", "🬰", "🬱", "🬲", "🬳", "🬴", /* 48 to 55 */
+    "🬵", "🬶", "🬷", "🬸", "🬹", "🬺", "🬻", "█", /* 56 to 63 */
+};
+
+/* 65536 / n, rounded up: (sum * reciprocals[n]) >> 16 is sum / n, for sums
+ * of up to six bytes. */
+static const uint32_t reciprocals[] = { 0, 65536, 32768, 21846, 16384, 13108, 10923 };
+
+/**
+ * A short, pre-formatted string. Snippets are always copied whole, which is
+ * just a couple of moves; only the first `length` bytes are meaningful.
+ */
+typedef struct {
+    char bytes[15];
+    uint8_t length;
+} Snippet;
+
+/**
+ * Pre-formatted parameter bytes, so that formatting a cell is only a few
+ * copies instead of a call to snprintf(). Parameter bytes are the bytes that
+ * go between the Command Sequence Initiator (CSI, a.k.a, "\033[") and the
+ * "m" at the end.
+ */
+struct EscapeTable {
+    /* "000" to "255" (or "0" to "255" when compact). */
+    Snippet decimal[256];
+    /* "48;5;000" to "48;5;255", and "38;5;000" to "38;5;255". */
+    Snippet palette[2][256];
+    /* "40" to "47", and "30" to "37". */
+    Snippet ansi[2][8];
+    /* "48;2;" and "38;2;", to be followed by three decimals. */
+    Snippet true_color[2];
+};
+
+static struct EscapeTable padded_escapes, compact_escapes;
+static pthread_once_t escape_tables_once = PTHREAD_ONCE_INIT;
+
+/* Each frame of an animation is wrapped in a synchronized update, so that the
+ * terminal shows it all at once, rather than as it trickles in. */
+static const char begin_synchronized_update[] = "\033[?2026h";
+static const char end_synchronized_update[] = "\033[?2026l";
+
+/* Set by the signal handler when an animation should stop. */
+static volatile sig_atomic_t interrupted_by = 0;
+
+/**
+ * What gets printed in a cell: an index into the palette for the 8 and 256
+ * color formats, or the pixel itself, packed as 0xRRGGBB, for true color.
+ */
+typedef uint32_t Colour;
+
+/**
+ * A colour function appends the parameter bytes for a colour to dest, and
+ * returns the new end of the string. There must be room for at least
+ * sizeof(Snippet) bytes more than the parameter bytes themselves.
+ */
+typedef char* (*ColourFunc)(const struct EscapeTable *, Colour colour,
+                            enum layer, char *dest);
+
+/**
+ * Turns rows of pixels into colours, and colours into escape sequences.
+ */
+struct Printer {
+    Format format;
+    Quantizer quantizer;
+    Emission emission;
+    Blocks blocks;
+    /* Whether rows may be written as soon as there are enough of them. Off
+     * when formatting a band that has to wait its turn. */
+    bool flush_rows;
+    ColourFunc print;
+    const struct EscapeTable *escapes;
+    /* Only used when dithering; otherwise, its dither is D_NONE. */
+    struct Ditherer ditherer;
+    /* Scratch space, each as wide as a line of cells: */
+    uint8_t *indices;
+    Colour *upper, *lower;
+    /* ...for quadrants and sextants, which pixels are in the foreground,
+     * and the two colours (as pixels) before quantizing. */
+    uint8_t *masks;
+    uint8_t *foreground, *background;
+    /* Escape sequences are collected here, rather than printf'd per cell. */
+    struct Output output;
+};
+
+/**
+ * Holds the output of one band of lines, until it's that band's turn to be
+ * written.
+ */
+struct BandSlot {
+    struct Output output;
+    bool done;
+};
+
+/**
+ * Bands of lines, formatted by worker threads in any order, and written by
+ * the calling thread in order. Everything here is protected by lock.
+ */
+struct BandQueue {
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    const struct Image *image;
+    int lines, lines_per_band, bands;
+    /* The next band a worker should format. */
+    int next_band;
+    /* The next band to be written; band b lives in slots[b % n_slots]. */
+    int next_to_write;
+    int n_slots;
+    struct BandSlot *slots;
+};
+
+struct BandWorker {
+    struct BandQueue *queue;
+    struct Printer printer;
+    pthread_t thread;
+};
+
+/**
+ * One way --max-bytes could print an image.
+ */
+struct Rendering {
+    Format format;
+    Blocks blocks;
+    /* In pixels; the height keeps the decoded image's aspect ratio. */
+    int width, height;
+    /* How many bytes it's estimated to print. */
+    size_t estimate;
+};
+
+/**
+ * The cells of an animation that are on the screen, and the cells of the
+ * frame about to replace them, so that only the cells that changed have to be
+ * printed. In full-height mode, only the upper layer is used; the masks are
+ * only used for quadrants and sextants. The width is in cells.
+ */
+struct Screen {
+    int width, lines;
+    Colour *shown_upper, *shown_lower;
+    Colour *upper, *lower;
+    uint8_t *shown_masks, *masks;
+};
+
+static bool iterm2_passthrough(PrintRequest *request);
+static bool print_base64(struct Output *output, int fd);
+static bool print_base64_buffer(struct Output *output, const uint8_t *data, size_t length);
+static bool print_iterate(PrintRequest *request);
+static struct LoadOpts load_options(const PrintRequest *request);
+static bool decode_image_at(const PrintRequest *, int width, int height, struct Image *);
+static bool decode_with_options(const PrintRequest *, struct LoadOpts *, struct Image *);
+static bool print_animation(PrintRequest *request);
+static bool play_animation(PrintRequest *request, struct Animation *animation);
+static bool show_frame(struct Animation *, struct Printer *, struct Screen *);
+static bool screen_init(struct Screen *, int width, int lines);
+static void screen_free(struct Screen *);
+static void compute_cells(struct Printer *, const struct Image *, struct Screen *);
+static void print_whole_frame(struct Printer *, struct Screen *);
+static void print_changed_cells(struct Printer *, struct Screen *);
+static void move_cursor(struct Output *, int from_line, int to_line, int column);
+static bool print_in_parallel(PrintRequest *request, const struct Image *image, bool *success);
+static bool print_sixel(PrintRequest *request, struct Image *image);
+static bool print_kitty(PrintRequest *request, const struct Image *image);
+static bool print_within_budget(PrintRequest *request);
+static bool choose_rendering(const PrintRequest *, const struct Image *, struct Rendering *);
+static bool estimate_size(const PrintRequest *, const struct Image *, struct Rendering *);
+static int scaled_height(int image_width, int image_height, Blocks from, Blocks to, int width);
+static void *band_worker(void *arg);
+static void flush_stdio(const PrintRequest *request);
+static void request_output_init(struct Output *output, const PrintRequest *request);
+static bool printer_init(struct Printer *, PrintRequest *, int width);
+static void printer_free(struct Printer *);
+static void quantize_indices(struct Printer *, const uint8_t *pixels, int y, int width, uint8_t *indices);
+static void quantize_row(struct Printer *, const uint8_t *pixels, int y, int width, Colour *colours);
+static int count_lines(const struct Image *image, Blocks blocks);
+static int count_cells(int width, Blocks blocks);
+static Blocks request_blocks(const PrintRequest *request);
+static void print_lines(const struct Image *image, struct Printer *printer, int first, int last);
+static void half_height_image_iterator(const struct Image *image, struct Printer *printer, int first, int last);
+static void block_image_iterator(const struct Image *image, struct Printer *printer, int first, int last);
+static void image_iterator(const struct Image *image, struct Printer *printer, int first, int last);
+static void fit_blocks(const uint8_t *const rows[], int n_rows, int width,
+                       uint8_t *foreground, uint8_t *background, uint8_t *masks);
+static void quantize_blocks(struct Printer *, const uint8_t *const rows[], int line, int width,
+                            Colour *foreground, Colour *background, uint8_t *masks);
+static void print_cells(struct Printer *, const Colour *upper, const Colour *lower,
+                        const uint8_t *masks, int width);
+static void print_row(struct Printer *, const Colour *colours, int width);
+static void print_half_height_row(struct Printer *, const Colour *top, const Colour *bottom, int width);
+static void print_block_row(struct Printer *, const Colour *foreground, const Colour *background,
+                            const uint8_t *masks, int width);
+static void print_repeats(struct Printer *, const char *glyph, int count);
+static void print_osc(struct Output *output);
+static void print_st(struct Output *output);
+static void build_escape_tables(void);
+static char* printer_true_color(const struct EscapeTable *, Colour colour, enum layer, char *dest);
+static char* printer_256_color(const struct EscapeTable *, Colour colour, enum layer, char *dest);
+static char* printer_8_color(const struct EscapeTable *, Colour colour, enum layer, char *dest);
+
+
+bool print_image(PrintRequest *request) {
+    if (request->format == F_ITERM2) {
+        /* iTerm2 plays animated GIFs all by itself. */
+        return iterm2_passthrough(request);
+    } else if (request->animate && request->format != F_SIXEL && request->format != F_KITTY) {
+        return print_animation(request);
+    } else if (request->max_bytes > 0 && request->format != F_KITTY) {
+        return print_within_budget(request);
+    } else {
+        /* Delegate to the "pixel iterator" approach. */
+        return print_iterate(request);
+    }
+}
+
+
+static bool print_iterate(PrintRequest *request) {
+    struct Image image;
+
+    return decode_image(request, &image) && print_decoded_image(request, &image);
+}
+
+static struct LoadOpts load_options(const PrintRequest *request) {
+    const Blocks blocks = request_blocks(request);
+    return (struct LoadOpts) {
+        .max_width = request->max_width,
+        .max_height = request->max_height,
+        .desired_width = request->desired_width,
+        .desired_height = request->desired_height,
+        .preserve_aspect_ratio = request->preserve_aspect_ratio,
+        .halves_across = block_shapes[blocks].halves_across,
+        .halves_down = block_shapes[blocks].halves_down,
+    };
+}
+
+bool decode_image(const PrintRequest *request, struct Image *image) {
+    struct LoadOpts options = load_options(request);
+    return decode_with_options(request, &options, image);
+}
+
+/**
+ * Decodes the image at exactly width × height of its own pixels.
+ */
+static bool decode_image_at(const PrintRequest *request, int width, int height,
+                            struct Image *image) {
+    struct LoadOpts options = {
+        .max_width = width,
+        .max_height = height,
+        .desired_width = width,
+        .desired_height = height,
+        .preserve_aspect_ratio = false,
+    };
+    return decode_with_options(request, &options, image);
+}
+
+static bool decode_with_options(const PrintRequest *request, struct LoadOpts *options,
+                                struct Image *image) {
+    assert(request->format != F_UNSET && request->format != F_ITERM2);
+
+    int64_t start = profile_now();
+    profile_set_image(request->filename);
+
+    /* Load the image, and potentially rescale it. */
+    bool success = request->data != NULL
+        ? load_image_from_memory(request->data, request->data_length, image, options)
+        : load_image(request->filename, image, options);
+    profile_span("decode", start, request->filename);
+    return success;
+}
+
+bool print_decoded_image(PrintRequest *request, struct Image *image) {
+    int64_t start = profile_now();
+    flush_stdio(request);
+
+    if (request->format == F_SIXEL) {
+        bool success = print_sixel(request, image);
+        unload_image(image);
+        profile_span("print", start, request->filename);
+        return success;
+    } else if (request->format == F_KITTY) {
+        bool success = print_kitty(request, image);
+        unload_image(image);
+        profile_span("print", start, request->filename);
+        return success;
+    }
+
+    bool success;
+    if (request->jobs > 1 && print_in_parallel(request, image, &success)) {
+        unload_image(image);
+        profile_span("print", start, request->filename);
+        return success;
+    }
+
+    struct Printer printer;
+    if (!printer_init(&printer, request, image->width)) {
+        unload_image(image);
+        return false;
+    }
+
+    /* That resized buffer? Yeah. Print it. */
+    print_lines(image, &printer, 0, count_lines(image, printer.blocks));
+
+    output_flush(&printer.output);
+    request->bytes_written = printer.output.bytes_written;
+    success = !printer.output.failed;
+
+    printer_free(&printer);
+    unload_image(image);
+    profile_span("print", start, request->filename);
+    return success;
+}
+
+/**
+ * Plays the image if it's animated, or prints it like any other image if it
+ * isn't.
+ */
+static bool print_animation(PrintRequest *request) {
+    struct LoadOpts options = load_options(request);
+
+    /* The whole animation has to fit on the screen, with a line to spare for
+     * the cursor to sit on. */
+    options.max_height = DIMENSION_UNSET;
+    if (request->max_height > 1) {
+        options.max_height = (request->max_height - 1) * block_shapes[request_blocks(request)].rows;
+    }
+
+    profile_set_image(request->filename);
+    struct Animation *animation = request->data != NULL
+        ? load_animation_from_memory(request->data, request->data_length, &options)
+        : load_animation(request->filename, &options);
+    if (animation == NULL) {
+        return print_iterate(request);
+    }
+
+    bool success = play_animation(request, animation);
+    unload_animation(animation);
+    return success;
+}
+
+static void on_interrupt(int signal) {
+    interrupted_by = signal;
+}
+
+/* Milliseconds on a clock that only ever goes forward. */
+static int64_t now_ms(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t) now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+/* Sleeps until the given now_ms(), or until a signal arrives. */
+static void sleep_until(int64_t ms) {
+    struct timespec deadline = {
+        .tv_sec = ms / 1000,
+        .tv_nsec = (ms % 1000) * 1000000,
+    };
+    clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL);
+}
+
+static int frame_delay(int delay) {
+    return delay < MIN_FRAME_DELAY ? DEFAULT_FRAME_DELAY : delay;
+}
+
+/**
+ * Prints the first frame in full, then each following frame on top of it,
+ * printing only the cells that changed. Frames are paced by their delays;
+ * if printing falls so far behind that a frame's time is already over
+ * before it's even started, that frame is skipped.
+ *
+ * An image with only one frame is printed just like a still image.
+ */
+static bool play_animation(PrintRequest *request, struct Animation *animation) {
+    struct Image frame;
+    struct Printer printer;
+    struct Screen screen;
+    int delay, next_delay;
+
+    if (!animation_next_frame(animation, &delay) || !animation_render(animation, &frame)) {
+        return false;
+    }
+    if (!animation_next_frame(animation, &next_delay)) {
+        return print_decoded_image(request, &frame);
+    }
+
+    /* How many more times to start over, after this time through. */
+    int replays;
+    if (request->plays > 0) {
+        replays = request->plays - 1;
+    } else {
+        int loops = animation_loop_count(animation);
+        replays = loops < 0 ? 0 : loops == 0 ? PLAY_FOREVER : loops;
+    }
+
+    flush_stdio(request);
+
+    if (!printer_init(&printer, request, frame.width)) {
+        unload_image(&frame);
+        return false;
+    }
+    if (!screen_init(&screen, count_cells(frame.width, printer.blocks),
+                     count_lines(&frame, printer.blocks))) {
+        printer_free(&printer);
+        unload_image(&frame);
+        return false;
+    }
+
+    /* Stop cleanly between frames, so the terminal isn't left without a
+     * cursor. Without SA_RESTART, the signal also cuts a sleep short. */
+    struct sigaction interrupt = { .sa_handler = on_interrupt }, old_int, old_term;
+    sigemptyset(&interrupt.sa_mask);
+    interrupted_by = 0;
+    sigaction(SIGINT, &interrupt, &old_int);
+    sigaction(SIGTERM, &interrupt, &old_term);
+
+    /* Hide the cursor, then print the first frame in full. */
+    output_puts(&printer.output, "\033[?25l");
+    compute_cells(&printer, &frame, &screen);
+    output_puts(&printer.output, begin_synchronized_update);
+    print_whole_frame(&printer, &screen);
+    output_puts(&printer.output, end_synchronized_update);
+    output_flush(&printer.output);
+    unload_image(&frame);
+
+    int64_t due = now_ms() + frame_delay(delay);
+    delay = next_delay;
+    /* Whether the frame on the canvas was skipped. */
+    bool skipped = false;
+    bool success = true;
+
+    while (!interrupted_by && !printer.output.failed) {
+        if (now_ms() >= due + frame_delay(delay)) {
+            skipped = true;
+        } else {
+            sleep_until(due);
+            if (interrupted_by) {
+                break;
+            }
+            success = show_frame(animation, &printer, &screen);
+            skipped = false;
+        }
+        due += frame_delay(delay);
+
+        if (!animation_next_frame(animation, &delay)) {
+            if (replays == 0) {
+                break;
+            } else if (replays != PLAY_FOREVER) {
+                replays--;
+            }
+            animation_rewind(animation);
+            if (!animation_next_frame(animation, &delay)) {
+                break;
+            }
+        }
+    }
+
+    /* Whatever happens, the last frame should be the one left on screen. */
+    if (skipped && !interrupted_by) {
+        success = show_frame(animation, &printer, &screen);
+    }
+
+    /* Show the cursor again. */
+    output_puts(&printer.output, "\033[?25h");
+    output_flush(&printer.output);
+    request->bytes_written = printer.output.bytes_written;
+    success = success && !printer.output.failed;
+
+    sigaction(SIGINT, &old_int, NULL);
+    sigaction(SIGTERM, &old_term, NULL);
+    screen_free(&screen);
+    printer_free(&printer);
+
+    /* Now that the terminal is tidy, die of the signal as intended. */
+    if (interrupted_by) {
+        raise(interrupted_by);
+    }
+    return success;
+}
+
+/**
+ * Renders the current frame, and prints the cells that changed since the
+ * last frame that was shown.
+ */
+static bool show_frame(struct Animation *animation, struct Printer *printer,
+                       struct Screen *screen) {
+    int64_t start = profile_now();
+    struct Image frame;
+    if (!animation_render(animation, &frame)) {
+        return false;
+    }
+
+    compute_cells(printer, &frame, screen);
+    unload_image(&frame);
+
+    output_puts(&printer->output, begin_synchronized_update);
+    print_changed_cells(printer, screen);
+    output_puts(&printer->output, end_synchronized_update);
+    output_flush(&printer->output);
+    profile_span("frame", start, NULL);
+    return true;
+}
+
+static bool screen_init(struct Screen *screen, int width, int lines) {
+    size_t cells = (size_t) width * lines;
+    *screen = (struct Screen) {
+        .width = width,
+        .lines = lines,
+        .shown_upper = malloc(cells * sizeof(Colour)),
+        .shown_lower = malloc(cells * sizeof(Colour)),
+        .upper = malloc(cells * sizeof(Colour)),
+        .lower = malloc(cells * sizeof(Colour)),
+        .shown_masks = malloc(cells * sizeof(uint8_t)),
+        .masks = malloc(cells * sizeof(uint8_t)),
+    };
+
+    if (screen->shown_upper == NULL || screen->shown_lower == NULL ||
+            screen->upper == NULL || screen->lower == NULL ||
+            screen->shown_masks == NULL || screen->masks == NULL) {
+        screen_free(screen);
+        return false;
+    }
+    return true;
+}
+
+static void screen_free(struct Screen *screen) {
+    free(screen->shown_upper);
+    free(screen->shown_lower);
+    free(screen->upper);
+    free(screen->lower);
+    free(screen->shown_masks);
+    free(screen->masks);
+    screen->shown_upper = screen->shown_lower = NULL;
+    screen->upper = screen->lower = NULL;
+    screen->shown_masks = screen->masks = NULL;
+}
+
+/**
+ * Quantizes the frame into the screen's upcoming cells.
+ */
+static void compute_cells(struct Printer *printer, const struct Image *frame,
+                          struct Screen *screen) {
+    const size_t stride = (size_t) frame->depth * frame->width;
+    const int rows_per_line = block_shapes[printer->blocks].rows;
+
+    for (int line = 0; line < screen->lines; line++) {
+        const uint8_t *row = frame->buffer + stride * rows_per_line * line;
+        size_t offset = (size_t) screen->width * line;
+
+        if (printer->blocks == B_QUADRANT || printer->blocks == B_SEXTANT) {
+            const uint8_t *rows[MAX_BLOCK_ROWS];
+            for (int r = 0; r < rows_per_line; r++) {
+                rows[r] = row + stride * r;
+            }
+            quantize_blocks(printer, rows, line, frame->width, screen->upper + offset,
+                            screen->lower + offset, screen->masks + offset);
+            continue;
+        }
+        quantize_row(printer, row, rows_per_line * line, screen->width,
+                     screen->upper + offset);
+        if (printer->blocks == B_HALF) {
+            quantize_row(printer, row + stride, 2 * line + 1, screen->width,
+                         screen->lower + offset);
+        }
+    }
+}
+
+/**
+ * The upcoming cells are now on the screen.
+ */
+static void screen_swap(struct Screen *screen) {
+    Colour *upper = screen->shown_upper, *lower = screen->shown_lower;
+    uint8_t *masks = screen->shown_masks;
+    screen->shown_upper = screen->upper;
+    screen->shown_lower = screen->lower;
+    screen->shown_masks = screen->masks;
+    screen->upper = upper;
+    screen->lower = lower;
+    screen->masks = masks;
+}
+
+/**
+ * Prints every line of the upcoming cells, exactly like a still image, which
+ * leaves the cursor at the start of the line below.
+ */
+static void print_whole_frame(struct Printer *printer, struct Screen *screen) {
+    for (int line = 0; line < screen->lines; line++) {
+        size_t offset = (size_t) screen->width * line;
+
+        print_cells(printer, screen->upper + offset, screen->lower + offset,
+                    screen->masks + offset, screen->width);
+        if (printer->blocks == B_FULL) {
+            output_puts(&printer->output, "\033[49m\n");
+        } else {
+            output_puts(&printer->output, "\033[39;49m\n");
+        }
+    }
+    screen_swap(screen);
+}
+
+/**
+ * Prints runs of cells that differ from what's on the screen, moving the
+ * cursor to each one. The cursor starts, and is left, at the start of the
+ * line below the image.
+ */
+static void print_changed_cells(struct Printer *printer, struct Screen *screen) {
+    const bool lower_shown = printer->blocks != B_FULL;
+    const bool masks_shown = printer->blocks == B_QUADRANT || printer->blocks == B_SEXTANT;
+    int cursor_line = screen->lines;
+
+    for (int line = 0; line < screen->lines; line++) {
+        size_t offset = (size_t) screen->width * line;
+        const Colour *upper = screen->upper + offset, *lower = screen->lower + offset;
+        const Colour *shown_upper = screen->shown_upper + offset;
+        const Colour *shown_lower = screen->shown_lower + offset;
+        const uint8_t *masks = screen->masks + offset, *shown_masks = screen->shown_masks + offset;
+
+#       define changed(x) (upper[x] != shown_upper[x] || \
+                          (lower_shown && lower[x] != shown_lower[x]) || \
+                          (masks_shown && masks[x] != shown_masks[x]))
+        for (int x = 0; x < screen->width; x++) {
+            if (!changed(x)) {
+                continue;
+            }
+            int end = x + 1;
+            while (end < screen->width && changed(end)) {
+                end++;
+            }
+
+            move_cursor(&printer->output, cursor_line, line, x);
+            cursor_line = line;
+            print_cells(printer, upper + x, lower + x, masks + x, end - x);
+            x = end;
+        }
+#       undef changed
+    }
+
+    if (cursor_line < screen->lines) {
+        output_puts(&printer->output, "\033[39;49m");
+        move_cursor(&printer->output, cursor_line, screen->lines, 0);
+    }
+    screen_swap(screen);
+}
+
+/**
+ * Moves the cursor from one line to another (up or down), and then to a
+ * column. Columns count from 0.
+ */
+static void move_cursor(struct Output *output, int from_line, int to_line, int column) {
+    char sequence[2 * sizeof("\033[2147483647A")];
+    char *end = sequence;
+
+    if (to_line < from_line) {
+        end += sprintf(end, "\033[%dA", from_line - to_line);
+    } else if (to_line > from_line) {
+        end += sprintf(end, "\033[%dB", to_line - from_line);
+    }
+    end += sprintf(end, "\033[%dG", column + 1);
+    output_write(output, sequence, end - sequence);
+}
+
+/**
+ * Prints the image as one sixel image, a pixel per pixel, encoding and
+ * printing it six rows at a time.
+ */
+static bool print_sixel(PrintRequest *request, struct Image *image) {
+    const int width = image->width;
+    struct Printer printer;
+    struct SixelEncoder encoder;
+
+    if (!printer_init(&printer, request, width)) {
+        return false;
+    }
+    uint8_t *band = malloc((size_t) SIXEL_BAND_HEIGHT * width * sizeof(uint8_t));
+    if (band == NULL || !sixel_encoder_init(&encoder, width)) {
+        free(band);
+        printer_free(&printer);
+        return false;
+    }
+
+    struct Output *output = &printer.output;
+    const uint8_t *rows[SIXEL_BAND_HEIGHT];
+    for (int r = 0; r < SIXEL_BAND_HEIGHT; r++) {
+        rows[r] = band + (size_t) r * width;
+    }
+
+    sixel_start(&encoder, image->height, output);
+    for (int y = 0; y < image->height; y += SIXEL_BAND_HEIGHT) {
+        int n_rows = image->height - y < SIXEL_BAND_HEIGHT ? image->height - y : SIXEL_BAND_HEIGHT;
+
+        int64_t start = profile_now();
+        for (int r = 0; r < n_rows; r++) {
+            const uint8_t *pixels = image->buffer + (size_t) image->depth * width * (y + r);
+            quantize_indices(&printer, pixels, y + r, width, band + (size_t) r * width);
+        }
+        profile_add(P_QUANTIZE, start);
+
+        start = profile_now();
+        sixel_band(&encoder, rows, n_rows, output);
+        profile_add(P_FORMAT, start);
+
+        if (output_should_flush(output)) {
+            output_flush(output);
+        }
+    }
+    sixel_finish(&encoder, output);
+
+    output_flush(output);
+    request->bytes_written = output->bytes_written;
+    bool success = !output->failed;
+
+    sixel_encoder_free(&encoder);
+    free(band);
+    printer_free(&printer);
+    return success;
+}
+
+/**
+ * Prints the image, a pixel per pixel, with the kitty graphics protocol.
+ */
+static bool print_kitty(PrintRequest *request, const struct Image *image) {
+    struct Output output;
+    request_output_init(&output, request);
+
+    int64_t start = profile_now();
+    bool success = kitty_print(image, request->kitty_medium, &output);
+    profile_add(P_FORMAT, start);
+
+    output_flush(&output);
+    request->bytes_written = output.bytes_written;
+    success = success && !output.failed;
+    output_free(&output);
+    return success;
+}
+
+/**
+ * How much a pixel in each format is worth to --max-bytes, out of four: a
+ * palette squeezes out detail that more pixels can't make up for.
+ */
+static int format_fidelity(Format format) {
+    switch (format) {
+        case F_TRUE_COLOR:
+        case F_SIXEL:
+            return 4;
+        case F_256_COLOR:
+            return 3;
+        default:
+            return 1;
+    }
+}
+
+static const char *blocks_name(Blocks blocks) {
+    switch (blocks) {
+        case B_HALF:
+            return "half-height, ";
+        case B_QUADRANT:
+            return "quadrants, ";
+        case B_SEXTANT:
+            return "sextants, ";
+        default:
+            return "";
+    }
+}
+
+static const char *format_name(Format format) {
+    switch (format) {
+        case F_TRUE_COLOR:
+            return "24-bit colour";
+        case F_256_COLOR:
+            return "256 colours";
+        case F_SIXEL:
+            return "sixel";
+        default:
+            return "8 colours";
+    }
+}
+
+/**
+ * Whether a is a better way to print the image than b: more pixels (allowing
+ * for their format), or else more pixels to a cell, which keeps the image's
+ * shape better, or else fewer bytes.
+ */
+static bool better_rendering(const struct Rendering *a, const struct Rendering *b) {
+    int64_t fidelity_a = (int64_t) a->width * a->height * format_fidelity(a->format);
+    int64_t fidelity_b = (int64_t) b->width * b->height * format_fidelity(b->format);
+    if (fidelity_a != fidelity_b) {
+        return fidelity_a > fidelity_b;
+    } else if (a->blocks != b->blocks) {
+        return a->blocks > b->blocks;
+    }
+    return a->estimate < b->estimate;
+}
+
+/**
+ * Decodes the image at the largest size allowed, then prints it (or a
+ * narrower copy) in the best format, size, and cells estimated to fit in
+ * request->max_bytes. If nothing fits, prints the smallest rendering tried.
+ *
+ * The image is rendered into memory first, so that if the estimate was too
+ * low, it can be rendered narrower instead of going over the budget; and if
+ * it was too high, wider, keeping the widest rendering that fit. If a retry
+ * can't be rendered, the best one so far is printed instead.
+ */
+static bool print_within_budget(PrintRequest *request) {
+    struct Image image;
+    struct Rendering chosen;
+
+    if (!decode_image(request, &image)) {
+        return false;
+    }
+    const int full_width = image.width, full_height = image.height;
+
+    int64_t start = profile_now();
+    if (!choose_rendering(request, &image, &chosen)) {
+        unload_image(&image);
+        return false;
+    }
+    profile_span("budget", start, request->filename);
+
+    /* The one being tried, and the best so far: the widest that fit, or if
+     * none has, the last (and narrowest) tried. */
+    struct Output rendered, kept;
+    output_init_memory(&rendered, NULL, 0);
+    output_init_memory(&kept, NULL, 0);
+    PrintRequest budgeted = *request;
+    budgeted.format = chosen.format;
+    budgeted.blocks = chosen.blocks;
+    budgeted.output = &rendered;
+    if (budgeted.emission == E_FULL) {
+        /* Only printing colours that change is never longer. */
+        budgeted.emission = E_DELTA;
+    }
+
+    /* As wide as choose_rendering() would have gone. */
+    const int widest = (int) ((int64_t) full_width * block_shapes[chosen.blocks].columns
+                              / block_shapes[request_blocks(request)].columns);
+    const struct Rendering estimated = chosen;
+    struct Rendering printed = chosen;
+    int too_wide = INT_MAX;
+    bool success = true, decoded = true, fits = false, any = false;
+    for (int retry = 0; ; retry++) {
+        output_clear(&rendered);
+        if (decoded && chosen.width == image.width && chosen.height == image.height) {
+            success = print_decoded_image(&budgeted, &image);
+        } else {
+            /* Resizing from the original looks better than shrinking it
+             * again. */
+            if (decoded) {
+                unload_image(&image);
+            }
+            success = decode_image_at(&budgeted, chosen.width, chosen.height, &image)
+                && print_decoded_image(&budgeted, &image);
+        }
+        decoded = false;
+        if (!success) {
+            break;
+        }
+
+        const size_t length = rendered.length;
+        if (length <= request->max_bytes || !fits) {
+            /* Keep it, and render the next try into the old one's memory. */
+            struct Output best = rendered;
+            rendered = kept;
+            kept = best;
+            printed = chosen;
+            fits = length <= request->max_bytes;
+            any = true;
+        }
+        if (length > request->max_bytes) {
+            too_wide = chosen.width;
+        }
+        if (retry == MAX_BUDGET_RETRIES) {
+            break;
+        }
+
+        if (fits) {
+            if (kept.length >= request->max_bytes - request->max_bytes / BUDGET_SLACK) {
+                break;
+            }
+            /* Well under: widen it by the square root, since the height grows
+             * with the width; or, if that's already too wide, halfway there. */
+            int width = (int) (printed.width * sqrt((double) request->max_bytes / kept.length));
+            if (width >= too_wide) {
+                width = printed.width + (too_wide - printed.width) / 2;
+            }
+            width = width < widest ? width : widest;
+            if (width <= printed.width) {
+                break;
+            }
+            chosen.width = width;
+        } else {
+            if (chosen.width == 1) {
+                break;
+            }
+            /* Over by a little: narrow it by as much. */
+            chosen.width = (int) ((uint64_t) chosen.width * request->max_bytes / length);
+            chosen.width = chosen.width > 0 ? chosen.width : 1;
+        }
+        chosen.height = scaled_height(full_width, full_height, request_blocks(request),
+                                      chosen.blocks, chosen.width);
+    }
+
+    success = any;
+    if (success) {
+        char choice[128];
+        int n = snprintf(choice, sizeof(choice), "%s, %s%dx%d", format_name(printed.format),
+                         blocks_name(printed.blocks), printed.width, printed.height);
+        if (printed.width != estimated.width && n > 0 && (size_t) n < sizeof(choice)) {
+            snprintf(choice + n, sizeof(choice) - n, " (estimated at %dx%d)",
+                     estimated.width, estimated.height);
+        }
+        profile_budget(choice, estimated.estimate, kept.length, request->max_bytes);
+
+        struct Output output;
+        request_output_init(&output, request);
+        output_write(&output, kept.data, kept.length);
+        output_flush(&output);
+        request->bytes_written = output.bytes_written;
+        success = !output.failed;
+        output_free(&output);
+    }
+    output_free(&kept);
+    output_free(&rendered);
+    return success;
+}
+
+/**
+ * For every format and blocks allowed, finds the widest image estimated to
+ * fit in the budget (by bisection, since the estimate grows with the width),
+ * and chooses the best of them. Full and half-height cells are always
+ * allowed; quadrants and sextants only if they were asked for, since not
+ * every font has them.
+ */
+static bool choose_rendering(const PrintRequest *request, const struct Image *image,
+                             struct Rendering *chosen) {
+    static const Format cell_formats[] = { F_TRUE_COLOR, F_256_COLOR, F_8_COLOR };
+    const Blocks most_blocks = request->format == F_SIXEL ? B_FULL
+        : request->blocks > B_HALF ? request->blocks : B_HALF;
+    const int columns = block_shapes[request_blocks(request)].columns;
+    bool found = false, fits = false;
+
+    for (int f = 0; f < 3; f++) {
+        Format format = request->format == F_SIXEL ? F_SIXEL : cell_formats[f];
+        if (format_fidelity(format) > format_fidelity(request->format)
+                || (request->format == F_SIXEL && f > 0)) {
+            continue;
+        }
+
+        for (Blocks blocks = B_FULL; blocks <= most_blocks; blocks++) {
+            struct Rendering candidate = { .format = format, .blocks = blocks };
+            /* No wider, in cells, than the image that was decoded. */
+            int low = 1, high = image->width * block_shapes[blocks].columns / columns;
+
+            /* The narrowest is the fallback, if nothing fits. */
+            candidate.width = low;
+            if (!estimate_size(request, image, &candidate)) {
+                return false;
+            }
+            if (candidate.estimate > request->max_bytes) {
+                if (!found || (!fits && candidate.estimate < chosen->estimate)) {
+                    *chosen = candidate;
+                    found = true;
+                }
+                continue;
+            }
+
+            /* Invariant: low fits, and everything wider than high doesn't. */
+            struct Rendering best = candidate;
+            while (low < high) {
+                candidate.width = low + (high - low + 1) / 2;
+                if (!estimate_size(request, image, &candidate)) {
+                    return false;
+                }
+                if (candidate.estimate <= request->max_bytes) {
+                    low = candidate.width;
+                    best = candidate;
+                } else {
+                    high = candidate.width - 1;
+                }
+            }
+
+            if (!fits || better_rendering(&best, chosen)) {
+                *chosen = best;
+                found = fits = true;
+            }
+        }
+    }
+    return found;
+}
+
+/**
+ * How many pixels high an image image_width × image_height of from's pixels
+ * is, printed width pixels wide in to's, keeping its shape.
+ */
+static int scaled_height(int image_width, int image_height, Blocks from, Blocks to, int width) {
+    int64_t height = (int64_t) width * image_height
+        * block_shapes[from].halves_across * block_shapes[to].halves_down
+        / ((int64_t) image_width * block_shapes[from].halves_down * block_shapes[to].halves_across);
+    return height > 0 ? (int) height : 1;
+}
+
+/**
+ * Samples row y of the image, as if resized to width pixels wide and height
+ * pixels high, into row. Each pixel is the average of (up to) a grid of
+ * MAX_SAMPLE_GRID × MAX_SAMPLE_GRID pixels spread over the area it covers,
+ * which is much cheaper than resizing, which averages the whole area. Smooth
+ * images come out about the same; fine detail comes out noisier, and so is
+ * overestimated, which print_within_budget() makes up for.
+ */
+static void sample_row(const struct Image *image, int width, int height, int y, uint8_t *row) {
+    const int depth = image->depth;
+    const int top = (int) ((int64_t) y * image->height / height);
+    const int bottom = (int) ((int64_t) (y + 1) * image->height / height);
+    const int rows = bottom - top < 1 ? 1 : bottom - top < MAX_SAMPLE_GRID ? bottom - top
+        : MAX_SAMPLE_GRID;
+
+    for (int x = 0; x < width; x++, row += depth) {
+        const int left = (int) ((int64_t) x * image->width / width);
+        const int right = (int) ((int64_t) (x + 1) * image->width / width);
+        const int columns = right - left < 1 ? 1 : right - left < MAX_SAMPLE_GRID ? right - left
+            : MAX_SAMPLE_GRID;
+        unsigned sum[4] = { 0, 0, 0, 0 };
+
+        for (int j = 0; j < rows; j++) {
+            int source_y = top + (2 * j + 1) * (bottom - top) / (2 * rows);
+            const uint8_t *source_row = image->buffer + (size_t) depth * image->width * source_y;
+            for (int i = 0; i < columns; i++) {
+                int source_x = left + (2 * i + 1) * (right - left) / (2 * columns);
+                for (int c = 0; c < depth; c++) {
+                    sum[c] += source_row[(size_t) depth * source_x + c];
+                }
+            }
+        }
+        for (int c = 0; c < depth; c++) {
+            row[c] = (sum[c] + rows * columns / 2) / (rows * columns);
+        }
+    }
+}
+
+/**
+ * Estimates how many bytes the rendering would print, by printing a sample
+ * of its lines with the real encoders (into memory), and scaling up by how
+ * many lines there are. Also fills in the rendering's height.
+ */
+static bool estimate_size(const PrintRequest *request, const struct Image *image,
+                          struct Rendering *rendering) {
+    const int width = rendering->width;
+    rendering->height = scaled_height(image->width, image->height, request_blocks(request),
+                                      rendering->blocks, width);
+
+    PrintRequest sample_request = *request;
+    sample_request.format = rendering->format;
+    sample_request.blocks = rendering->blocks;
+    if (sample_request.emission == E_FULL) {
+        sample_request.emission = E_DELTA;
+    }
+
+    struct Printer printer;
+    struct SixelEncoder encoder;
+    const bool sixel = rendering->format == F_SIXEL;
+    const int rows_per_line = sixel ? SIXEL_BAND_HEIGHT : block_shapes[rendering->blocks].rows;
+    const int lines = sixel ? (rendering->height + SIXEL_BAND_HEIGHT - 1) / SIXEL_BAND_HEIGHT
+        : rendering->height / rows_per_line;
+    const int samples = lines < SAMPLE_LINES ? lines : SAMPLE_LINES;
+
+    if (!printer_init(&printer, &sample_request, width)) {
+        return false;
+    }
+    output_init_memory(&printer.output, NULL, 0);
+    uint8_t *pixels = malloc((size_t) image->depth * width * MAX_BLOCK_ROWS);
+    uint8_t *band = malloc((size_t) SIXEL_BAND_HEIGHT * width);
+    if (pixels == NULL || band == NULL || (sixel && !sixel_encoder_init(&encoder, width))) {
+        free(pixels);
+        free(band);
+        printer_free(&printer);
+        return false;
+    }
+
+    size_t sampled = 0;
+    for (int i = 0; i < samples; i++) {
+        int line = (int) ((2 * (int64_t) i + 1) * lines / (2 * samples));
+        int first_row = line * rows_per_line;
+        output_clear(&printer.output);
+
+        if (sixel) {
+            const uint8_t *rows[SIXEL_BAND_HEIGHT];
+            int n_rows = rendering->height - first_row;
+            n_rows = n_rows < SIXEL_BAND_HEIGHT ? n_rows : SIXEL_BAND_HEIGHT;
+            for (int r = 0; r < n_rows; r++) {
+                sample_row(image, width, rendering->height, first_row + r, pixels);
+                quantize_indices(&printer, pixels, first_row + r, width, band + (size_t) r * width);
+                rows[r] = band + (size_t) r * width;
+            }
+            sixel_band(&encoder, rows, n_rows, &printer.output);
+        } else if (rendering->blocks == B_QUADRANT || rendering->blocks == B_SEXTANT) {
+            const uint8_t *rows[MAX_BLOCK_ROWS];
+            for (int r = 0; r < rows_per_line; r++) {
+                uint8_t *row = pixels + (size_t) image->depth * width * r;
+                sample_row(image, width, rendering->height, first_row + r, row);
+                rows[r] = row;
+            }
+            quantize_blocks(&printer, rows, line, width, printer.upper, printer.lower,
+                            printer.masks);
+            print_block_row(&printer, printer.upper, printer.lower, printer.masks,
+                            count_cells(width, rendering->blocks));
+            output_puts(&printer.output, "\033[39;49m\n");
+        } else if (rendering->blocks == B_HALF) {
+            sample_row(image, width, rendering->height, first_row, pixels);
+            quantize_row(&printer, pixels, first_row, width, printer.upper);
+            sample_row(image, width, rendering->height, first_row + 1, pixels);
+            quantize_row(&printer, pixels, first_row + 1, width, printer.lower);
+            print_half_height_row(&printer, printer.upper, printer.lower, width);
+            output_puts(&printer.output, "\033[39;49m\n");
+        } else {
+            sample_row(image, width, rendering->height, first_row, pixels);
+            quantize_row(&printer, pixels, first_row, width, printer.upper);
+            print_row(&printer, printer.upper, width);
+            output_puts(&printer.output, "\033[49m\n");
+        }
+        sampled += printer.output.length;
+    }
+
+    rendering->estimate = samples > 0 ? sampled * lines / samples : 0;
+    if (sixel) {
+        /* The start and end of the image. */
+        output_clear(&printer.output);
+        sixel_start(&encoder, rendering->height, &printer.output);
+        sixel_finish(&encoder, &printer.output);
+        rendering->estimate += printer.output.length;
+        sixel_encoder_free(&encoder);
+    }
+
+    bool success = !printer.output.failed;
+    free(pixels);
+    free(band);
+    printer_free(&printer);
+    return success;
+}
+
+/**
+ * Formats the image using request->jobs worker threads, while this thread
+ * writes the bands out in order. Since every line is formatted independently
+ * of the others, the output is exactly the same as print_lines() on the whole
+ * image.
+ *
+ * Returns false without printing anything if the image is too small to be
+ * worth it, if its lines depend on each other (as with error diffusion), or
+ * if the threads could not be set up; the caller should print the image by
+ * itself instead. Otherwise, returns true, and sets *success to whether
+ * every band made it out.
+ */
+static bool print_in_parallel(PrintRequest *request, const struct Image *image, bool *success) {
+    if (request->dither == D_DIFFUSION && request->format != F_TRUE_COLOR) {
+        return false;
+    }
+
+    struct BandQueue queue = {
+        .image = image,
+        .next_band = 0,
+        .next_to_write = 0,
+    };
+    struct BandWorker *workers = NULL;
+    int jobs = request->jobs, started = 0;
+    bool printed = false;
+
+    queue.lines = count_lines(image, request_blocks(request));
+    queue.lines_per_band = (queue.lines + jobs * BANDS_PER_JOB - 1) / (jobs * BANDS_PER_JOB);
+    if (queue.lines_per_band > MAX_BAND_LINES) {
+        queue.lines_per_band = MAX_BAND_LINES;
+    } else if (queue.lines_per_band < 1) {
+        queue.lines_per_band = 1;
+    }
+    queue.bands = (queue.lines + queue.lines_per_band - 1) / queue.lines_per_band;
+    if (queue.bands < 2) {
+        return false;
+    }
+    if (jobs > queue.bands) {
+        jobs = queue.bands;
+    }
+
+    queue.n_slots = jobs * SLOTS_PER_JOB;
+    queue.slots = calloc(queue.n_slots, sizeof(struct BandSlot));
+    workers = calloc(jobs, sizeof(struct BandWorker));
+    if (queue.slots == NULL || workers == NULL) {
+        goto out_free;
+    }
+    for (int i = 0; i < queue.n_slots; i++) {
+        request_output_init(&queue.slots[i].output, request);
+    }
+
+    /* Set up all the printers before starting any threads, so there's
+     * nothing to undo in a running thread. */
+    int ready = 0;
+    for (; ready < jobs; ready++) {
+        workers[ready].queue = &queue;
+        if (!printer_init(&workers[ready].printer, request, image->width)) {
+            break;
+        }
+        workers[ready].printer.flush_rows = false;
+    }
+    if (ready < jobs) {
+        goto out_free_printers;
+    }
+
+    pthread_mutex_init(&queue.lock, NULL);
+    pthread_cond_init(&queue.changed, NULL);
+
+    for (; started < jobs; started++) {
+        if (pthread_create(&workers[started].thread, NULL, band_worker, &workers[started]) != 0) {
+            break;
+        }
+    }
+
+    /* Any number of workers will get through the queue eventually; but
+     * with none, nothing has been printed and the caller can take over. */
+    if (started > 0) {
+        size_t bytes_written = 0;
+        bool failed = false;
+
+        for (int band = 0; band < queue.bands; band++) {
+            struct BandSlot *slot = &queue.slots[band % queue.n_slots];
+
+            pthread_mutex_lock(&queue.lock);
+            while (!slot->done) {
+                pthread_cond_wait(&queue.changed, &queue.lock);
+            }
+            pthread_mutex_unlock(&queue.lock);
+
+            /* No worker touches this slot until next_to_write moves on. */
+            size_t before = slot->output.bytes_written;
+            output_flush(&slot->output);
+            bytes_written += slot->output.bytes_written - before;
+            failed = failed || slot->output.failed;
+
+            pthread_mutex_lock(&queue.lock);
+            slot->done = false;
+            queue.next_to_write++;
+            pthread_cond_broadcast(&queue.changed);
+            pthread_mutex_unlock(&queue.lock);
+        }
+
+        request->bytes_written = bytes_written;
+        *success = !failed;
+        printed = true;
+    }
 
-enum {
-    /* PixelFuncs writes "parameter bytes" to a provided buffer that is
-     * **at most** this big.
-     * Parameter bytes are the bytes that go between the Command Sequence
-     * Initiator (CSI, a.k.a, "\033[") and the "m" at the end.
-     */
-    MAX_ESC_SEQUENCE_LEN = sizeof("38;2;000;000;000;48;2;000;000;000")
-};
+    for (int i = 0; i < started; i++) {
+        pthread_join(workers[i].thread, NULL);
+    }
+    pthread_cond_destroy(&queue.changed);
+    pthread_mutex_destroy(&queue.lock);
 
-enum layer {
-    BACKGROUND, FOREGROUND
-};
+out_free_printers:
+    for (int i = 0; i < ready; i++) {
+        printer_free(&workers[i].printer);
+    }
+out_free:
+    if (queue.slots != NULL) {
+        for (int i = 0; i < queue.n_slots; i++) {
+            output_free(&queue.slots[i].output);
+        }
+    }
+    free(queue.slots);
+    free(workers);
+    return printed;
+}
 
-typedef const unsigned char Pixel;
 /**
- * A pixel function takes in a pixel and places an escape sequence within a
- * buffer. It must return a pointer to characters allocated within the
- * provided buffer.
+ * Takes bands off the queue and formats them, until there are none left.
  */
-typedef const char* (*PixelFunc)(Pixel *pixel, char sequence[], enum layer);
+static void *band_worker(void *arg) {
+    struct BandWorker *worker = arg;
+    struct BandQueue *queue = worker->queue;
+    struct Printer *printer = &worker->printer;
 
-static bool iterm2_passthrough(PrintRequest *request);
-static bool print_base64(const char *filename);
-static bool print_iterate(PrintRequest *request);
-static void half_height_image_iterator(struct Image *image, PixelFunc printer);
-static void image_iterator(struct Image *image, PixelFunc printer);
-static void print_osc();
-static void print_st();
-static const char* printer_true_color(Pixel *pixel, char sequence[], enum layer);
-static const char* printer_256_color(Pixel *pixel, char sequence[], enum layer);
-static const char* printer_8_color(Pixel *pixel, char sequence[], enum layer);
-
-/* The 8 color table. It has 8 colors. */
-static const RGB_Tuple ansi_color_table[] = {
-    {{  0,   0,   0}}, {{ 128,   0,   0}},
-    {{  0, 128,   0}}, {{ 128, 128,   0}},
-    {{  0,   0, 128}}, {{ 128,   0, 128}},
-    {{  0, 128, 128}}, {{ 128, 128, 128}},
-};
+    profile_thread_name("format");
+    pthread_mutex_lock(&queue->lock);
+    while (1) {
+        /* Don't get too far ahead of the writer. */
+        while (queue->next_band < queue->bands &&
+                queue->next_band >= queue->next_to_write + queue->n_slots) {
+            pthread_cond_wait(&queue->changed, &queue->lock);
+        }
+        if (queue->next_band >= queue->bands) {
+            break;
+        }
 
+        int band = queue->next_band++;
+        pthread_mutex_unlock(&queue->lock);
 
-bool print_image(PrintRequest *request) {
-    if (request->format == F_ITERM2) {
-        return iterm2_passthrough(request);
-    } else {
-        /* Delegate to the "pixel iterator" approach. */
-        return print_iterate(request);
-    }
-}
+        int64_t start = profile_now();
+        int first = band * queue->lines_per_band;
+        int last = first + queue->lines_per_band;
+        if (last > queue->lines) {
+            last = queue->lines;
+        }
+        print_lines(queue->image, printer, first, last);
+        profile_span("band", start, NULL);
 
+        pthread_mutex_lock(&queue->lock);
+        /* Trade the formatted band for the slot's empty buffer. */
+        struct BandSlot *slot = &queue->slots[band % queue->n_slots];
+        struct Output formatted = printer->output;
+        printer->output = slot->output;
+        slot->output = formatted;
+        slot->done = true;
+        pthread_cond_broadcast(&queue->changed);
+    }
+    pthread_mutex_unlock(&queue->lock);
 
-static bool print_iterate(PrintRequest *request) {
-    struct Image image;
-    const char *filename = request->filename;
-    Format format = request->format;
-    struct LoadOpts options = {
-        .max_width = request->max_width,
-        .max_height = request->max_height,
-        .desired_width = request->desired_width,
-        .desired_height = request->desired_height,
-        .preserve_aspect_ratio = request->preserve_aspect_ratio,
-    };
-    assert(format != F_UNSET);
+    return NULL;
+}
 
-    /* Load the image, and potentially rescale it. */
-    bool success = load_image(filename, &image, &options);
+/**
+ * Anything already in stdio's buffer must go out before we write(2) to
+ * the same file.
+ */
+static void flush_stdio(const PrintRequest *request) {
+    if (request->output == NULL) {
+        fflush(stdout);
+    }
+}
 
-    /* Could not load image. */
-    if (!success) {
-        return false;
+/**
+ * Initializes output to go wherever the request says.
+ */
+static void request_output_init(struct Output *output, const PrintRequest *request) {
+    if (request->output != NULL) {
+        output_init_sink(output, request->output);
+    } else {
+        output_init(output, request->output_fd);
     }
+}
 
-    PixelFunc printer = NULL;
+/**
+ * Chooses the colour function for the format, and allocates scratch rows.
+ * Returns false if memory could not be allocated.
+ */
+static bool printer_init(struct Printer *printer, PrintRequest *request, int width) {
+    const Blocks blocks = request_blocks(request);
+    const int cells = count_cells(width, blocks);
+    *printer = (struct Printer) {
+        .format = request->format,
+        .quantizer = request->quantizer,
+        .emission = request->emission,
+        .blocks = blocks,
+        .flush_rows = true,
+        .indices = malloc(cells * sizeof(uint8_t)),
+        .upper = malloc(cells * sizeof(Colour)),
+        .lower = malloc(cells * sizeof(Colour)),
+        .masks = malloc(cells * sizeof(uint8_t)),
+        .foreground = malloc(cells * 4 * sizeof(uint8_t)),
+        .background = malloc(cells * 4 * sizeof(uint8_t)),
+        .ditherer = { .dither = D_NONE, .error = NULL },
+    };
+    request_output_init(&printer->output, request);
 
-    /* That resized buffer? Yeah. Print it. */
-    switch (format) {
+    pthread_once(&escape_tables_once, build_escape_tables);
+    printer->escapes = request->compact_escapes ? &compact_escapes : &padded_escapes;
+
+    switch (printer->format) {
         case F_TRUE_COLOR:
-            printer = printer_true_color;
+            printer->print = printer_true_color;
             break;
         case F_256_COLOR:
-            printer = printer_256_color;
+            printer->print = printer_256_color;
             break;
         case F_8_COLOR:
-            printer = printer_8_color;
+            printer->print = printer_8_color;
+            break;
+        case F_SIXEL:
+            /* Pixels are encoded by print_sixel(), not printed as cells. */
+            printer->print = NULL;
             break;
         default:
             assert(0 && "Not a valid format.");
     }
 
-    /* Print the image with the given pixel func. */
-    if (request->half_height) {
-        half_height_image_iterator(&image, printer);
-    } else {
-        image_iterator(&image, printer);
+    bool palette = printer->format != F_TRUE_COLOR;
+    if (palette && request->dither != D_NONE
+            && !ditherer_init(&printer->ditherer, request->dither, request->quantizer,
+                              printer->format == F_8_COLOR ? 8 : 256, cells)) {
+        printer_free(printer);
+        return false;
     }
 
-    unload_image(&image);
+    if (printer->indices == NULL || printer->upper == NULL || printer->lower == NULL ||
+            printer->masks == NULL || printer->foreground == NULL || printer->background == NULL) {
+        printer_free(printer);
+        return false;
+    }
     return true;
 }
 
+static void printer_free(struct Printer *printer) {
+    free(printer->indices);
+    free(printer->upper);
+    free(printer->lower);
+    free(printer->masks);
+    free(printer->foreground);
+    free(printer->background);
+    printer->indices = NULL;
+    printer->upper = printer->lower = NULL;
+    printer->masks = printer->foreground = printer->background = NULL;
+    ditherer_free(&printer->ditherer);
+    output_free(&printer->output);
+}
+
+/**
+ * Matches a whole row of pixels to palette indices at once, so that palette
+ * matching can run as one tight (and where possible, vectorized) loop. y is
+ * the row's place in the image, which dithering needs to know.
+ */
+static void quantize_indices(struct Printer *printer, const uint8_t *pixels, int y, int width,
+                             uint8_t *indices) {
+    switch (printer->format) {
+        case F_256_COLOR:
+        case F_SIXEL:
+            if (printer->ditherer.dither != D_NONE) {
+                dither_row(&printer->ditherer, pixels, y, indices);
+            } else {
+                quantize_row_256(printer->quantizer, pixels, width, indices);
+            }
+            break;
+        case F_8_COLOR:
+            if (printer->ditherer.dither != D_NONE) {
+                dither_row(&printer->ditherer, pixels, y, indices);
+            } else if (printer->quantizer == Q_PERCEPTUAL) {
+                quantize_row_8_perceptual(pixels, width, indices);
+            } else {
+                quantize_row_8(pixels, width, indices);
+            }
+            break;
+        default:
+            assert(0 && "Not a palette format.");
+    }
+}
+
+/**
+ * Converts a whole row of pixels into colours at once.
+ */
+static void quantize_row(struct Printer *printer, const uint8_t *pixels, int y, int width,
+                         Colour *colours) {
+    int64_t start = profile_now();
+
+    if (printer->format == F_TRUE_COLOR) {
+        for (int x = 0; x < width; x++, pixels += 4) {
+            colours[x] = (Colour) pixels[0] << 16 | (Colour) pixels[1] << 8 | pixels[2];
+        }
+        profile_add(P_QUANTIZE, start);
+        return;
+    }
+
+    quantize_indices(printer, pixels, y, width, printer->indices);
+    for (int x = 0; x < width; x++) {
+        colours[x] = printer->indices[x];
+    }
+    profile_add(P_QUANTIZE, start);
+}
+
 /**
  * Pass-through to iTerm2's inline image feature.
  *
@@ -137,213 +1588,683 @@ static bool print_iterate(PrintRequest *request) {
  * https://raw.githubusercontent.com/gnachman/iTerm2/master/tests/imgcat
  */
 static bool iterm2_passthrough(PrintRequest *request) {
-    print_osc();
-    printf("1337;File=inline=1");
+    char argument[sizeof(";height=2147483647")];
+    struct Output output;
+
+    /* Make sure the image exists before committing to the escape sequence. */
+    int fd = -1;
+    if (request->data == NULL) {
+        fd = open(request->filename, O_RDONLY);
+        if (fd == -1) {
+            return false;
+        }
+    }
+
+    flush_stdio(request);
+    request_output_init(&output, request);
+
+    print_osc(&output);
+    output_puts(&output, "1337;File=inline=1");
 
     assert(request->desired_width == WIDTH_UNSET || request->desired_width > 0);
     assert(request->desired_height == HEIGHT_UNSET || request->desired_height > 0);
     if (request->desired_width != WIDTH_UNSET) {
-        printf(";width=%d", request->desired_width);
+        snprintf(argument, sizeof(argument), ";width=%d", request->desired_width);
+        output_puts(&output, argument);
     }
     if (request->desired_height != HEIGHT_UNSET) {
-        printf(";height=%d", request->desired_height);
+        snprintf(argument, sizeof(argument), ";height=%d", request->desired_height);
+        output_puts(&output, argument);
     }
 
-    printf(":");
-    print_base64(request->filename);
+    output_puts(&output, ":");
+    bool success;
+    if (request->data != NULL) {
+        success = print_base64_buffer(&output, request->data, request->data_length);
+    } else {
+        success = print_base64(&output, fd);
+        close(fd);
+    }
 
-    print_st();
-    return true;
+    print_st(&output);
+    output_flush(&output);
+    request->bytes_written = output.bytes_written;
+    success = success && !output.failed;
+    output_free(&output);
+
+    return success;
+}
+
+/**
+ * How many lines of text the image is printed as.
+ */
+static int count_lines(const struct Image *image, Blocks blocks) {
+    /* Rows left over at the bottom, too few for a line, are dropped. */
+    return image->height / block_shapes[blocks].rows;
+}
+
+/**
+ * How many character cells wide an image width pixels wide is printed. A
+ * column left over at the right gets cells of its own.
+ */
+static int count_cells(int width, Blocks blocks) {
+    const int columns = block_shapes[blocks].columns;
+    return (width + columns - 1) / columns;
+}
+
+/**
+ * The blocks the request's image is printed in: sixel and kitty images are
+ * a pixel per pixel.
+ */
+static Blocks request_blocks(const PrintRequest *request) {
+    return request->format == F_SIXEL || request->format == F_KITTY ? B_FULL : request->blocks;
+}
+
+/**
+ * Prints lines [first, last) of the image.
+ */
+static void print_lines(const struct Image *image, struct Printer *printer,
+                        int first, int last) {
+    switch (printer->blocks) {
+        case B_HALF:
+            half_height_image_iterator(image, printer, first, last);
+            break;
+        case B_QUADRANT:
+        case B_SEXTANT:
+            block_image_iterator(image, printer, first, last);
+            break;
+        default:
+            image_iterator(image, printer, first, last);
+    }
 }
 
 /**
  * Iterates through the image, x, then y,
  */
-static void image_iterator(struct Image *image, PixelFunc printer) {
-    char sequence[MAX_ESC_SEQUENCE_LEN];
-    const int width = image->width, height = image->height;
+static void image_iterator(const struct Image *image, struct Printer *printer,
+                           int first, int last) {
+    const int width = image->width;
     const int color_depth = image->depth;
-    unsigned char *pixels = image->buffer;
+    const unsigned char *pixels = image->buffer;
+    Colour *colours = printer->upper;
+    struct Output *output = &printer->output;
 
-    for (int y = 0; y < height; y++) {
-        /* Print each pixel. */
-        for (int x = 0; x < width; x++) {
-            /* Get the position of the first channel of the pixel. */
-            uint8_t *pixel = pixels + color_depth * (x + width * y);
-            /* Delegate to the provided printer. */
-            const char* parameter_bytes = printer(pixel, sequence, BACKGROUND);
+    for (int y = first; y < last; y++) {
+        quantize_row(printer, pixels + (size_t) color_depth * width * y, y, width, colours);
+        print_row(printer, colours, width);
 
-            assert(parameter_bytes >= sequence);
-            assert(parameter_bytes < sequence + MAX_ESC_SEQUENCE_LEN);
-            printf("\033[%sm ", parameter_bytes);
-        }
         /* Finish the line. */
         /* TODO: this can go at the very end. */
-        printf("\033[49m\n");
+        output_puts(output, "\033[49m\n");
+
+        if (printer->flush_rows && output_should_flush(output)) {
+            output_flush(output);
+        }
     }
 }
 
 /**
  * Iterates through the image, two rows at a time, two pixels per cell.
  */
-static void half_height_image_iterator(struct Image *image, PixelFunc printer) {
-    char upper_half[MAX_ESC_SEQUENCE_LEN], lower_half[MAX_ESC_SEQUENCE_LEN];
-    const int width = image->width, height = image->height;
+static void half_height_image_iterator(const struct Image *image, struct Printer *printer,
+                                       int first, int last) {
+    const int width = image->width;
     const int color_depth = image->depth;
-    unsigned char *pixels = image->buffer;
+    const unsigned char *pixels = image->buffer;
+    Colour *top = printer->upper, *bottom = printer->lower;
+    struct Output *output = &printer->output;
 
     /* Increment two lines at a time. Focus on the BOTTOM of the two lines
      * (because if the bottom line is valid, then we know there must be a line
      * above it. */
-    for (int y = 1; y < height; y += 2) {
-        /* Print each pixel. */
-        for (int x = 0; x < width; x++) {
-            /* Get the position of the first channel of the pixel. */
-            uint8_t *top_pixel = pixels + color_depth * (x + width * (y - 1));
-            uint8_t *bottom_pixel = pixels + color_depth * (x + width * y);
+    for (int y = 2 * first + 1; y < 2 * last; y += 2) {
+        quantize_row(printer, pixels + (size_t) color_depth * width * (y - 1), y - 1, width, top);
+        quantize_row(printer, pixels + (size_t) color_depth * width * y, y, width, bottom);
+        print_half_height_row(printer, top, bottom, width);
 
-            printf("\033[%s;%sm▀",
-                    printer(top_pixel, upper_half, FOREGROUND),
-                    printer(bottom_pixel, lower_half, BACKGROUND));
-        }
         /* Finish the line by reseting the background and foreground colors.
          * If you don't reset the background color, the color "spills" to the
          * end of the line. */
-        printf("\033[39;49m\n");
+        output_puts(output, "\033[39;49m\n");
+
+        if (printer->flush_rows && output_should_flush(output)) {
+            output_flush(output);
+        }
     }
 }
 
 /**
- * Convert the pixel values to an escape sequence directly
+ * Iterates through the image, two or three rows at a time, four or six
+ * pixels per cell.
  */
-static const char* printer_true_color(Pixel *pixel, char sequence[], enum layer layer) {
-    char category = layer == FOREGROUND ? '3' : '4';
-    snprintf(sequence, MAX_ESC_SEQUENCE_LEN,
-            "%c8;2;%03d;%03d;%03d", category, pixel[0], pixel[1], pixel[2]);
-    return sequence;
+static void block_image_iterator(const struct Image *image, struct Printer *printer,
+                                 int first, int last) {
+    const size_t stride = (size_t) image->depth * image->width;
+    const int rows_per_line = block_shapes[printer->blocks].rows;
+    const int cells = count_cells(image->width, printer->blocks);
+    struct Output *output = &printer->output;
+
+    for (int line = first; line < last; line++) {
+        const uint8_t *rows[MAX_BLOCK_ROWS];
+        for (int r = 0; r < rows_per_line; r++) {
+            rows[r] = image->buffer + stride * (rows_per_line * line + r);
+        }
+        quantize_blocks(printer, rows, line, image->width, printer->upper, printer->lower,
+                        printer->masks);
+        print_block_row(printer, printer->upper, printer->lower, printer->masks, cells);
+        output_puts(output, "\033[39;49m\n");
+
+        if (printer->flush_rows && output_should_flush(output)) {
+            output_flush(output);
+        }
+    }
 }
 
 /**
- * Gets a colour match from the global RGB tree.
+ * Fits two colours to each cell of n_rows (2 or 3) rows of pixels, width
+ * pixels wide: the cell's pixels are split halfway along the channel that
+ * varies the most, and each side gets the average of its pixels. The
+ * foreground side (the one with the brighter channel, which always has at
+ * least one pixel) goes in foreground and masks, and the background side in
+ * background; if there is none, it's the same as the foreground.
+ *
+ * Apart from skipping cells of one colour, there are no branches on the
+ * pixels themselves, so that it runs nearly as fast as quantizing the pixels
+ * for half-height cells would.
  */
-static const char* printer_256_color(Pixel *pixel, char sequence[], enum layer layer) {
-    const RGB_Node *match = rgb_closest_colour(pixel[0], pixel[1], pixel[2]);
-    int closest_code = match->id;
-    char category = layer == FOREGROUND ? '3' : '4';
-    snprintf(sequence, MAX_ESC_SEQUENCE_LEN,
-            "%c8;5;%03d", category, closest_code);
-    return sequence;
+static inline void fit_cells(const uint8_t *const rows[], const int n_rows, int width,
+                             uint8_t *foreground, uint8_t *background, uint8_t *masks) {
+    const int cells = (width + 1) / 2;
+    const int n = 2 * n_rows;
+
+    for (int cell = 0; cell < cells; cell++) {
+        /* A column left over at the right is repeated. */
+        const int left = 4 * (2 * cell);
+        const int right = 2 * cell + 1 < width ? left + 4 : left;
+        const uint8_t *pixels[2 * MAX_BLOCK_ROWS];
+        for (int r = 0; r < n_rows; r++) {
+            pixels[2 * r] = rows[r] + left;
+            pixels[2 * r + 1] = rows[r] + right;
+        }
+
+        /* Flat areas are common, and have nothing to split. */
+        uint32_t first, differences = 0;
+        memcpy(&first, pixels[0], sizeof(first));
+        for (int i = 1; i < n; i++) {
+            uint32_t pixel;
+            memcpy(&pixel, pixels[i], sizeof(pixel));
+            differences |= pixel ^ first;
+        }
+        if (differences == 0) {
+            memcpy(foreground + 4 * cell, &first, sizeof(first));
+            memcpy(background + 4 * cell, &first, sizeof(first));
+            masks[cell] = 0;
+            continue;
+        }
+
+        int low[3] = { 255, 255, 255 }, high[3] = { 0, 0, 0 };
+        for (int i = 0; i < n; i++) {
+            for (int c = 0; c < 3; c++) {
+                int value = pixels[i][c];
+                low[c] = value < low[c] ? value : low[c];
+                high[c] = value > high[c] ? value : high[c];
+            }
+        }
+        int channel = high[1] - low[1] > high[0] - low[0] ? 1 : 0;
+        channel = high[2] - low[2] > high[channel] - low[channel] ? 2 : channel;
+        const int threshold = (low[channel] + high[channel] + 1) / 2;
+
+        unsigned mask = 0, in_foreground = 0;
+        unsigned sum[4] = { 0, 0, 0, 0 }, total[4] = { 0, 0, 0, 0 };
+        for (int i = 0; i < n; i++) {
+            unsigned in = pixels[i][channel] >= threshold;
+            mask |= in << i;
+            in_foreground += in;
+            for (int c = 0; c < 4; c++) {
+                sum[c] += in * pixels[i][c];
+                total[c] += pixels[i][c];
+            }
+        }
+
+        /* With no pixels in the background, it's the same as the
+         * foreground. */
+        const bool empty = in_foreground == (unsigned) n;
+        const unsigned in_background = empty ? in_foreground : n - in_foreground;
+        for (int c = 0; c < 4; c++) {
+            unsigned rest = empty ? sum[c] : total[c] - sum[c];
+            foreground[4 * cell + c] = ((sum[c] + in_foreground / 2) * reciprocals[in_foreground]) >> 16;
+            background[4 * cell + c] = ((rest + in_background / 2) * reciprocals[in_background]) >> 16;
+        }
+        masks[cell] = mask;
+    }
+}
+
+static void fit_blocks(const uint8_t *const rows[], int n_rows, int width,
+                       uint8_t *foreground, uint8_t *background, uint8_t *masks) {
+    /* Each with the number of rows known, so its loops can be unrolled. */
+    if (n_rows == 2) {
+        fit_cells(rows, 2, width, foreground, background, masks);
+    } else {
+        fit_cells(rows, 3, width, foreground, background, masks);
+    }
 }
 
-/* Gets a color from the list. Will take same number of steps as the tree
- * version. */
-static const char* printer_8_color(Pixel *pixel, char sequence[], enum layer layer) {
-    RGB_Tuple target = {{pixel[0], pixel[1], pixel[2]}};
-    int i, best_index = 0;
-    unsigned int distance, closest;
-    closest = rgb_colour_distance(&ansi_color_table[0], &target);
+/**
+ * Fits two colours to each cell of a line of quadrant or sextant cells, and
+ * quantizes them. Cells are then put in a normal form, so that cells that
+ * look the same are the same: a cell with just one colour shows it as the
+ * background, with a mask of 0, and the same colour as the foreground.
+ */
+static void quantize_blocks(struct Printer *printer, const uint8_t *const rows[], int line,
+                            int width, Colour *foreground, Colour *background, uint8_t *masks) {
+    const int cells = count_cells(width, printer->blocks);
+    const unsigned all = (1u << (2 * block_shapes[printer->blocks].rows)) - 1;
+
+    int64_t start = profile_now();
+    fit_blocks(rows, block_shapes[printer->blocks].rows, width, printer->foreground,
+               printer->background, masks);
+    profile_add(P_QUANTIZE, start);
+
+    /* Like half-height cells, the two colours are dithered as two rows. */
+    quantize_row(printer, printer->foreground, 2 * line, cells, foreground);
+    quantize_row(printer, printer->background, 2 * line + 1, cells, background);
 
-    for (i = 1; i < 8; i++) {
-        distance = rgb_colour_distance(&ansi_color_table[i], &target);
-        if (distance < closest) {
-            closest = distance;
-            best_index = i;
+    for (int x = 0; x < cells; x++) {
+        if (masks[x] == all) {
+            background[x] = foreground[x];
+        }
+        if (masks[x] == all || foreground[x] == background[x]) {
+            masks[x] = 0;
+            foreground[x] = background[x];
         }
     }
+}
 
-    /* It turns out that the 8 color array has the SAME indices as its
-     * corresponding ANSI escape sequence. */
-    int ansi_code = (layer == FOREGROUND ? 30 : 40) + best_index;
-    snprintf(sequence, MAX_ESC_SEQUENCE_LEN, "%2d", ansi_code);
-    return sequence;
+/**
+ * Appends a whole snippet to dest, and returns the end of the meaningful part.
+ */
+static inline char *append_snippet(char *dest, const Snippet *snippet) {
+    memcpy(dest, snippet->bytes, sizeof(snippet->bytes));
+    return dest + snippet->length;
 }
 
-static void print_base64_char(uint8_t c) {
-    static const char b64_encode_table[] =
-        "ABCDEFGHIJKLMNOPQRSTUVWXYZ"
-        "abcdefghijklmnopqrstuvwxyz"
-        "0123456789+/";
-    uint8_t index = c & 0b00111111;
-    putchar(b64_encode_table[index]);
+static inline char *append_string(char *dest, const char *string, size_t length) {
+    memcpy(dest, string, length);
+    return dest + length;
 }
 
 /**
- * Open the file and prints its contents in "canonical" base64.
- * See Table 1 in RFC4648: https://tools.ietf.org/html/rfc4648#page-6
+ * Prints one row of full-height cells.
+ *
+ * Cells are printed in runs of the same colour. Normally, runs are always one
+ * cell long, so every cell gets its own escape sequence. With compression,
+ * the escape sequence is only printed at the start of each run.
  */
-static bool print_base64(const char *filename) {
-    FILE *file = fopen(filename, "rb");
+static void print_row(struct Printer *printer, const Colour *colours, int width) {
+    char cell[MAX_CELL_LEN];
+    struct Output *output = &printer->output;
+    const bool compress = printer->emission != E_FULL;
+    int64_t start = profile_now();
 
-    if (file == NULL) {
-        return false;
+    for (int x = 0; x < width; ) {
+        int run = 1;
+        while (compress && x + run < width && colours[x + run] == colours[x]) {
+            run++;
+        }
+
+        char *end = append_string(cell, "\033[", 2);
+        /* Delegate to the provided printer. */
+        end = printer->print(printer->escapes, colours[x], BACKGROUND, end);
+        end = append_string(end, "m ", 2);
+
+        assert(end <= cell + MAX_CELL_LEN - sizeof(Snippet));
+        output_write(output, cell, end - cell);
+        print_repeats(printer, " ", run - 1);
+
+        x += run;
     }
-    int c;
-    uint8_t leftover_bits = 0;
 
-    enum { byte_0, byte_1, byte_2, max_states } state = byte_0;
+    profile_add(P_FORMAT, start);
+    profile_count(P_CELLS, width);
+}
 
-    /* Convert each character into base64. */
-    while ((c = fgetc(file)) != EOF) {
-        uint8_t lower, upper;
-        switch (state) {
-            case byte_0:
-                print_base64_char(c >> 2);
-                break;
-            case byte_1:
-                lower = (leftover_bits & 0b11) << 4;
-                upper = (c & 0b11110000) >> 4;
-                print_base64_char(upper | lower);
-                break;
-            case byte_2:
-                upper = (leftover_bits & 0b00001111) << 2;
-                lower = (c & 0b11000000) >> 6;
-                print_base64_char(upper | lower);
-                print_base64_char(c & 0b00111111);
-                break;
-            default:
-                assert(false);
+/**
+ * Prints one row of half-height cells: the top pixel is the foreground
+ * colour of the ▀, and the bottom pixel is the background colour.
+ *
+ * Like print_row(), but with compression, only the layer(s) that actually
+ * changed since the previous run are printed.
+ */
+static void print_half_height_row(struct Printer *printer,
+                                  const Colour *top, const Colour *bottom,
+                                  int width) {
+    char cell[MAX_CELL_LEN];
+    struct Output *output = &printer->output;
+    const struct EscapeTable *escapes = printer->escapes;
+    const bool compress = printer->emission != E_FULL;
+    int64_t start = profile_now();
+
+    for (int x = 0; x < width; ) {
+        int run = 1;
+        while (compress && x + run < width &&
+                top[x + run] == top[x] && bottom[x + run] == bottom[x]) {
+            run++;
+        }
+
+        /* At the start of the row, the terminal's colours are unknown. */
+        bool new_foreground = !compress || x == 0 || top[x] != top[x - 1];
+        bool new_background = !compress || x == 0 || bottom[x] != bottom[x - 1];
+
+        char *end = append_string(cell, "\033[", 2);
+        if (new_foreground) {
+            end = printer->print(escapes, top[x], FOREGROUND, end);
+        }
+        if (new_foreground && new_background) {
+            *end++ = ';';
+        }
+        if (new_background) {
+            end = printer->print(escapes, bottom[x], BACKGROUND, end);
         }
-        /* Save the leftover bits. */
-        leftover_bits = c;
-        /* Move to the next state. */
-        state = (state + 1) % max_states;
+        *end++ = 'm';
+        end = append_string(end, upper_half_block, sizeof(upper_half_block) - 1);
+
+        assert(end <= cell + MAX_CELL_LEN - sizeof(Snippet));
+        output_write(output, cell, end - cell);
+        print_repeats(printer, upper_half_block, run - 1);
+
+        x += run;
     }
 
-    /* Pad the end, if needed. */
-    uint8_t upper = 0;
-    switch (state) {
-        case byte_0:
-            /* No padding necessary: last character ended on byte boundary. */
-            break;
-        case byte_1:
-            upper = (c & 0b11110000) >> 4;
-            print_base64_char(upper);
-            printf("==");  /* padding */
+    profile_add(P_FORMAT, start);
+    profile_count(P_CELLS, width);
+}
+
+/**
+ * Prints one row of quadrant or sextant cells: the glyph for each cell's
+ * mask, in its foreground and background colours.
+ *
+ * Like print_half_height_row(), but a cell's glyph can always be swapped for
+ * its inverse, with the colours swapped too; with compression, whichever way
+ * round needs fewer colours printed is used. Only the layers the glyph
+ * actually shows need to be right.
+ */
+static void print_block_row(struct Printer *printer,
+                            const Colour *foreground, const Colour *background,
+                            const uint8_t *masks, int width) {
+    char cell[MAX_CELL_LEN];
+    struct Output *output = &printer->output;
+    const struct EscapeTable *escapes = printer->escapes;
+    const bool compress = printer->emission != E_FULL;
+    const bool sextants = printer->blocks == B_SEXTANT;
+    const char *const *glyphs = sextants ? sextant_glyphs : quadrant_glyphs;
+    const unsigned all = sextants ? 0x3F : 0xF;
+    /* The terminal's colours; at the start of the row, they're unknown. */
+    Colour shown_foreground = 0, shown_background = 0;
+    bool foreground_known = false, background_known = false;
+    int64_t start = profile_now();
+
+    for (int x = 0; x < width; ) {
+        int run = 1;
+        while (compress && x + run < width && masks[x + run] == masks[x] &&
+                foreground[x + run] == foreground[x] && background[x + run] == background[x]) {
+            run++;
+        }
+
+        Colour top = foreground[x], bottom = background[x];
+        unsigned mask = masks[x];
+#       define needs_foreground(mask, colour) \
+            ((mask) != 0 && (!foreground_known || (colour) != shown_foreground))
+#       define needs_background(mask, colour) \
+            ((mask) != all && (!background_known || (colour) != shown_background))
+        if (compress) {
+            int as_is = needs_foreground(mask, top) + needs_background(mask, bottom);
+            int inverse = needs_foreground(all ^ mask, bottom) + needs_background(all ^ mask, top);
+            if (inverse < as_is) {
+                top = background[x];
+                bottom = foreground[x];
+                mask ^= all;
+            }
+        }
+        bool new_foreground = !compress || needs_foreground(mask, top);
+        bool new_background = !compress || needs_background(mask, bottom);
+#       undef needs_foreground
+#       undef needs_background
+
+        char *end = cell;
+        if (new_foreground || new_background) {
+            end = append_string(end, "\033[", 2);
+            if (new_foreground) {
+                end = printer->print(escapes, top, FOREGROUND, end);
+                shown_foreground = top;
+                foreground_known = true;
+            }
+            if (new_foreground && new_background) {
+                *end++ = ';';
+            }
+            if (new_background) {
+                end = printer->print(escapes, bottom, BACKGROUND, end);
+                shown_background = bottom;
+                background_known = true;
+            }
+            *end++ = 'm';
+        }
+        end = append_string(end, glyphs[mask], strlen(glyphs[mask]));
+
+        assert(end <= cell + MAX_CELL_LEN - sizeof(Snippet));
+        output_write(output, cell, end - cell);
+        print_repeats(printer, glyphs[mask], run - 1);
+
+        x += run;
+    }
+
+    profile_add(P_FORMAT, start);
+    profile_count(P_CELLS, width);
+}
+
+/**
+ * Prints a row of whichever cells the printer prints.
+ */
+static void print_cells(struct Printer *printer, const Colour *upper, const Colour *lower,
+                        const uint8_t *masks, int width) {
+    switch (printer->blocks) {
+        case B_HALF:
+            print_half_height_row(printer, upper, lower, width);
             break;
-        case byte_2:
-            upper = (leftover_bits & 0b00001111) << 2;
-            print_base64_char(upper);
-            printf("=");  /* padding */
+        case B_QUADRANT:
+        case B_SEXTANT:
+            print_block_row(printer, upper, lower, masks, width);
             break;
         default:
-            assert(false);
+            print_row(printer, upper, width);
+    }
+}
+
+/**
+ * Prints the glyph that was just printed count more times. Uses REP
+ * (CSI n b) instead, if it's allowed and would actually be shorter.
+ */
+static void print_repeats(struct Printer *printer, const char *glyph, int count) {
+    struct Output *output = &printer->output;
+    const size_t glyph_length = strlen(glyph);
+
+    if (count <= 0) {
+        return;
+    }
+
+    if (printer->emission == E_DELTA_REP) {
+        char rep[sizeof("\033[2147483647b")];
+        int rep_length = snprintf(rep, sizeof(rep), "\033[%db", count);
+        if ((size_t) rep_length < glyph_length * count) {
+            output_write(output, rep, rep_length);
+            return;
+        }
+    }
+
+    for (int i = 0; i < count; i++) {
+        output_write(output, glyph, glyph_length);
+    }
+}
+
+/**
+ * Convert the pixel values to an escape sequence directly
+ */
+static char* printer_true_color(const struct EscapeTable *escapes, Colour colour,
+                                enum layer layer, char *dest) {
+    dest = append_snippet(dest, &escapes->true_color[layer]);
+    dest = append_snippet(dest, &escapes->decimal[(colour >> 16) & 0xFF]);
+    *dest++ = ';';
+    dest = append_snippet(dest, &escapes->decimal[(colour >> 8) & 0xFF]);
+    *dest++ = ';';
+    return append_snippet(dest, &escapes->decimal[colour & 0xFF]);
+}
+
+/**
+ * Prints an index into the 256 color palette.
+ */
+static char* printer_256_color(const struct EscapeTable *escapes, Colour colour,
+                               enum layer layer, char *dest) {
+    return append_snippet(dest, &escapes->palette[layer][colour & 0xFF]);
+}
+
+/**
+ * Prints an index into the 8 color palette.
+ */
+static char* printer_8_color(const struct EscapeTable *escapes, Colour colour,
+                             enum layer layer, char *dest) {
+    /* It turns out that the 8 color array has the SAME indices as its
+     * corresponding ANSI escape sequence. */
+    return append_snippet(dest, &escapes->ansi[layer][colour & 0x7]);
+}
+
+static void set_snippet(Snippet *snippet, const char *format, int value) {
+    int length = snprintf(snippet->bytes, sizeof(snippet->bytes), format, value);
+    assert(length > 0 && length < (int) sizeof(snippet->bytes));
+    snippet->length = length;
+}
+
+/**
+ * Fills in both escape tables. They are the same, except that numbers in the
+ * compact table are not padded with zeros.
+ */
+static void build_escape_tables(void) {
+    struct EscapeTable *tables[] = { &padded_escapes, &compact_escapes };
+    const char *decimal_formats[] = { "%03d", "%d" };
+    const char *palette_formats[2][2] = {
+        /* BACKGROUND,  FOREGROUND */
+        { "48;5;%03d",  "38;5;%03d" },
+        { "48;5;%d",    "38;5;%d"   },
+    };
+
+    for (int t = 0; t < 2; t++) {
+        struct EscapeTable *table = tables[t];
+
+        for (int i = 0; i < 256; i++) {
+            set_snippet(&table->decimal[i], decimal_formats[t], i);
+            set_snippet(&table->palette[BACKGROUND][i], palette_formats[t][BACKGROUND], i);
+            set_snippet(&table->palette[FOREGROUND][i], palette_formats[t][FOREGROUND], i);
+        }
+
+        for (int i = 0; i < 8; i++) {
+            set_snippet(&table->ansi[BACKGROUND][i], "%2d", 40 + i);
+            set_snippet(&table->ansi[FOREGROUND][i], "%2d", 30 + i);
+        }
+
+        set_snippet(&table->true_color[BACKGROUND], "%d8;2;", 4);
+        set_snippet(&table->true_color[FOREGROUND], "%d8;2;", 3);
+    }
+}
+
+/**
+ * Prints the contents of the file in "canonical" base64.
+ * See Table 1 in RFC4648: https://tools.ietf.org/html/rfc4648#page-6
+ *
+ * Regular files are mapped into memory and encoded in place; anything else
+ * is read in big chunks.
+ */
+static bool print_base64(struct Output *output, int fd) {
+    struct stat info;
+
+    if (fstat(fd, &info) == 0 && S_ISREG(info.st_mode) && info.st_size > 0) {
+        size_t length = info.st_size;
+        void *contents = mmap(NULL, length, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (contents != MAP_FAILED) {
+            posix_madvise(contents, length, POSIX_MADV_SEQUENTIAL);
+            profile_count(P_BYTES_READ, length);
+            bool success = print_base64_buffer(output, contents, length);
+            munmap(contents, length);
+            return success;
+        }
+    }
+
+    /* Could not map it, so read it instead. Every chunk but the last must be
+     * a multiple of three bytes long, so top up short reads. */
+    uint8_t *chunk = malloc(BASE64_CHUNK_LEN);
+    if (chunk == NULL) {
+        return false;
+    }
+
+    size_t length = 0;
+    ssize_t bytes_read;
+    while ((bytes_read = read(fd, chunk + length, BASE64_CHUNK_LEN - length)) != 0) {
+        if (bytes_read < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            free(chunk);
+            return false;
+        }
+        length += bytes_read;
+        profile_count(P_BYTES_READ, bytes_read);
+        if (length == BASE64_CHUNK_LEN) {
+            if (!print_base64_buffer(output, chunk, length)) {
+                free(chunk);
+                return false;
+            }
+            length = 0;
+        }
     }
+    bool success = print_base64_buffer(output, chunk, length);
+
+    free(chunk);
+    return success;
+}
 
-    fclose(file);
+/**
+ * Encodes the buffer a chunk at a time, straight into the output buffer.
+ * Returns false if there wasn't room for it all.
+ */
+static bool print_base64_buffer(struct Output *output, const uint8_t *data, size_t length) {
+    while (length > 0) {
+        size_t chunk = length < BASE64_CHUNK_LEN ? length : BASE64_CHUNK_LEN;
+
+        if (!output_reserve(output, base64_encoded_length(chunk))) {
+            return false;
+        }
+        int64_t start = profile_now();
+        output->length += base64_encode(data, chunk, output->data + output->length);
+        profile_add(P_FORMAT, start);
+
+        if (output_should_flush(output)) {
+            output_flush(output);
+        }
+
+        data += chunk;
+        length -= chunk;
+    }
     return true;
 }
 
 /**
  * Print the start of an operating system command (OSC).
  */
-static void print_osc() {
-    printf("\033]");
+static void print_osc(struct Output *output) {
+    output_puts(output, "\033]");
 }
 
 /**
  * Print the string terminator (ST), which in iTerm's case is simply the ASCII
  * bell.
  */
-static void print_st() {
-    printf("\007\n");
+static void print_st(struct Output *output) {
+    output_puts(output, "\007\n");
 }
@@ -21,6 +21,10 @@
 #define PRINT_IMAGE_H
 
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "quantize.h"
 
 /* The dimension has been left unspecified. */
 enum {
@@ -31,24 +35,113 @@ enum {
 
 /* The output color depth/format. */
 typedef enum {
-    F_8_COLOR, F_256_COLOR, F_TRUE_COLOR, F_ITERM2, F_UNSET
+    F_8_COLOR, F_256_COLOR, F_TRUE_COLOR, F_ITERM2, F_SIXEL, F_KITTY, F_UNSET
 } Format;
 
+/* How hard to try to keep the escape sequences short. */
+typedef enum {
+    /* Every cell gets its own complete escape sequence. */
+    E_FULL,
+    /* Only print colours that differ from the previous cell's. */
+    E_DELTA,
+    /* Like E_DELTA, but runs of identical cells are printed using REP. */
+    E_DELTA_REP,
+} Emission;
+
+/* What each character cell of an image shows. */
+typedef enum {
+    /* One pixel: the background colour of a space. */
+    B_FULL,
+    /* Two pixels, one above the other: ▀. */
+    B_HALF,
+    /* 2×2 pixels, in at most two colours: quadrant blocks, like ▚. */
+    B_QUADRANT,
+    /* 2×3 pixels, in at most two colours: sextant blocks, from Unicode's
+     * Symbols for Legacy Computing, which not every font has. */
+    B_SEXTANT,
+} Blocks;
+
+/* How F_KITTY images get to the terminal. */
+typedef enum {
+    /* Compressed and base64 encoded in the escape sequences, so it works
+     * over ssh, too. */
+    K_DIRECT,
+    /* In a temporary file, which the terminal deletes once it's read it. */
+    K_FILE,
+    /* In a POSIX shared memory object, which the terminal unlinks once
+     * it's read it. */
+    K_SHARED_MEMORY,
+} KittyMedium;
+
+struct Output;
+
 /**
  * Specifies all the parameters needed to print an image.
+ *
+ * Every field that changes what gets printed must also be part of the render
+ * cache's key; see cache_key() in render_cache.c.
  */
 typedef struct {
     const char *filename;
+    /* When set, the image's encoded contents are already in memory (e.g.,
+     * read from a pipe), and filename is only used to name it. */
+    const uint8_t *data;
+    size_t data_length;
+    /* In character cells; or, for F_SIXEL and F_KITTY, in pixels. B_QUADRANT
+     * and B_SEXTANT images are sized just like B_HALF ones, and then each
+     * pixel is split into 2×1 or 2×1½ of their own. */
     int max_width;
     int max_height;
     int desired_width;
     int desired_height;
-    bool half_height;
+    /* Doesn't apply to F_SIXEL or F_KITTY, which are a pixel per pixel. */
+    Blocks blocks;
     bool preserve_aspect_ratio;
     Format format;
+    Quantizer quantizer;
+    /* Only applies to F_8_COLOR, F_256_COLOR, and F_SIXEL. */
+    Dither dither;
+    Emission emission;
+    /* Only applies to F_KITTY. Files and shared memory are only for a
+     * terminal on the same machine. */
+    KittyMedium kitty_medium;
+    /* Don't pad numbers in escape sequences with zeros. */
+    bool compact_escapes;
+    /* When non-zero, print the image at the highest fidelity estimated to
+     * fit in this many bytes: as narrow, in as few colours, and with as much
+     * compression as it takes, but never more colours than format. Doesn't
+     * apply to F_ITERM2, F_KITTY, or animations. */
+    size_t max_bytes;
+    /* How many threads may format rows. 1 or less formats them all on the
+     * calling thread. The output is the same either way. */
+    int jobs;
+    /* Play animated images, rather than printing their first frame (sixel and
+     * kitty images are never played)... */
+    bool animate;
+    /* ...this many times, or 0 for as many times as the image asks. */
+    int plays;
+    /* Where to print the image: usually STDOUT_FILENO... */
+    int output_fd;
+    /* ...unless this is set, in which case it's appended here instead. */
+    struct Output *output;
+    /* Set by print_image(): the number of bytes printed. */
+    size_t bytes_written;
 } PrintRequest;
 
+struct Image;
+
 /* Prints the image. Returns true when successful. */
 bool print_image(PrintRequest *request);
 
+/**
+ * The two halves of print_image() for character cell formats (anything but
+ * F_ITERM2), so that one image can be decoded while another is printed.
+ *
+ * decode_image() loads and resizes the image; it may be called from any
+ * thread. print_decoded_image() prints and then unloads it. Both return true
+ * when successful.
+ */
+bool decode_image(const PrintRequest *request, struct Image *image);
+bool print_decoded_image(PrintRequest *request, struct Image *image);
+
 #endif /* PRINT_IMAGE_H */
@@ -0,0 +1,376 @@
+/*
+ * Copyright (c) 2026 Eddie Antonio Santos <hello@eddieantonio.ca>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+
+/**
+ * @file profile.c
+ * @brief Stage timings and counters for --x-profile.
+ *
+ * Totals and counters are added to atomically, since every thread adds to
+ * them per row. Spans are much rarer, and are appended to a list under a
+ * lock, to be written out as trace events at the end.
+ */
+
+/* Feature-test macro for clock_gettime(2). */
+#define _XOPEN_SOURCE 600
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "profile.h"
+
+/**
+ * One step that took a while, on one thread.
+ */
+struct Span {
+    const char *name;
+    char *what;
+    int64_t start, end;
+    /* Index into the list of threads. */
+    int thread;
+};
+
+struct ThreadName {
+    pthread_t thread;
+    const char *name;
+};
+
+struct ImageSize {
+    char *name;
+    int width, height;
+    int decoded_width, decoded_height;
+    int resized_width, resized_height;
+};
+
+struct BudgetChoice {
+    char *name;
+    char *choice;
+    uint64_t estimate, printed, budget;
+};
+
+/* Only written before and after there are any other threads. */
+static bool enabled = false;
+static const char *trace_filename;
+static int64_t started;
+
+static int64_t totals[P_STAGES];
+static uint64_t counters[P_COUNTERS];
+
+/* The lists, protected by lock. */
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static struct Span *spans;
+static size_t n_spans, spans_capacity;
+static struct ThreadName *threads;
+static size_t n_threads, threads_capacity;
+static struct ImageSize *images;
+static size_t n_images, images_capacity;
+static struct BudgetChoice *budgets;
+static size_t n_budgets, budgets_capacity;
+
+static _Thread_local const char *current_image;
+
+static const char *const stage_names[P_STAGES] = {
+    [P_READ] = "read",
+    [P_DECODE] = "decode",
+    [P_RESIZE] = "resize",
+    [P_QUANTIZE] = "quantize",
+    [P_FORMAT] = "format",
+    [P_WRITE] = "write",
+};
+
+static int64_t clock_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/**
+ * Makes room for one more item in a list. Returns false if there's no
+ * memory for it.
+ */
+static bool make_room(void **list, size_t *capacity, size_t count, size_t size) {
+    if (count < *capacity) {
+        return true;
+    }
+    size_t new_capacity = *capacity ? 2 * *capacity : 64;
+    void *bigger = realloc(*list, new_capacity * size);
+    if (bigger == NULL) {
+        return false;
+    }
+    *list = bigger;
+    *capacity = new_capacity;
+    return true;
+}
+
+/**
+ * Finds (or adds) this thread in the list of threads. Must hold the lock.
+ * Returns -1 if it couldn't be added.
+ */
+static int thread_index(void) {
+    pthread_t self = pthread_self();
+    for (size_t i = 0; i < n_threads; i++) {
+        if (pthread_equal(threads[i].thread, self)) {
+            return (int) i;
+        }
+    }
+    if (!make_room((void **) &threads, &threads_capacity, n_threads, sizeof(*threads))) {
+        return -1;
+    }
+    threads[n_threads] = (struct ThreadName) { .thread = self, .name = NULL };
+    return (int) n_threads++;
+}
+
+void profile_start(const char *filename) {
+    trace_filename = filename;
+    started = clock_ns();
+    enabled = true;
+    profile_thread_name("main");
+}
+
+bool profile_enabled(void) {
+    return enabled;
+}
+
+int64_t profile_now(void) {
+    return enabled ? clock_ns() : 0;
+}
+
+void profile_add(ProfileStage stage, int64_t start) {
+    if (!enabled) {
+        return;
+    }
+    __atomic_fetch_add(&totals[stage], clock_ns() - start, __ATOMIC_RELAXED);
+}
+
+void profile_move(ProfileStage from, ProfileStage to, int64_t start) {
+    if (!enabled) {
+        return;
+    }
+    int64_t elapsed = clock_ns() - start;
+    __atomic_fetch_sub(&totals[from], elapsed, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&totals[to], elapsed, __ATOMIC_RELAXED);
+}
+
+void profile_count(ProfileCounter counter, uint64_t amount) {
+    if (!enabled) {
+        return;
+    }
+    __atomic_fetch_add(&counters[counter], amount, __ATOMIC_RELAXED);
+}
+
+void profile_span(const char *name, int64_t start, const char *what) {
+    if (!enabled) {
+        return;
+    }
+    struct Span span = {
+        .name = name,
+        .what = what != NULL ? strdup(what) : NULL,
+        .start = start,
+        .end = clock_ns(),
+    };
+
+    pthread_mutex_lock(&lock);
+    span.thread = thread_index();
+    if (span.thread >= 0
+            && make_room((void **) &spans, &spans_capacity, n_spans, sizeof(*spans))) {
+        spans[n_spans++] = span;
+    } else {
+        free(span.what);
+    }
+    pthread_mutex_unlock(&lock);
+}
+
+void profile_thread_name(const char *name) {
+    if (!enabled) {
+        return;
+    }
+    pthread_mutex_lock(&lock);
+    int thread = thread_index();
+    if (thread >= 0) {
+        threads[thread].name = name;
+    }
+    pthread_mutex_unlock(&lock);
+}
+
+void profile_set_image(const char *name) {
+    current_image = name;
+}
+
+void profile_image(int width, int height, int decoded_width, int decoded_height,
+                   int resized_width, int resized_height) {
+    if (!enabled) {
+        return;
+    }
+    struct ImageSize size = {
+        .name = strdup(current_image != NULL ? current_image : "(image)"),
+        .width = width,
+        .height = height,
+        .decoded_width = decoded_width,
+        .decoded_height = decoded_height,
+        .resized_width = resized_width,
+        .resized_height = resized_height,
+    };
+
+    pthread_mutex_lock(&lock);
+    if (size.name != NULL
+            && make_room((void **) &images, &images_capacity, n_images, sizeof(*images))) {
+        images[n_images++] = size;
+    } else {
+        free(size.name);
+    }
+    pthread_mutex_unlock(&lock);
+}
+
+void profile_budget(const char *choice, uint64_t estimate, uint64_t printed,
+                    uint64_t budget) {
+    if (!enabled) {
+        return;
+    }
+    struct BudgetChoice budget_choice = {
+        .name = strdup(current_image != NULL ? current_image : "(image)"),
+        .choice = strdup(choice),
+        .estimate = estimate,
+        .printed = printed,
+        .budget = budget,
+    };
+
+    pthread_mutex_lock(&lock);
+    if (budget_choice.name != NULL && budget_choice.choice != NULL
+            && make_room((void **) &budgets, &budgets_capacity, n_budgets, sizeof(*budgets))) {
+        budgets[n_budgets++] = budget_choice;
+    } else {
+        free(budget_choice.name);
+        free(budget_choice.choice);
+    }
+    pthread_mutex_unlock(&lock);
+}
+
+/**
+ * Writes a string as a JSON string literal.
+ */
+static void write_json_string(FILE *file, const char *string) {
+    putc('"', file);
+    for (const unsigned char *c = (const unsigned char *) string; *c; c++) {
+        if (*c == '"' || *c == '\\') {
+            fprintf(file, "\\%c", *c);
+        } else if (*c < 0x20) {
+            fprintf(file, "\\u%04x", *c);
+        } else {
+            putc(*c, file);
+        }
+    }
+    putc('"', file);
+}
+
+/**
+ * Writes every span as a complete ("X") event, and every thread's name as
+ * metadata, in the Trace Event Format.
+ */
+static bool write_trace(const char *filename) {
+    FILE *file = fopen(filename, "w");
+    if (file == NULL) {
+        return false;
+    }
+
+    const int pid = (int) getpid();
+    fprintf(file, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+    for (size_t i = 0; i < n_threads; i++) {
+        fprintf(file, "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": %d, "
+                "\"tid\": %zu, \"args\": {\"name\": ", pid, i);
+        write_json_string(file, threads[i].name != NULL ? threads[i].name : "worker");
+        fprintf(file, "}},\n");
+    }
+    for (size_t i = 0; i < n_spans; i++) {
+        const struct Span *span = &spans[i];
+        fprintf(file, "{\"name\": ");
+        write_json_string(file, span->name);
+        fprintf(file, ", \"cat\": \"imgcat\", \"ph\": \"X\", \"pid\": %d, \"tid\": %d, "
+                "\"ts\": %.3f, \"dur\": %.3f",
+                pid, span->thread, (span->start - started) / 1e3,
+                (span->end - span->start) / 1e3);
+        if (span->what != NULL) {
+            fprintf(file, ", \"args\": {\"image\": ");
+            write_json_string(file, span->what);
+            fprintf(file, "}");
+        }
+        fprintf(file, "},\n");
+    }
+    /* A trailing comma isn't allowed, so end with one more event. */
+    fprintf(file, "{\"name\": \"process_name\", \"ph\": \"M\", \"pid\": %d, "
+            "\"args\": {\"name\": \"imgcat\"}}\n]}\n", pid);
+
+    bool success = !ferror(file);
+    return fclose(file) == 0 && success;
+}
+
+static void print_summary(FILE *dest) {
+    fprintf(dest, "profile: %.3f ms in all\n", (clock_ns() - started) / 1e6);
+    for (int stage = 0; stage < P_STAGES; stage++) {
+        fprintf(dest, "  %-16s %12.3f ms\n", stage_names[stage], totals[stage] / 1e6);
+    }
+    fprintf(dest, "  %-16s %12" PRIu64 "\n", "bytes read", counters[P_BYTES_READ]);
+    fprintf(dest, "  %-16s %12" PRIu64 "\n", "cells", counters[P_CELLS]);
+    fprintf(dest, "  %-16s %12" PRIu64 "\n", "bytes written", counters[P_BYTES_WRITTEN]);
+    for (size_t i = 0; i < n_images; i++) {
+        const struct ImageSize *size = &images[i];
+        fprintf(dest, "  %s: %dx%d, decoded at %dx%d, resized to %dx%d\n",
+                size->name, size->width, size->height,
+                size->decoded_width, size->decoded_height,
+                size->resized_width, size->resized_height);
+    }
+    for (size_t i = 0; i < n_budgets; i++) {
+        const struct BudgetChoice *choice = &budgets[i];
+        fprintf(dest, "  %s: %s, %" PRIu64 " of %" PRIu64 " bytes, estimated %" PRIu64 "\n",
+                choice->name, choice->choice, choice->printed, choice->budget,
+                choice->estimate);
+    }
+}
+
+bool profile_finish(void) {
+    if (!enabled) {
+        return true;
+    }
+    enabled = false;
+
+    print_summary(stderr);
+    bool success = trace_filename == NULL || write_trace(trace_filename);
+
+    for (size_t i = 0; i < n_spans; i++) {
+        free(spans[i].what);
+    }
+    for (size_t i = 0; i < n_images; i++) {
+        free(images[i].name);
+    }
+    for (size_t i = 0; i < n_budgets; i++) {
+        free(budgets[i].name);
+        free(budgets[i].choice);
+    }
+    free(spans);
+    free(threads);
+    free(images);
+    free(budgets);
+    spans = NULL;
+    threads = NULL;
+    images = NULL;
+    budgets = NULL;
+    n_spans = n_threads = n_images = n_budgets = 0;
+    spans_capacity = threads_capacity = images_capacity = budgets_capacity = 0;
+    return success;
+}
@@ -0,0 +1,143 @@
+/*
+ * Copyright (c) 2026 Eddie Antonio Santos <hello@eddieantonio.ca>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+
+/**
+ * @file profile.h
+ * @brief Stage timings and counters for --x-profile, and a Chrome trace of
+ * where the time went.
+ *
+ * Usage:
+ *
+ * Call profile_start() before starting any threads, and profile_finish()
+ * once they're all done. In between, every stage adds the time it took with
+ * profile_add(), and the bigger steps are recorded as spans in the trace
+ * with profile_span().
+ *
+ * Until profile_start() is called, profile_now() returns 0 without reading
+ * the clock, and everything else returns straight away, so the hooks cost
+ * next to nothing when nobody is profiling.
+ */
+
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#ifdef __cplusplus
+#include <cstdint>
+extern "C" {
+#else
+#include <stdbool.h>
+#include <stdint.h>
+#endif
+
+/* Where the time goes, in the order it's spent. */
+typedef enum {
+    /* Reading an encoded image into memory. */
+    P_READ,
+    /* Decoding, including interleaving the decoded rows. */
+    P_DECODE,
+    /* Shrinking decoded rows. */
+    P_RESIZE,
+    /* Turning pixels into palette indices (or packed true colours). */
+    P_QUANTIZE,
+    /* Turning colours into escape sequences (or base64, for iTerm2). */
+    P_FORMAT,
+    /* Blocked in write(2). */
+    P_WRITE,
+    P_STAGES
+} ProfileStage;
+
+typedef enum {
+    P_BYTES_READ,
+    P_CELLS,
+    P_BYTES_WRITTEN,
+    P_COUNTERS
+} ProfileCounter;
+
+/**
+ * Starts profiling. If trace_filename isn't NULL, profile_finish() writes a
+ * Chrome trace there (see chrome://tracing, or https://ui.perfetto.dev/).
+ */
+void profile_start(const char *trace_filename);
+
+/**
+ * Prints a summary to stderr, and writes the trace, if one was asked for.
+ * Returns false if the trace could not be written.
+ */
+bool profile_finish(void);
+
+/**
+ * Whether profile_start() has been called, for hooks that would have to do
+ * extra work to count something.
+ */
+bool profile_enabled(void);
+
+/**
+ * Monotonic time, in nanoseconds, or 0 when not profiling.
+ */
+int64_t profile_now(void);
+
+/**
+ * Adds the time since start to the stage's total. Cheap enough to call for
+ * every row.
+ */
+void profile_add(ProfileStage, int64_t start);
+
+/**
+ * Moves the time since start from one stage's total to another's, for a
+ * stage that happens in the middle of another (e.g., resizing rows while
+ * they're decoded).
+ */
+void profile_move(ProfileStage from, ProfileStage to, int64_t start);
+
+void profile_count(ProfileCounter, uint64_t amount);
+
+/**
+ * Records a span of the trace on this thread, from start until now. what
+ * (e.g., a filename) is shown with it, and may be NULL.
+ */
+void profile_span(const char *name, int64_t start, const char *what);
+
+/**
+ * Names this thread in the trace.
+ */
+void profile_thread_name(const char *name);
+
+/**
+ * Sets the name of the image this thread is working on, for
+ * profile_image().
+ */
+void profile_set_image(const char *name);
+
+/**
+ * Records the size of the image this thread is working on: in its header,
+ * as decoded (some decoders can decode at reduced size), and once resized.
+ */
+void profile_image(int width, int height, int decoded_width, int decoded_height,
+                   int resized_width, int resized_height);
+
+/**
+ * Records how --max-bytes chose to print the image this thread is working
+ * on (described by choice, e.g., "256 colours, 80 columns"), how many bytes
+ * it was estimated to take, and how many it printed, out of budget.
+ */
+void profile_budget(const char *choice, uint64_t estimate, uint64_t printed,
+                    uint64_t budget);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+#endif /* PROFILE_H */
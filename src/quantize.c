@@ -0,0 +1,714 @@
+/*
+ * Copyright (c) 2026 Eddie Antonio Santos <hello@eddieantonio.ca>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/**
+ * @file quantize.c
+ * @brief Finds the closest palette colours for whole rows of pixels.
+ *
+ * Walking the k-d tree is a handful of recursive calls per pixel, which adds
+ * up quickly on large images. Both RGB tables here are built from the tree,
+ * so the tree remains the single source of truth for what "closest" means.
+ *
+ * Perceptual matching measures "closest" in CIELAB instead, where equal
+ * distances look about equally different. Converting and searching is slower
+ * than walking the tree, but it's done once per distinct colour, and then
+ * served from a table just like Q_EXACT.
+ *
+ * Dithering nudges each pixel before it's matched. Nudged colours are
+ * matched at the small table's resolution, which the dithering hides. Error
+ * diffusion keeps just one row of error, however big the image.
+ */
+
+#include <assert.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+/* AVX2 is not part of the x86-64 baseline, so it's compiled separately and
+ * chosen at runtime. */
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define HAVE_AVX2_DISPATCH 1
+#include <immintrin.h>
+#endif
+
+#include "quantize.h"
+#include "rgbtree.h"
+
+enum {
+    /* Bits kept per channel in the small table. */
+    TABLE_BITS = 5,
+    TABLE_SIZE = 1 << (3 * TABLE_BITS),
+    /* One entry for every 24-bit colour. */
+    EXACT_SIZE = 1 << 24,
+    /* The 8 colour palette only has 0 or 128 in each channel, so the closest
+     * entry can be chosen one channel at a time: anything above 64 is closer
+     * to 128. At exactly 64 both are equally close, and the lower index (0)
+     * wins, just like a linear search over the palette. */
+    ANSI_THRESHOLD = 64,
+    /* Every xterm colour, and the first 8 of them. */
+    PALETTE_256 = 256,
+    PALETTE_8 = 8,
+};
+
+/* 32 KiB: built all at once on first use. */
+static uint8_t small_table[TABLE_SIZE];
+static pthread_once_t small_table_once = PTHREAD_ONCE_INIT;
+
+/* 32 MiB of *virtual* memory, but only the pages covering colours that are
+ * actually looked up are ever touched. Each entry is the palette index plus
+ * one; zero means "not looked up yet". */
+static uint16_t *exact_table = NULL;
+static pthread_once_t exact_table_once = PTHREAD_ONCE_INIT;
+
+static uint8_t quantize_tree(uint8_t red, uint8_t green, uint8_t blue) {
+    return rgb_closest_colour(red, green, blue)->id;
+}
+
+static void build_small_table(void) {
+    const int shift = 8 - TABLE_BITS;
+    /* Look up the centre of each bucket, not its corner. */
+    const int half_bucket = 1 << (shift - 1);
+
+    for (int i = 0; i < TABLE_SIZE; i++) {
+        int red = (i >> (2 * TABLE_BITS)) & ((1 << TABLE_BITS) - 1);
+        int green = (i >> TABLE_BITS) & ((1 << TABLE_BITS) - 1);
+        int blue = i & ((1 << TABLE_BITS) - 1);
+        small_table[i] = quantize_tree((red << shift) | half_bucket,
+                                       (green << shift) | half_bucket,
+                                       (blue << shift) | half_bucket);
+    }
+}
+
+static inline uint8_t lookup_small_table(uint8_t red, uint8_t green, uint8_t blue) {
+    const int shift = 8 - TABLE_BITS;
+    int i = ((red >> shift) << (2 * TABLE_BITS))
+          | ((green >> shift) << TABLE_BITS)
+          | (blue >> shift);
+    return small_table[i];
+}
+
+static uint8_t quantize_small_table(uint8_t red, uint8_t green, uint8_t blue) {
+    return lookup_small_table(red, green, blue);
+}
+
+static void allocate_exact_table(void) {
+    /* calloc() hands back zeroed pages lazily, so this is cheap until used.
+     * If it fails, we silently fall back to walking the tree. */
+    exact_table = calloc(EXACT_SIZE, sizeof(uint16_t));
+}
+
+/* The table is indexed in the same byte order as pixels in an Image, so a
+ * row of pixels can be looked up without shuffling channels around. */
+static inline uint8_t lookup_exact(uint8_t red, uint8_t green, uint8_t blue) {
+    uint32_t i = ((uint32_t) blue << 16) | ((uint32_t) green << 8) | red;
+
+    /* Racing threads can only ever store the same answer, so relaxed
+     * atomics are sufficient. */
+    uint16_t entry = __atomic_load_n(&exact_table[i], __ATOMIC_RELAXED);
+    if (entry == 0) {
+        entry = quantize_tree(red, green, blue) + 1;
+        __atomic_store_n(&exact_table[i], entry, __ATOMIC_RELAXED);
+    }
+
+    return entry - 1;
+}
+
+static uint8_t quantize_exact(uint8_t red, uint8_t green, uint8_t blue) {
+    return lookup_exact(red, green, blue);
+}
+
+/**
+ * A palette in CIELAB, sorted by lightness (L*), so that a search can stop as
+ * soon as the difference in lightness alone is further than the best match.
+ */
+struct LabPalette {
+    int size;
+    float lightness[PALETTE_256], a[PALETTE_256], b[PALETTE_256];
+    uint8_t index[PALETTE_256];
+    /* Like exact_table: the palette index plus one, or zero if not looked up
+     * yet. NULL if it couldn't be allocated. */
+    uint16_t *table;
+};
+
+static struct LabPalette lab_palette_256, lab_palette_8;
+static pthread_once_t lab_palettes_once = PTHREAD_ONCE_INIT;
+
+/* sRGB's transfer function, undone, for every channel value. */
+static float linear_channel[256];
+/* Filled in by collect_palette(), by way of rgb_foreach_df(). */
+static RGB_Tuple palette_rgb[PALETTE_256];
+static pthread_once_t palette_rgb_once = PTHREAD_ONCE_INIT;
+
+static float lab_f(float t) {
+    const float delta = 6.0f / 29.0f;
+    return t > delta * delta * delta
+        ? cbrtf(t)
+        : t / (3 * delta * delta) + 4.0f / 29.0f;
+}
+
+/**
+ * Converts an sRGB colour to CIELAB, relative to the D65 white point.
+ */
+static void rgb_to_lab(uint8_t red, uint8_t green, uint8_t blue, float lab[3]) {
+    float r = linear_channel[red], g = linear_channel[green], b = linear_channel[blue];
+    float x = (0.4124f * r + 0.3576f * g + 0.1805f * b) / 0.95047f;
+    float y = 0.2126f * r + 0.7152f * g + 0.0722f * b;
+    float z = (0.0193f * r + 0.1192f * g + 0.9505f * b) / 1.08883f;
+
+    float fx = lab_f(x), fy = lab_f(y), fz = lab_f(z);
+    lab[0] = 116 * fy - 16;
+    lab[1] = 500 * (fx - fy);
+    lab[2] = 200 * (fy - fz);
+}
+
+static void collect_palette(const RGB_Node *node, int depth) {
+    (void) depth;
+    palette_rgb[node->id] = node->colour;
+}
+
+static void build_palette_rgb(void) {
+    rgb_foreach_df(rgb_palette_tree(), collect_palette);
+}
+
+/* Sorts the palette in lightness order, keeping ties in index order. */
+static const float *sort_lightness;
+
+static int compare_lightness(const void *p, const void *q) {
+    uint8_t i = *(const uint8_t *) p, j = *(const uint8_t *) q;
+    if (sort_lightness[i] != sort_lightness[j]) {
+        return sort_lightness[i] < sort_lightness[j] ? -1 : 1;
+    }
+    return i - j;
+}
+
+static void build_lab_palette(struct LabPalette *palette, int size) {
+    float lab[PALETTE_256][3], lightness[PALETTE_256];
+    uint8_t order[PALETTE_256];
+
+    for (int i = 0; i < size; i++) {
+        const RGB_Tuple *rgb = &palette_rgb[i];
+        rgb_to_lab(rgb->channel.red, rgb->channel.green, rgb->channel.blue, lab[i]);
+        lightness[i] = lab[i][0];
+        order[i] = i;
+    }
+    sort_lightness = lightness;
+    qsort(order, size, sizeof(order[0]), compare_lightness);
+
+    palette->size = size;
+    for (int i = 0; i < size; i++) {
+        palette->index[i] = order[i];
+        palette->lightness[i] = lab[order[i]][0];
+        palette->a[i] = lab[order[i]][1];
+        palette->b[i] = lab[order[i]][2];
+    }
+    /* Lazily zeroed, like exact_table. */
+    palette->table = calloc(EXACT_SIZE, sizeof(uint16_t));
+}
+
+static void build_lab_palettes(void) {
+    for (int i = 0; i < 256; i++) {
+        float c = i / 255.0f;
+        linear_channel[i] = c <= 0.04045f ? c / 12.92f : powf((c + 0.055f) / 1.055f, 2.4f);
+    }
+    pthread_once(&palette_rgb_once, build_palette_rgb);
+
+    build_lab_palette(&lab_palette_256, PALETTE_256);
+    build_lab_palette(&lab_palette_8, PALETTE_8);
+}
+
+/**
+ * Finds the palette entry closest to the colour in CIELAB. Starts at the
+ * entries with the most similar lightness, and works outwards in both
+ * directions until lightness alone is too far away to do any better.
+ */
+static uint8_t search_lab_palette(const struct LabPalette *palette,
+                                  uint8_t red, uint8_t green, uint8_t blue) {
+    float lab[3];
+    rgb_to_lab(red, green, blue, lab);
+
+    int low = 0, high = palette->size;
+    while (low < high) {
+        int middle = (low + high) / 2;
+        if (palette->lightness[middle] < lab[0]) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+
+    float best_distance = INFINITY;
+    uint8_t best = 0;
+    int down = low - 1, up = low;
+    while (down >= 0 || up < palette->size) {
+        /* Take the next entry on whichever side is closer in lightness. */
+        int i;
+        if (up == palette->size ||
+                (down >= 0 && lab[0] - palette->lightness[down] < palette->lightness[up] - lab[0])) {
+            i = down--;
+        } else {
+            i = up++;
+        }
+
+        float dl = palette->lightness[i] - lab[0];
+        if (dl * dl > best_distance) {
+            /* Every entry left is even further away in lightness alone. */
+            break;
+        }
+        float da = palette->a[i] - lab[1], db = palette->b[i] - lab[2];
+        float distance = dl * dl + da * da + db * db;
+        /* Ties go to the lower index, like a linear search would. */
+        if (distance < best_distance
+                || (distance == best_distance && palette->index[i] < best)) {
+            best_distance = distance;
+            best = palette->index[i];
+        }
+    }
+
+    return best;
+}
+
+static inline uint8_t lookup_lab(const struct LabPalette *palette,
+                                 uint8_t red, uint8_t green, uint8_t blue) {
+    if (palette->table == NULL) {
+        return search_lab_palette(palette, red, green, blue);
+    }
+
+    /* Indexed and filled in just like exact_table. */
+    uint32_t i = ((uint32_t) blue << 16) | ((uint32_t) green << 8) | red;
+    uint16_t entry = __atomic_load_n(&palette->table[i], __ATOMIC_RELAXED);
+    if (entry == 0) {
+        entry = search_lab_palette(palette, red, green, blue) + 1;
+        __atomic_store_n(&palette->table[i], entry, __ATOMIC_RELAXED);
+    }
+
+    return entry - 1;
+}
+
+static uint8_t quantize_perceptual(uint8_t red, uint8_t green, uint8_t blue) {
+    return lookup_lab(&lab_palette_256, red, green, blue);
+}
+
+QuantizeFunc quantizer_256(Quantizer backend) {
+    switch (backend) {
+        case Q_EXACT:
+            pthread_once(&exact_table_once, allocate_exact_table);
+            if (exact_table == NULL) {
+                return quantize_tree;
+            }
+            return quantize_exact;
+        case Q_TABLE:
+            pthread_once(&small_table_once, build_small_table);
+            return quantize_small_table;
+        case Q_TREE:
+            return quantize_tree;
+        case Q_PERCEPTUAL:
+            pthread_once(&lab_palettes_once, build_lab_palettes);
+            return quantize_perceptual;
+    }
+
+    assert(0 && "Not a valid quantizer.");
+    return quantize_tree;
+}
+
+void palette_rgb_256(uint8_t index, uint8_t rgb[3]) {
+    pthread_once(&palette_rgb_once, build_palette_rgb);
+    memcpy(rgb, palette_rgb[index].axis, 3);
+}
+
+/*
+ * Row kernels. Pixels are always 32bpp, as in struct Image.
+ */
+
+void quantize_row_256(Quantizer backend, const uint8_t *pixels, int width,
+                      uint8_t *indices) {
+    /* Make sure the tables exist, and find out if we fell back to the tree. */
+    QuantizeFunc quantize = quantizer_256(backend);
+
+    /* The table lookups are written out so that they get inlined into the
+     * loop; only the tree pays for a function call per pixel. The lookups
+     * themselves are scattered loads, so there is nothing to gain from
+     * vectorizing them. */
+    if (quantize == quantize_exact) {
+        for (int x = 0; x < width; x++, pixels += 4) {
+            indices[x] = lookup_exact(pixels[0], pixels[1], pixels[2]);
+        }
+    } else if (quantize == quantize_small_table) {
+        for (int x = 0; x < width; x++, pixels += 4) {
+            indices[x] = lookup_small_table(pixels[0], pixels[1], pixels[2]);
+        }
+    } else if (quantize == quantize_perceptual) {
+        for (int x = 0; x < width; x++, pixels += 4) {
+            indices[x] = lookup_lab(&lab_palette_256, pixels[0], pixels[1], pixels[2]);
+        }
+    } else {
+        for (int x = 0; x < width; x++, pixels += 4) {
+            indices[x] = quantize(pixels[0], pixels[1], pixels[2]);
+        }
+    }
+}
+
+static inline uint8_t ansi_index(const uint8_t *pixel) {
+    return (pixel[0] > ANSI_THRESHOLD)
+         | (pixel[1] > ANSI_THRESHOLD) << 1
+         | (pixel[2] > ANSI_THRESHOLD) << 2;
+}
+
+#if defined(__SSE2__)
+/* Returns how many pixels were done; the caller finishes off the rest. */
+static int quantize_row_8_sse2(const uint8_t *pixels, int width,
+                               uint8_t *indices) {
+    /* There's no unsigned byte comparison, so flip the sign bit of both
+     * sides and compare signed. */
+    const __m128i bias = _mm_set1_epi8((char) 0x80);
+    const __m128i threshold = _mm_set1_epi8((char) (ANSI_THRESHOLD ^ 0x80));
+    int x = 0;
+
+    for (; x + 4 <= width; x += 4) {
+        __m128i quad = _mm_loadu_si128((const __m128i *) (pixels + 4 * x));
+        __m128i above = _mm_cmpgt_epi8(_mm_xor_si128(quad, bias), threshold);
+        /* One bit per channel: R, G, B, A for each of the four pixels. */
+        unsigned mask = _mm_movemask_epi8(above);
+        indices[x + 0] = mask & 7;
+        indices[x + 1] = (mask >> 4) & 7;
+        indices[x + 2] = (mask >> 8) & 7;
+        indices[x + 3] = (mask >> 12) & 7;
+    }
+
+    return x;
+}
+#endif
+
+#if defined(HAVE_AVX2_DISPATCH)
+__attribute__((target("avx2")))
+static int quantize_row_8_avx2(const uint8_t *pixels, int width,
+                               uint8_t *indices) {
+    const __m256i bias = _mm256_set1_epi8((char) 0x80);
+    const __m256i threshold = _mm256_set1_epi8((char) (ANSI_THRESHOLD ^ 0x80));
+    int x = 0;
+
+    for (; x + 8 <= width; x += 8) {
+        __m256i octet = _mm256_loadu_si256((const __m256i *) (pixels + 4 * x));
+        __m256i above = _mm256_cmpgt_epi8(_mm256_xor_si256(octet, bias), threshold);
+        uint32_t mask = (uint32_t) _mm256_movemask_epi8(above);
+        for (int i = 0; i < 8; i++) {
+            indices[x + i] = (mask >> (4 * i)) & 7;
+        }
+    }
+
+    return x;
+}
+#endif
+
+void quantize_row_8(const uint8_t *pixels, int width, uint8_t *indices) {
+    int x = 0;
+
+#if defined(HAVE_AVX2_DISPATCH)
+    if (__builtin_cpu_supports("avx2")) {
+        x = quantize_row_8_avx2(pixels, width, indices);
+    }
+#endif
+#if defined(__SSE2__)
+    x += quantize_row_8_sse2(pixels + 4 * x, width - x, indices + x);
+#endif
+
+    /* Scalar fallback, and the leftovers from the vector loops. */
+    for (; x < width; x++) {
+        indices[x] = ansi_index(pixels + 4 * x);
+    }
+}
+
+void quantize_row_8_perceptual(const uint8_t *pixels, int width, uint8_t *indices) {
+    pthread_once(&lab_palettes_once, build_lab_palettes);
+
+    for (int x = 0; x < width; x++, pixels += 4) {
+        indices[x] = lookup_lab(&lab_palette_8, pixels[0], pixels[1], pixels[2]);
+    }
+}
+
+/*
+ * Dithering.
+ */
+
+enum {
+    /* How far apart the palette colours being dithered between usually are:
+     * most steps of the xterm colour cube are 40 apart, and the 8 colour
+     * palette is either 0 or 128. */
+    ORDERED_SPREAD_256 = 40,
+    ORDERED_SPREAD_8 = 128,
+    /* Diffused error is kept in sixteenths, Floyd-Steinberg's denominator. */
+    ERROR_SCALE = 16,
+};
+
+/* Each threshold is as far as possible from its neighbours', so every level
+ * comes out as an even, fine-grained pattern. */
+static const uint8_t bayer_8x8[8][8] = {
+    {  0, 32,  8, 40,  2, 34, 10, 42 },
+    { 48, 16, 56, 24, 50, 18, 58, 26 },
+    { 12, 44,  4, 36, 14, 46,  6, 38 },
+    { 60, 28, 52, 20, 62, 30, 54, 22 },
+    {  3, 35, 11, 43,  1, 33,  9, 41 },
+    { 51, 19, 59, 27, 49, 17, 57, 25 },
+    { 15, 47,  7, 39, 13, 45,  5, 37 },
+    { 63, 31, 55, 23, 61, 29, 53, 21 },
+};
+
+/* Dithering scatters colours all over the exact tables, so every lookup
+ * would be a cache miss. Instead, dithered colours are matched at the small
+ * table's resolution, which the dithering itself hides. These tables are
+ * filled in lazily, like exact_table. */
+typedef enum {
+    COARSE_256, COARSE_LAB_256, COARSE_LAB_8, N_COARSE_TABLES,
+} CoarseTable;
+
+static uint16_t coarse_tables[N_COARSE_TABLES][TABLE_SIZE];
+
+/* How each Ditherer matches colours. */
+typedef enum {
+    MATCH_COARSE_256, MATCH_COARSE_LAB_256, MATCH_COARSE_LAB_8,
+    MATCH_SMALL_TABLE, MATCH_ANSI,
+} Match;
+
+static Match choose_match(const struct Ditherer *ditherer) {
+    if (ditherer->colours == PALETTE_8) {
+        if (ditherer->backend == Q_PERCEPTUAL) {
+            pthread_once(&lab_palettes_once, build_lab_palettes);
+            return MATCH_COARSE_LAB_8;
+        }
+        return MATCH_ANSI;
+    }
+
+    switch (ditherer->backend) {
+        case Q_TABLE:
+            pthread_once(&small_table_once, build_small_table);
+            return MATCH_SMALL_TABLE;
+        case Q_PERCEPTUAL:
+            pthread_once(&lab_palettes_once, build_lab_palettes);
+            return MATCH_COARSE_LAB_256;
+        case Q_EXACT:
+        case Q_TREE:
+            break;
+    }
+    return MATCH_COARSE_256;
+}
+
+static uint8_t search_coarse(CoarseTable table, int i) {
+    const int shift = 8 - TABLE_BITS;
+    /* Look up the centre of each bucket, like build_small_table(). */
+    const int half_bucket = 1 << (shift - 1);
+    const int mask = (1 << TABLE_BITS) - 1;
+    uint8_t red = ((i >> (2 * TABLE_BITS)) & mask) << shift | half_bucket;
+    uint8_t green = ((i >> TABLE_BITS) & mask) << shift | half_bucket;
+    uint8_t blue = (i & mask) << shift | half_bucket;
+
+    switch (table) {
+        case COARSE_LAB_256:
+            return search_lab_palette(&lab_palette_256, red, green, blue);
+        case COARSE_LAB_8:
+            return search_lab_palette(&lab_palette_8, red, green, blue);
+        default:
+            return quantize_tree(red, green, blue);
+    }
+}
+
+static inline uint8_t lookup_coarse(CoarseTable table,
+                                    uint8_t red, uint8_t green, uint8_t blue) {
+    const int shift = 8 - TABLE_BITS;
+    int i = ((red >> shift) << (2 * TABLE_BITS))
+          | ((green >> shift) << TABLE_BITS)
+          | (blue >> shift);
+
+    uint16_t entry = __atomic_load_n(&coarse_tables[table][i], __ATOMIC_RELAXED);
+    if (entry == 0) {
+        entry = search_coarse(table, i) + 1;
+        __atomic_store_n(&coarse_tables[table][i], entry, __ATOMIC_RELAXED);
+    }
+    return entry - 1;
+}
+
+/* Inlined into both loops below. The switch always goes the same way within
+ * a row, so it costs next to nothing. */
+static inline uint8_t closest(Match match, uint8_t red, uint8_t green, uint8_t blue) {
+    switch (match) {
+        case MATCH_COARSE_256:
+            return lookup_coarse(COARSE_256, red, green, blue);
+        case MATCH_COARSE_LAB_256:
+            return lookup_coarse(COARSE_LAB_256, red, green, blue);
+        case MATCH_COARSE_LAB_8:
+            return lookup_coarse(COARSE_LAB_8, red, green, blue);
+        case MATCH_SMALL_TABLE:
+            return lookup_small_table(red, green, blue);
+        case MATCH_ANSI:
+            break;
+    }
+    return (red > ANSI_THRESHOLD)
+         | (green > ANSI_THRESHOLD) << 1
+         | (blue > ANSI_THRESHOLD) << 2;
+}
+
+static inline uint8_t clamp_channel(int value) {
+    return value < 0 ? 0 : value > 255 ? 255 : value;
+}
+
+bool ditherer_init(struct Ditherer *ditherer, Dither dither, Quantizer backend,
+                   int colours, int width) {
+    assert(colours == PALETTE_8 || colours == PALETTE_256);
+    *ditherer = (struct Ditherer) {
+        .dither = dither,
+        .backend = backend,
+        .colours = colours,
+        .width = width,
+        .error = NULL,
+    };
+    pthread_once(&palette_rgb_once, build_palette_rgb);
+
+    if (dither == D_DIFFUSION) {
+        ditherer->error = calloc(NUM_CHANNELS * (size_t) width, sizeof(int16_t));
+        return ditherer->error != NULL;
+    }
+    return true;
+}
+
+void ditherer_free(struct Ditherer *ditherer) {
+    free(ditherer->error);
+    ditherer->error = NULL;
+}
+
+static void dither_row_ordered(const struct Ditherer *ditherer, Match match,
+                               const uint8_t *pixels, int y, uint8_t *indices) {
+    const int spread = ditherer->colours == PALETTE_8 ? ORDERED_SPREAD_8 : ORDERED_SPREAD_256;
+    int offsets[8];
+
+    /* Centred on zero, so that flat areas are just as bright on average. */
+    for (int i = 0; i < 8; i++) {
+        offsets[i] = (2 * bayer_8x8[y % 8][i] - 63) * spread / 128;
+    }
+
+    for (int x = 0; x < ditherer->width; x++, pixels += 4) {
+        int offset = offsets[x % 8];
+        indices[x] = closest(match,
+                             clamp_channel(pixels[0] + offset),
+                             clamp_channel(pixels[1] + offset),
+                             clamp_channel(pixels[2] + offset));
+    }
+}
+
+/**
+ * Adds the error owed to one channel of a pixel: whatever the row above left
+ * it, plus 7/16 of the previous pixel's.
+ */
+static inline uint8_t diffuse(uint8_t value, int16_t owed, int previous) {
+    return clamp_channel(value + (owed + 7 * previous) / ERROR_SCALE);
+}
+
+/**
+ * Floyd-Steinberg: each pixel's error goes 7/16 to the next pixel, and 3/16,
+ * 5/16, and 1/16 to the three pixels below, behind to ahead.
+ *
+ * Each pixel depends on the one before it, so this is one long chain of
+ * arithmetic and lookups. To keep it short, the previous two pixels' errors
+ * stay in registers (one channel at a time, so that they really do), and
+ * what a pixel owes the row below is only written once it's complete: when
+ * the pixel after it is done.
+ */
+static void dither_row_diffusion(struct Ditherer *ditherer, Match match,
+                                 const uint8_t *pixels, int y, uint8_t *indices) {
+    const int width = ditherer->width;
+    int16_t *error = ditherer->error;
+
+    if (y == 0) {
+        memset(error, 0, NUM_CHANNELS * (size_t) width * sizeof(int16_t));
+    }
+
+    /* Alternate directions, so that the error doesn't always drift the same
+     * way and leave diagonal streaks. */
+    const int step = y % 2 == 0 ? 1 : -1;
+    int x = step > 0 ? 0 : width - 1;
+    /* The errors of the previous pixel and the one before it. */
+    int previous_red = 0, previous_green = 0, previous_blue = 0;
+    int before_red = 0, before_green = 0, before_blue = 0;
+
+    for (int n = 0; n < width; n++, x += step) {
+        const uint8_t *pixel = pixels + 4 * (size_t) x;
+        int16_t *owed = error + NUM_CHANNELS * x;
+
+        uint8_t red = diffuse(pixel[0], owed[0], previous_red);
+        uint8_t green = diffuse(pixel[1], owed[1], previous_green);
+        uint8_t blue = diffuse(pixel[2], owed[2], previous_blue);
+        uint8_t index = closest(match, red, green, blue);
+        indices[x] = index;
+
+        const RGB_Tuple *chosen = &palette_rgb[index];
+        int red_error = red - chosen->channel.red;
+        int green_error = green - chosen->channel.green;
+        int blue_error = blue - chosen->channel.blue;
+
+        /* The previous pixel now has everything it's owed from above. */
+        if (n > 0) {
+            int16_t *behind = owed - NUM_CHANNELS * step;
+            behind[0] = before_red + 5 * previous_red + 3 * red_error;
+            behind[1] = before_green + 5 * previous_green + 3 * green_error;
+            behind[2] = before_blue + 5 * previous_blue + 3 * blue_error;
+        }
+        before_red = previous_red;
+        before_green = previous_green;
+        before_blue = previous_blue;
+        previous_red = red_error;
+        previous_green = green_error;
+        previous_blue = blue_error;
+    }
+
+    /* Nothing comes after the last pixel, which is wherever x stepped back
+     * from. Error that would fall off either edge is dropped. */
+    if (width > 0) {
+        int16_t *last = error + NUM_CHANNELS * (x - step);
+        last[0] = before_red + 5 * previous_red;
+        last[1] = before_green + 5 * previous_green;
+        last[2] = before_blue + 5 * previous_blue;
+    }
+}
+
+void dither_row(struct Ditherer *ditherer, const uint8_t *pixels, int y,
+                uint8_t *indices) {
+    Match match = choose_match(ditherer);
+
+    switch (ditherer->dither) {
+        case D_NONE:
+            if (ditherer->colours == PALETTE_8) {
+                if (ditherer->backend == Q_PERCEPTUAL) {
+                    quantize_row_8_perceptual(pixels, ditherer->width, indices);
+                } else {
+                    quantize_row_8(pixels, ditherer->width, indices);
+                }
+            } else {
+                quantize_row_256(ditherer->backend, pixels, ditherer->width, indices);
+            }
+            return;
+        case D_ORDERED:
+            dither_row_ordered(ditherer, match, pixels, y, indices);
+            return;
+        case D_DIFFUSION:
+            dither_row_diffusion(ditherer, match, pixels, y, indices);
+            return;
+    }
+
+    assert(0 && "Not a valid dither.");
+}
@@ -0,0 +1,132 @@
+/*
+ * Copyright (c) 2026 Eddie Antonio Santos <hello@eddieantonio.ca>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/**
+ * @file quantize.h
+ * @brief Maps 24-bit colours onto the xterm 256 colour palette.
+ */
+
+#ifndef QUANTIZE_H
+#define QUANTIZE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * How to find the closest palette entry for a colour.
+ */
+typedef enum {
+    /* Full 2^24 entry table, filled in lazily as colours are looked up.
+     * Gives exactly the same answers as Q_TREE. This is the default. */
+    Q_EXACT,
+    /* 2^15 entry table indexed by the top five bits of each channel.
+     * Small and fast, but only approximates the tree. */
+    Q_TABLE,
+    /* Walk the k-d tree for every single lookup. */
+    Q_TREE,
+    /* Like Q_EXACT, but "closest" is measured in CIELAB (CIE76), which is
+     * much closer to how different the colours look. Also applies to the
+     * 8 colour palette. */
+    Q_PERCEPTUAL,
+} Quantizer;
+
+/**
+ * How to hide the difference between each pixel and its palette colour.
+ */
+typedef enum {
+    /* None: every pixel simply gets its closest colour. This is the
+     * default. */
+    D_NONE,
+    /* Nudge each pixel by an 8x8 Bayer pattern before matching it. Pixels
+     * don't depend on one another, so rows can be done in any order. */
+    D_ORDERED,
+    /* Floyd-Steinberg error diffusion, in serpentine order. Each row
+     * depends on the one above it, so rows must be done in order. */
+    D_DIFFUSION,
+} Dither;
+
+/**
+ * Returns the index of the closest xterm 256 colour.
+ */
+typedef uint8_t (*QuantizeFunc)(uint8_t red, uint8_t green, uint8_t blue);
+
+/**
+ * Returns the lookup function for the given backend. Any tables that the
+ * backend needs are built on first use.
+ */
+QuantizeFunc quantizer_256(Quantizer backend);
+
+/**
+ * Writes the red, green, and blue of an xterm colour into rgb.
+ */
+void palette_rgb_256(uint8_t index, uint8_t rgb[3]);
+
+/**
+ * Writes the xterm 256 colour index of each pixel in a row of 32bpp pixels.
+ */
+void quantize_row_256(Quantizer backend, const uint8_t *pixels, int width,
+                      uint8_t *indices);
+
+/**
+ * Writes the ANSI colour index (0–7) of each pixel in a row of 32bpp pixels.
+ * The index is the same as the offset from the SGR code 30 or 40.
+ */
+void quantize_row_8(const uint8_t *pixels, int width, uint8_t *indices);
+
+/**
+ * Like quantize_row_8(), but matched like Q_PERCEPTUAL, against the colours
+ * xterm uses for the 8 ANSI colours.
+ */
+void quantize_row_8_perceptual(const uint8_t *pixels, int width, uint8_t *indices);
+
+/**
+ * Dithers rows of 32bpp pixels onto the 8 or 256 colour palette.
+ *
+ * Error diffusion only ever needs the error owed to the current row and the
+ * next. That's kept in a single row of fixed point, which is overwritten as
+ * it's used, so it stays in cache no matter how big the image is.
+ */
+struct Ditherer {
+    Dither dither;
+    Quantizer backend;
+    /* 8 or 256. */
+    int colours;
+    int width;
+    /* D_DIFFUSION only: error for each channel of each pixel, in
+     * sixteenths. Pixels already dithered in the current row hold what they
+     * owe the row below; the rest, what the row above owes them. */
+    int16_t *error;
+};
+
+/**
+ * Initializes a Ditherer for rows width pixels wide. Returns false if memory
+ * could not be allocated.
+ */
+bool ditherer_init(struct Ditherer *ditherer, Dither dither, Quantizer backend,
+                   int colours, int width);
+void ditherer_free(struct Ditherer *ditherer);
+
+/**
+ * Writes the palette index of each pixel in row y of an image, like
+ * quantize_row_256() or quantize_row_8(), but dithered.
+ *
+ * With D_DIFFUSION, rows must be given in order. Row 0 starts afresh, so the
+ * same Ditherer can be used for one image (or frame) after another.
+ */
+void dither_row(struct Ditherer *ditherer, const uint8_t *pixels, int y,
+                uint8_t *indices);
+
+#endif /* QUANTIZE_H */
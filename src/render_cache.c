@@ -0,0 +1,555 @@
+/*
+ * Copyright (c) 2026 Eddie Antonio Santos <hello@eddieantonio.ca>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+
+/**
+ * @file render_cache.c
+ * @brief Entries are plain files named by their key; LRU order is their mtime.
+ *
+ * A miss renders into a temporary file in the cache directory, which is then
+ * sent to output_fd and renamed into place, so other imgcats never see half
+ * an entry. A hit touches its entry's mtime, so eviction can delete the
+ * least recently printed entries first. Names starting with a dot (the
+ * temporary files and the hit/miss totals) are never entries.
+ */
+
+/* Feature-test macros for flock(2), futimens(2), and mkstemp(3). */
+#define _DEFAULT_SOURCE
+#define _XOPEN_SOURCE 700
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/sendfile.h>
+#endif
+
+#include "render_cache.h"
+#include "config.h"
+#include "hash.h"
+
+static const char stats_name[] = ".stats";
+static const char temporary_template[] = ".tmp-XXXXXX";
+
+enum {
+    /* Two 64-bit hashes in hex, a dash, and another 64-bit hash. */
+    KEY_LEN = 16 + 16 + 1 + 16,
+    COPY_CHUNK_LEN = 64 * 1024,
+};
+
+struct RenderCache {
+    char *directory;
+    size_t max_bytes;
+    /* This run's tally, added to the stats file on close. */
+    uint64_t hits, misses;
+};
+
+struct Entry {
+    char name[KEY_LEN + 1];
+    struct timespec last_used;
+    off_t size;
+};
+
+static bool make_directories(char *path);
+static bool cache_key(const PrintRequest *, const uint8_t *data, size_t length, char key[KEY_LEN + 1]);
+static char *cache_path(const struct RenderCache *, const char *name);
+static bool print_hit(int fd, PrintRequest *request);
+static bool print_miss(struct RenderCache *, PrintRequest *, const uint8_t *data, size_t length, const char *key);
+static bool send_file(int in, int out, off_t size);
+static bool copy_file(int in, int out, off_t offset, off_t size);
+static void wait_until_writable(int fd);
+static size_t list_entries(const struct RenderCache *, struct Entry **entries);
+static void evict(struct RenderCache *);
+static int compare_last_used(const void *a, const void *b);
+static int lock_stats(const struct RenderCache *, int operation);
+static void read_stats(int fd, uint64_t *hits, uint64_t *misses);
+
+
+struct RenderCache *render_cache_open(const char *directory, size_t max_bytes) {
+    struct RenderCache *cache = calloc(1, sizeof(struct RenderCache));
+    if (cache == NULL) {
+        return NULL;
+    }
+
+    cache->directory = strdup(directory);
+    cache->max_bytes = max_bytes;
+    if (cache->directory == NULL || !make_directories(cache->directory)) {
+        int error = errno;
+        free(cache->directory);
+        free(cache);
+        errno = error;
+        return NULL;
+    }
+
+    return cache;
+}
+
+void render_cache_close(struct RenderCache *cache) {
+    if (cache->hits > 0 || cache->misses > 0) {
+        int fd = lock_stats(cache, LOCK_EX);
+        if (fd != -1) {
+            uint64_t hits, misses;
+            char totals[64];
+
+            read_stats(fd, &hits, &misses);
+            int length = snprintf(totals, sizeof(totals), "%" PRIu64 " %" PRIu64 "\n",
+                                  hits + cache->hits, misses + cache->misses);
+            if (ftruncate(fd, 0) == 0) {
+                (void) !pwrite(fd, totals, length, 0);
+            }
+            close(fd);
+        }
+    }
+
+    free(cache->directory);
+    free(cache);
+}
+
+bool render_cache_print(struct RenderCache *cache, PrintRequest *request) {
+    /* Animations are timed, so there's no one byte stream to save; and the
+     * terminal deletes kitty images' files once it's read them. */
+    if (request->animate || (request->format == F_KITTY && request->kitty_medium != K_DIRECT)) {
+        return print_image(request);
+    }
+
+    /* The key needs all of the image's contents, so map files in. Reading
+     * whatever's mapped is also how the image gets printed on a miss, which
+     * means the image can't change between hashing and rendering it. */
+    const uint8_t *data = request->data;
+    size_t length = request->data_length;
+    void *mapped = MAP_FAILED;
+    if (data == NULL) {
+        int fd = open(request->filename, O_RDONLY);
+        struct stat st;
+        if (fd == -1) {
+            return false;
+        }
+        if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+            mapped = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        }
+        close(fd);
+        if (mapped == MAP_FAILED) {
+            return print_image(request);
+        }
+        data = mapped;
+        length = st.st_size;
+    }
+
+    bool success;
+    char key[KEY_LEN + 1];
+    char *path = NULL;
+    int fd = -1;
+
+    if (!cache_key(request, data, length, key) || (path = cache_path(cache, key)) == NULL) {
+        success = print_image(request);
+    } else if ((fd = open(path, O_RDONLY)) != -1) {
+        cache->hits++;
+        success = print_hit(fd, request);
+        close(fd);
+    } else {
+        cache->misses++;
+        success = print_miss(cache, request, data, length, key);
+    }
+
+    free(path);
+    if (mapped != MAP_FAILED) {
+        munmap(mapped, length);
+    }
+    return success;
+}
+
+bool render_cache_clear(struct RenderCache *cache) {
+    struct Entry *entries;
+    size_t count = list_entries(cache, &entries);
+    bool success = true;
+
+    for (size_t i = 0; i < count; i++) {
+        char *path = cache_path(cache, entries[i].name);
+        if (path == NULL || (unlink(path) == -1 && errno != ENOENT)) {
+            success = false;
+        }
+        free(path);
+    }
+    free(entries);
+
+    char *path = cache_path(cache, stats_name);
+    if (path == NULL || (unlink(path) == -1 && errno != ENOENT)) {
+        success = false;
+    }
+    free(path);
+
+    cache->hits = cache->misses = 0;
+    return success;
+}
+
+bool render_cache_stats(struct RenderCache *cache, struct RenderCacheStats *stats) {
+    struct Entry *entries;
+    size_t count = list_entries(cache, &entries);
+
+    *stats = (struct RenderCacheStats) {
+        .hits = cache->hits,
+        .misses = cache->misses,
+        .entries = count,
+    };
+    for (size_t i = 0; i < count; i++) {
+        stats->bytes += entries[i].size;
+    }
+    free(entries);
+
+    int fd = lock_stats(cache, LOCK_SH);
+    if (fd == -1) {
+        return false;
+    }
+    uint64_t hits, misses;
+    read_stats(fd, &hits, &misses);
+    close(fd);
+
+    stats->hits += hits;
+    stats->misses += misses;
+    return true;
+}
+
+/**
+ * Creates path and all of its parents, like mkdir -p. path is modified
+ * along the way, but restored before returning.
+ */
+static bool make_directories(char *path) {
+    for (char *slash = strchr(path + 1, '/'); slash != NULL; slash = strchr(slash + 1, '/')) {
+        *slash = '\0';
+        int result = mkdir(path, 0755);
+        *slash = '/';
+        if (result == -1 && errno != EEXIST) {
+            return false;
+        }
+    }
+
+    if (mkdir(path, 0755) == -1 && errno != EEXIST) {
+        return false;
+    }
+
+    struct stat st;
+    if (stat(path, &st) == -1) {
+        return false;
+    } else if (!S_ISDIR(st.st_mode)) {
+        errno = ENOTDIR;
+        return false;
+    }
+    return true;
+}
+
+/**
+ * The key is the hash of the image's contents, followed by the hash of
+ * everything in the request that changes what gets printed. The version is
+ * in there too, so that upgrading imgcat doesn't serve stale output.
+ */
+static bool cache_key(const PrintRequest *request, const uint8_t *data, size_t length,
+                      char key[KEY_LEN + 1]) {
+    char parameters[256];
+    int parameters_length = snprintf(parameters, sizeof(parameters),
+            "imgcat %s format=%d max=%dx%d desired=%dx%d blocks=%d "
+            "preserve_aspect_ratio=%d quantizer=%d dither=%d emission=%d kitty_medium=%d "
+            "compact=%d max_bytes=%zu",
+            PACKAGE_VERSION, request->format,
+            request->max_width, request->max_height,
+            request->desired_width, request->desired_height,
+            request->blocks, request->preserve_aspect_ratio,
+            request->quantizer, request->dither, request->emission,
+            request->kitty_medium, request->compact_escapes, request->max_bytes);
+    if (parameters_length < 0 || (size_t) parameters_length >= sizeof(parameters)) {
+        return false;
+    }
+
+    struct Hash128 contents = hash128(data, length, 0);
+    struct Hash128 settings = hash128(parameters, parameters_length, 0);
+    snprintf(key, KEY_LEN + 1, "%016" PRIx64 "%016" PRIx64 "-%016" PRIx64,
+             contents.high, contents.low, settings.high);
+    return true;
+}
+
+/**
+ * Returns a malloc'd path to name in the cache directory.
+ */
+static char *cache_path(const struct RenderCache *cache, const char *name) {
+    size_t size = strlen(cache->directory) + 1 + strlen(name) + 1;
+    char *path = malloc(size);
+    if (path != NULL) {
+        snprintf(path, size, "%s/%s", cache->directory, name);
+    }
+    return path;
+}
+
+static bool print_hit(int fd, PrintRequest *request) {
+    struct stat st;
+    if (fstat(fd, &st) == -1) {
+        return false;
+    }
+
+    /* Mark it as recently used, so it's the last to be evicted. */
+    futimens(fd, NULL);
+
+    /* Anything already in stdio's buffer must go out before we write(2). */
+    fflush(stdout);
+    request->bytes_written = st.st_size;
+    return send_file(fd, request->output_fd, st.st_size);
+}
+
+static bool print_miss(struct RenderCache *cache, PrintRequest *request,
+                       const uint8_t *data, size_t length, const char *key) {
+    char *temporary = cache_path(cache, temporary_template);
+    char *path = cache_path(cache, key);
+    int fd = -1;
+    bool success;
+
+    if (temporary == NULL || path == NULL || (fd = mkstemp(temporary)) == -1) {
+        /* The cache is broken, but the image might be just fine. */
+        free(temporary);
+        free(path);
+        return print_image(request);
+    }
+
+    PrintRequest render = *request;
+    render.data = data;
+    render.data_length = length;
+    render.output_fd = fd;
+    success = print_image(&render);
+    request->bytes_written = render.bytes_written;
+
+    /* Only keep complete renders that fit in the cache at all. */
+    bool keep = success && render.bytes_written <= cache->max_bytes
+        && fsync(fd) == 0 && rename(temporary, path) == 0;
+    if (!keep) {
+        unlink(temporary);
+    }
+
+    if (success) {
+        fflush(stdout);
+        success = send_file(fd, request->output_fd, render.bytes_written);
+    }
+
+    close(fd);
+    free(temporary);
+    free(path);
+
+    if (keep) {
+        evict(cache);
+    }
+    return success;
+}
+
+/**
+ * Writes the first size bytes of in to out.
+ */
+static bool send_file(int in, int out, off_t size) {
+#ifdef __linux__
+    off_t offset = 0;
+    while (offset < size) {
+        ssize_t sent = sendfile(out, in, &offset, size - offset);
+        if (sent > 0) {
+            continue;
+        } else if (sent == 0) {
+            /* Somebody truncated the file. */
+            return false;
+        } else if (errno == EINTR) {
+            continue;
+        } else if (errno == EAGAIN) {
+            wait_until_writable(out);
+            continue;
+        } else if (errno == EINVAL || errno == ENOSYS) {
+            /* out is something sendfile(2) can't write to. */
+            return copy_file(in, out, offset, size);
+        }
+        return false;
+    }
+    return true;
+#else
+    return copy_file(in, out, 0, size);
+#endif
+}
+
+/**
+ * Like send_file(), from offset onwards, with plain read(2) and write(2).
+ */
+static bool copy_file(int in, int out, off_t offset, off_t size) {
+    char *buffer = malloc(COPY_CHUNK_LEN);
+    if (buffer == NULL) {
+        return false;
+    }
+
+    while (offset < size) {
+        size_t wanted = size - offset < COPY_CHUNK_LEN ? size - offset : COPY_CHUNK_LEN;
+        ssize_t length = pread(in, buffer, wanted, offset);
+        if (length < 0 && errno == EINTR) {
+            continue;
+        } else if (length <= 0) {
+            break;
+        }
+
+        for (ssize_t written = 0; written < length;) {
+            ssize_t result = write(out, buffer + written, length - written);
+            if (result < 0) {
+                if (errno == EINTR) {
+                    continue;
+                } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                    wait_until_writable(out);
+                    continue;
+                }
+                free(buffer);
+                return false;
+            }
+            written += result;
+        }
+        offset += length;
+    }
+
+    free(buffer);
+    return offset == size;
+}
+
+static void wait_until_writable(int fd) {
+    struct pollfd pfd = { .fd = fd, .events = POLLOUT };
+    while (poll(&pfd, 1, -1) == -1 && errno == EINTR) {
+        /* Try again. */
+    }
+}
+
+/**
+ * Points *entries at a malloc'd array of everything in the cache, and
+ * returns how many there are.
+ */
+static size_t list_entries(const struct RenderCache *cache, struct Entry **entries) {
+    size_t count = 0, capacity = 0;
+    *entries = NULL;
+
+    DIR *dir = opendir(cache->directory);
+    if (dir == NULL) {
+        return 0;
+    }
+
+    struct dirent *dirent;
+    while ((dirent = readdir(dir)) != NULL) {
+        struct stat st;
+        if (dirent->d_name[0] == '.' || strlen(dirent->d_name) != KEY_LEN
+                || fstatat(dirfd(dir), dirent->d_name, &st, 0) == -1
+                || !S_ISREG(st.st_mode)) {
+            continue;
+        }
+
+        if (count == capacity) {
+            capacity = capacity ? capacity * 2 : 64;
+            struct Entry *bigger = realloc(*entries, capacity * sizeof(struct Entry));
+            if (bigger == NULL) {
+                break;
+            }
+            *entries = bigger;
+        }
+
+        struct Entry *entry = &(*entries)[count++];
+        memcpy(entry->name, dirent->d_name, KEY_LEN + 1);
+        entry->last_used = st.st_mtim;
+        entry->size = st.st_size;
+    }
+
+    closedir(dir);
+    return count;
+}
+
+/**
+ * Deletes the least recently used entries until the cache fits in its
+ * budget.
+ */
+static void evict(struct RenderCache *cache) {
+    struct Entry *entries;
+    size_t count = list_entries(cache, &entries);
+    uint64_t total = 0;
+
+    for (size_t i = 0; i < count; i++) {
+        total += entries[i].size;
+    }
+
+    if (total > cache->max_bytes) {
+        qsort(entries, count, sizeof(struct Entry), compare_last_used);
+        for (size_t i = 0; i < count && total > cache->max_bytes; i++) {
+            char *path = cache_path(cache, entries[i].name);
+            /* If somebody else evicted it first, it's still gone. */
+            if (path != NULL && (unlink(path) == 0 || errno == ENOENT)) {
+                total -= entries[i].size;
+            }
+            free(path);
+        }
+    }
+
+    free(entries);
+}
+
+static int compare_last_used(const void *a, const void *b) {
+    const struct timespec *x = &((const struct Entry *) a)->last_used;
+    const struct timespec *y = &((const struct Entry *) b)->last_used;
+
+    if (x->tv_sec != y->tv_sec) {
+        return x->tv_sec < y->tv_sec ? -1 : 1;
+    }
+    return (x->tv_nsec > y->tv_nsec) - (x->tv_nsec < y->tv_nsec);
+}
+
+/**
+ * Opens the hit/miss totals, and locks them with flock(2). Several imgcats
+ * may share a cache, so the totals may only be changed with LOCK_EX held.
+ */
+static int lock_stats(const struct RenderCache *cache, int operation) {
+    char *path = cache_path(cache, stats_name);
+    if (path == NULL) {
+        return -1;
+    }
+
+    int fd = open(path, O_RDWR | O_CREAT, 0644);
+    free(path);
+    if (fd == -1) {
+        return -1;
+    }
+
+    while (flock(fd, operation) == -1) {
+        if (errno != EINTR) {
+            close(fd);
+            return -1;
+        }
+    }
+    return fd;
+}
+
+/**
+ * The totals are stored as text: "HITS MISSES\n". Anything unreadable
+ * counts as zero.
+ */
+static void read_stats(int fd, uint64_t *hits, uint64_t *misses) {
+    char totals[64];
+    ssize_t length = pread(fd, totals, sizeof(totals) - 1, 0);
+
+    *hits = *misses = 0;
+    if (length > 0) {
+        totals[length] = '\0';
+        if (sscanf(totals, "%" SCNu64 " %" SCNu64, hits, misses) != 2) {
+            *hits = *misses = 0;
+        }
+    }
+}
@@ -0,0 +1,83 @@
+/*
+ * Copyright (c) 2026 Eddie Antonio Santos <hello@eddieantonio.ca>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+
+/**
+ * @file render_cache.h
+ * @brief An on-disk cache of everything print_image() has printed before.
+ *
+ * Each entry is the exact byte stream printed for one image with one set of
+ * PrintRequest parameters. Its name is a hash of the image's contents and of
+ * those parameters, so a changed image or a different terminal is simply a
+ * miss. Printing a hit is a single sendfile(2) from the entry to output_fd.
+ *
+ * Usage:
+ *
+ * Open the cache with render_cache_open(), print images through it with
+ * render_cache_print(), then render_cache_close() it, which also adds this
+ * run's hits and misses to the cache's running totals.
+ */
+
+#ifndef RENDER_CACHE_H
+#define RENDER_CACHE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "print_image.h"
+
+struct RenderCache;
+
+struct RenderCacheStats {
+    /* Running totals for every run that used the cache... */
+    uint64_t hits, misses;
+    /* ...and what's in the cache right now. */
+    uint64_t entries, bytes;
+};
+
+/**
+ * Opens the cache in directory, creating it if necessary. When an image is
+ * added, the least recently printed entries are evicted until the whole
+ * cache fits in max_bytes. Returns NULL (and sets errno) on failure.
+ */
+struct RenderCache *render_cache_open(const char *directory, size_t max_bytes);
+
+/**
+ * Prints the image like print_image(), but from the cache when it's been
+ * printed before; otherwise, it's added to the cache as it's printed.
+ *
+ * Images that can't be cached (animations, or files that can't be mapped
+ * into memory, like named pipes) are printed by print_image() as usual.
+ */
+bool render_cache_print(struct RenderCache *cache, PrintRequest *request);
+
+/**
+ * Deletes every entry and resets the hit and miss totals.
+ */
+bool render_cache_clear(struct RenderCache *cache);
+
+/**
+ * Fills in stats, including this run's hits and misses so far.
+ */
+bool render_cache_stats(struct RenderCache *cache, struct RenderCacheStats *stats);
+
+/**
+ * Saves this run's hits and misses, and frees the cache.
+ */
+void render_cache_close(struct RenderCache *cache);
+
+#endif /* RENDER_CACHE_H */
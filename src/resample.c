@@ -0,0 +1,473 @@
+/*
+ * Copyright (c) 2026 Eddie Antonio Santos <hello@eddieantonio.ca>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+
+/**
+ * @file resample.c
+ * @brief Separable, fixed-point area-average resampling.
+ *
+ * Each row is first shrunk horizontally into 16-bit values with 7 fractional
+ * bits, and then accumulated vertically into 32-bit sums. Weights are
+ * fractions of WEIGHT_ONE, so that every destination pixel's weights add up
+ * to exactly one.
+ *
+ * When a dimension shrinks by a whole number, every source pixel has the
+ * same weight, so the weights are skipped and the plain sum is divided once
+ * at the end. Vertically, that's only done while the plain sums fit in 32
+ * bits; taller ratios fall back to the weights.
+ */
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "resample.h"
+
+enum {
+    WEIGHT_BITS = 14,
+    WEIGHT_ONE = 1 << WEIGHT_BITS,
+    /* Fractional bits kept after the horizontal pass. 255 << 7 still fits
+     * in an int16_t, which the SIMD multiplies need. */
+    FRACTION_BITS = 7,
+    CHANNELS = 4,
+    /* The vertical sums are plain when the ratio is whole; past this many
+     * rows a column of white would overflow them. */
+    MAX_VERTICAL_RATIO = INT32_MAX / (255 << FRACTION_BITS),
+};
+
+/**
+ * Which source pixels contribute to each destination pixel along one axis.
+ */
+struct Axis {
+    int src, dest;
+    /* Non-zero when src is a whole multiple of dest: every destination pixel
+     * is the plain average of `ratio` source pixels. */
+    int ratio;
+    /* Per destination pixel: */
+    int *first, *count, *offset;
+    /* Weights, packed back to back; see offset. */
+    int16_t *weights;
+};
+
+struct AreaResampler {
+    struct Axis horizontal, vertical;
+    /* The current source row, shrunk horizontally. */
+    int16_t *shrunk;
+    /* Sums for the two destination rows that a source row can touch. */
+    int32_t *sums[2];
+    /* The next source row to be pushed, and the next destination row to be
+     * finished. */
+    int src_y, dest_y;
+};
+
+static void axis_free(struct Axis *axis) {
+    free(axis->first);
+    free(axis->count);
+    free(axis->offset);
+    free(axis->weights);
+}
+
+/**
+ * Works out the weights. Coordinates are scaled by src * dest, so that
+ * destination pixel o covers [o * src, (o + 1) * src) and source pixel i
+ * covers [i * dest, (i + 1) * dest), and every overlap is a whole number.
+ */
+static bool axis_init(struct Axis *axis, int src, int dest) {
+    assert(dest > 0 && dest <= src);
+
+    *axis = (struct Axis) {
+        .src = src,
+        .dest = dest,
+        .ratio = src % dest == 0 ? src / dest : 0,
+        .first = malloc(dest * sizeof(int)),
+        .count = malloc(dest * sizeof(int)),
+        .offset = malloc(dest * sizeof(int)),
+        /* A destination pixel overlaps at most src / dest + 2 pixels. */
+        .weights = malloc(((size_t) src + 2 * (size_t) dest) * sizeof(int16_t)),
+    };
+    if (!axis->first || !axis->count || !axis->offset || !axis->weights) {
+        axis_free(axis);
+        return false;
+    }
+
+    int offset = 0;
+    for (int o = 0; o < dest; o++) {
+        int64_t low = (int64_t) o * src, high = (int64_t) (o + 1) * src;
+        int first = low / dest, last = (high - 1) / dest;
+        int total = 0, heaviest = offset;
+
+        for (int i = first; i <= last; i++) {
+            int64_t start = (int64_t) i * dest, end = start + dest;
+            int64_t overlap = (end < high ? end : high) - (start > low ? start : low);
+            int16_t weight = (overlap * WEIGHT_ONE + src / 2) / src;
+            axis->weights[offset + i - first] = weight;
+            total += weight;
+            if (weight > axis->weights[heaviest]) {
+                heaviest = offset + i - first;
+            }
+        }
+        /* Rounding may be off by a little; the heaviest can absorb it. */
+        axis->weights[heaviest] += WEIGHT_ONE - total;
+
+        axis->first[o] = first;
+        axis->count[o] = last - first + 1;
+        axis->offset[o] = offset;
+        offset += last - first + 1;
+    }
+
+    return true;
+}
+
+struct AreaResampler *area_resampler_new(int src_width, int src_height,
+                                         int dest_width, int dest_height) {
+    struct AreaResampler *resampler = calloc(1, sizeof(struct AreaResampler));
+    if (resampler == NULL) {
+        return NULL;
+    }
+
+    bool horizontal = axis_init(&resampler->horizontal, src_width, dest_width);
+    bool vertical = horizontal && axis_init(&resampler->vertical, src_height, dest_height);
+    if (!vertical) {
+        if (horizontal) {
+            axis_free(&resampler->horizontal);
+        }
+        free(resampler);
+        return NULL;
+    }
+    if (resampler->vertical.ratio > MAX_VERTICAL_RATIO) {
+        resampler->vertical.ratio = 0;
+    }
+
+    size_t row = (size_t) dest_width * CHANNELS;
+    resampler->shrunk = malloc(row * sizeof(int16_t));
+    resampler->sums[0] = calloc(row, sizeof(int32_t));
+    resampler->sums[1] = calloc(row, sizeof(int32_t));
+    if (!resampler->shrunk || !resampler->sums[0] || !resampler->sums[1]) {
+        area_resampler_free(resampler);
+        return NULL;
+    }
+
+    return resampler;
+}
+
+void area_resampler_free(struct AreaResampler *resampler) {
+    axis_free(&resampler->horizontal);
+    axis_free(&resampler->vertical);
+    free(resampler->shrunk);
+    free(resampler->sums[0]);
+    free(resampler->sums[1]);
+    free(resampler);
+}
+
+/*
+ * Horizontal pass: one 32bpp row into fixed-point pixels.
+ */
+
+#if defined(__SSE2__)
+static inline __m128i load_pixel(const uint8_t *pixel) {
+    int32_t value;
+    memcpy(&value, pixel, sizeof(value));
+    return _mm_cvtsi32_si128(value);
+}
+#endif
+
+static void shrink_row_weighted(const struct Axis *axis, const uint8_t *row,
+                                int16_t *out) {
+    for (int o = 0; o < axis->dest; o++, out += CHANNELS) {
+        const uint8_t *pixel = row + CHANNELS * axis->first[o];
+        const int16_t *weights = axis->weights + axis->offset[o];
+        const int count = axis->count[o];
+        int t = 0;
+
+#if defined(__SSE2__)
+        /* Two pixels at a time: interleave their channels as 16-bit values,
+         * so that one multiply-add does r0*w0 + r1*w1 and so on. */
+        const __m128i zero = _mm_setzero_si128();
+        __m128i sum = zero;
+        for (; t + 2 <= count; t += 2, pixel += 2 * CHANNELS) {
+            __m128i pair = _mm_unpacklo_epi8(load_pixel(pixel), load_pixel(pixel + CHANNELS));
+            __m128i weight = _mm_set1_epi32((uint16_t) weights[t] | (int32_t) weights[t + 1] << 16);
+            sum = _mm_add_epi32(sum, _mm_madd_epi16(_mm_unpacklo_epi8(pair, zero), weight));
+        }
+        if (t < count) {
+            __m128i single = _mm_unpacklo_epi8(_mm_unpacklo_epi8(load_pixel(pixel), zero), zero);
+            sum = _mm_add_epi32(sum, _mm_madd_epi16(single, _mm_set1_epi32((uint16_t) weights[t])));
+        }
+        const int shift = WEIGHT_BITS - FRACTION_BITS;
+        sum = _mm_srli_epi32(_mm_add_epi32(sum, _mm_set1_epi32(1 << (shift - 1))), shift);
+        _mm_storel_epi64((__m128i *) out, _mm_packs_epi32(sum, sum));
+#else
+        int32_t sum[CHANNELS] = { 0 };
+        for (; t < count; t++, pixel += CHANNELS) {
+            for (int c = 0; c < CHANNELS; c++) {
+                sum[c] += pixel[c] * weights[t];
+            }
+        }
+        const int shift = WEIGHT_BITS - FRACTION_BITS;
+        for (int c = 0; c < CHANNELS; c++) {
+            out[c] = (sum[c] + (1 << (shift - 1))) >> shift;
+        }
+#endif
+    }
+}
+
+static void shrink_row_exact(const struct Axis *axis, const uint8_t *row,
+                             int16_t *out) {
+    const int ratio = axis->ratio;
+    /* Dividing by ratio is a multiply and a shift. */
+    const uint64_t reciprocal = ((uint64_t) 1 << (32 + FRACTION_BITS)) / ratio;
+    const uint64_t half = (uint64_t) 1 << 31;
+
+    for (int o = 0; o < axis->dest; o++, out += CHANNELS) {
+        uint32_t sum[CHANNELS] = { 0 };
+        int t = 0;
+
+#if defined(__SSE2__)
+        /* Sum two pixels at a time in 16-bit lanes, spilling into 32 bits
+         * before they can overflow. */
+        const __m128i zero = _mm_setzero_si128();
+        while (t + 2 <= ratio) {
+            __m128i partial = zero;
+            int end = t + 2 * 128 < ratio ? t + 2 * 128 : ratio;
+            for (; t + 2 <= end; t += 2, row += 2 * CHANNELS) {
+                partial = _mm_add_epi16(partial,
+                        _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *) row), zero));
+            }
+            /* Fold the two pixels' lanes together. */
+            partial = _mm_add_epi16(partial, _mm_srli_si128(partial, 8));
+            uint16_t lanes[8];
+            _mm_storeu_si128((__m128i *) lanes, partial);
+            for (int c = 0; c < CHANNELS; c++) {
+                sum[c] += lanes[c];
+            }
+        }
+#endif
+        for (; t < ratio; t++, row += CHANNELS) {
+            for (int c = 0; c < CHANNELS; c++) {
+                sum[c] += row[c];
+            }
+        }
+
+        for (int c = 0; c < CHANNELS; c++) {
+            out[c] = (sum[c] * reciprocal + half) >> 32;
+        }
+    }
+}
+
+/*
+ * Horizontal pass, planar: one channel at a time, into every CHANNELS-th
+ * value. The sums and rounding are the same as above, so both give the
+ * same pixels.
+ */
+
+static void shrink_plane_weighted(const struct Axis *axis, const uint8_t *plane,
+                                  int16_t *out) {
+    const int shift = WEIGHT_BITS - FRACTION_BITS;
+
+    for (int o = 0; o < axis->dest; o++, out += CHANNELS) {
+        const uint8_t *pixel = plane + axis->first[o];
+        const int16_t *weights = axis->weights + axis->offset[o];
+        const int count = axis->count[o];
+        int32_t sum = 0;
+        int t = 0;
+
+#if defined(__SSE2__)
+        /* Eight pixels at a time, against their eight weights. */
+        if (count >= 8) {
+            const __m128i zero = _mm_setzero_si128();
+            __m128i sums = zero;
+            for (; t + 8 <= count; t += 8) {
+                __m128i values = _mm_unpacklo_epi8(
+                        _mm_loadl_epi64((const __m128i *) (pixel + t)), zero);
+                sums = _mm_add_epi32(sums, _mm_madd_epi16(values,
+                        _mm_loadu_si128((const __m128i *) (weights + t))));
+            }
+            sums = _mm_add_epi32(sums, _mm_srli_si128(sums, 8));
+            sums = _mm_add_epi32(sums, _mm_srli_si128(sums, 4));
+            sum = _mm_cvtsi128_si32(sums);
+        }
+#endif
+        for (; t < count; t++) {
+            sum += pixel[t] * weights[t];
+        }
+        *out = (sum + (1 << (shift - 1))) >> shift;
+    }
+}
+
+static void shrink_plane_exact(const struct Axis *axis, const uint8_t *plane,
+                               int16_t *out) {
+    const int ratio = axis->ratio;
+    const uint64_t reciprocal = ((uint64_t) 1 << (32 + FRACTION_BITS)) / ratio;
+    const uint64_t half = (uint64_t) 1 << 31;
+
+    for (int o = 0; o < axis->dest; o++, out += CHANNELS) {
+        uint32_t sum = 0;
+        int t = 0;
+
+#if defined(__SSE2__)
+        /* Sixteen bytes at a time, then eight: the sum of absolute
+         * differences from zero is the sum of each half, in two 64-bit
+         * lanes. */
+        if (ratio >= 8) {
+            const __m128i zero = _mm_setzero_si128();
+            __m128i sums = zero;
+            for (; t + 16 <= ratio; t += 16) {
+                sums = _mm_add_epi64(sums,
+                        _mm_sad_epu8(_mm_loadu_si128((const __m128i *) (plane + t)), zero));
+            }
+            if (t + 8 <= ratio) {
+                sums = _mm_add_epi64(sums,
+                        _mm_sad_epu8(_mm_loadl_epi64((const __m128i *) (plane + t)), zero));
+                t += 8;
+            }
+            sum = _mm_cvtsi128_si32(sums) + _mm_cvtsi128_si32(_mm_srli_si128(sums, 8));
+        }
+#endif
+        for (; t < ratio; t++) {
+            sum += plane[t];
+        }
+        plane += ratio;
+
+        *out = (sum * reciprocal + half) >> 32;
+    }
+}
+
+/**
+ * Fills in the channels a plane didn't provide, like interleave_row(): grey
+ * goes into all three colour channels, and a missing alpha is opaque.
+ */
+static void fill_channels(int16_t *shrunk, int length, int channels) {
+    const int16_t opaque = 255 << FRACTION_BITS;
+
+    for (int i = 0; i < length; i += CHANNELS) {
+        if (channels < 3) {
+            /* Grey, and maybe alpha in the second plane. */
+            shrunk[i + 3] = channels == 2 ? shrunk[i + 1] : opaque;
+            shrunk[i + 1] = shrunk[i + 2] = shrunk[i];
+        } else if (channels == 3) {
+            shrunk[i + 3] = opaque;
+        }
+    }
+}
+
+/*
+ * Vertical pass: fixed-point rows into sums, and sums into 32bpp rows.
+ */
+
+static void accumulate_row(const int16_t *shrunk, int length, int16_t weight,
+                           int32_t *sums) {
+    int i = 0;
+
+#if defined(__SSE2__)
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i weights = _mm_set1_epi32((uint16_t) weight);
+    for (; i + 8 <= length; i += 8) {
+        __m128i values = _mm_loadu_si128((const __m128i *) (shrunk + i));
+        /* Each value paired with a zero: the multiply-add is just value * w. */
+        __m128i low = _mm_madd_epi16(_mm_unpacklo_epi16(values, zero), weights);
+        __m128i high = _mm_madd_epi16(_mm_unpackhi_epi16(values, zero), weights);
+        __m128i *dest = (__m128i *) (sums + i);
+        _mm_storeu_si128(dest, _mm_add_epi32(_mm_loadu_si128(dest), low));
+        _mm_storeu_si128(dest + 1, _mm_add_epi32(_mm_loadu_si128(dest + 1), high));
+    }
+#endif
+
+    for (; i < length; i++) {
+        sums[i] += shrunk[i] * weight;
+    }
+}
+
+static void finish_row(const struct Axis *axis, int32_t *sums, int length,
+                       uint8_t *dest) {
+    if (axis->ratio) {
+        /* The sums have weight one each, so divide by the number of rows. */
+        const int64_t divisor = (int64_t) axis->ratio << FRACTION_BITS;
+        for (int i = 0; i < length; i++) {
+            int64_t value = (sums[i] + divisor / 2) / divisor;
+            dest[i] = value > 255 ? 255 : value;
+        }
+    } else {
+        const int shift = WEIGHT_BITS + FRACTION_BITS;
+        for (int i = 0; i < length; i++) {
+            int32_t value = (sums[i] + (1 << (shift - 1))) >> shift;
+            dest[i] = value > 255 ? 255 : value;
+        }
+    }
+
+    memset(sums, 0, length * sizeof(int32_t));
+}
+
+/**
+ * Adds the shrunk source row into the destination rows it's part of, and
+ * finishes the ones that it completes.
+ */
+static void push_shrunk(struct AreaResampler *resampler, uint8_t *dest) {
+    const struct Axis *vertical = &resampler->vertical;
+    const int length = resampler->horizontal.dest * CHANNELS;
+    const int y = resampler->src_y++;
+
+    assert(y < vertical->src);
+
+    /* When shrinking, a source row is part of one or two destination rows. */
+    for (int o = resampler->dest_y; o < vertical->dest && o <= resampler->dest_y + 1; o++) {
+        int t = y - vertical->first[o];
+        if (t < 0 || t >= vertical->count[o]) {
+            continue;
+        }
+        int16_t weight = vertical->ratio ? 1 : vertical->weights[vertical->offset[o] + t];
+        accumulate_row(resampler->shrunk, length, weight, resampler->sums[o & 1]);
+    }
+
+    /* Finish every destination row that this was the last source row of. */
+    while (resampler->dest_y < vertical->dest &&
+            vertical->first[resampler->dest_y] + vertical->count[resampler->dest_y] - 1 <= y) {
+        int o = resampler->dest_y++;
+        finish_row(vertical, resampler->sums[o & 1], length,
+                   dest + (size_t) o * length);
+    }
+}
+
+void area_resampler_push(struct AreaResampler *resampler, const uint8_t *row,
+                         uint8_t *dest) {
+    if (resampler->horizontal.ratio) {
+        shrink_row_exact(&resampler->horizontal, row, resampler->shrunk);
+    } else {
+        shrink_row_weighted(&resampler->horizontal, row, resampler->shrunk);
+    }
+    push_shrunk(resampler, dest);
+}
+
+void area_resampler_push_planes(struct AreaResampler *resampler,
+                                const uint8_t *const planes[], int channels,
+                                uint8_t *dest) {
+    assert(channels >= 1 && channels <= CHANNELS);
+
+    for (int c = 0; c < channels; c++) {
+        if (resampler->horizontal.ratio) {
+            shrink_plane_exact(&resampler->horizontal, planes[c], resampler->shrunk + c);
+        } else {
+            shrink_plane_weighted(&resampler->horizontal, planes[c], resampler->shrunk + c);
+        }
+    }
+    fill_channels(resampler->shrunk, resampler->horizontal.dest * CHANNELS, channels);
+    push_shrunk(resampler, dest);
+}
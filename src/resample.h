@@ -0,0 +1,77 @@
+/*
+ * Copyright (c) 2026 Eddie Antonio Santos <hello@eddieantonio.ca>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+
+/**
+ * @file resample.h
+ * @brief Shrinks 32bpp images by area-averaging, one source row at a time.
+ *
+ * Every destination pixel is the average of all of the source pixels it
+ * covers, weighted by how much of each it covers. Unlike sampling, this
+ * doesn't alias when thousands of pixels go into a hundred cells.
+ *
+ * Usage:
+ *
+ * Create an AreaResampler with area_resampler_new(), then push every source
+ * row to it, in order, with area_resampler_push(), or with
+ * area_resampler_push_planes() when the rows are planar. Destination rows are
+ * written to the destination image as soon as they're done. Finally, call
+ * area_resampler_free().
+ */
+
+#ifndef RESAMPLE_H
+#define RESAMPLE_H
+
+#ifdef __cplusplus
+#include <cstdint>
+extern "C" {
+#else
+#include <stdbool.h>
+#include <stdint.h>
+#endif
+
+struct AreaResampler;
+
+/**
+ * Makes a resampler from src_width x src_height to dest_width x dest_height.
+ * Only shrinking is supported: both destination dimensions must be no
+ * bigger than the source's. Returns NULL if memory could not be allocated.
+ */
+struct AreaResampler *area_resampler_new(int src_width, int src_height,
+                                         int dest_width, int dest_height);
+
+/**
+ * Takes the next source row of src_width 32bpp pixels. Finished rows are
+ * written into dest, a dest_width x dest_height 32bpp image.
+ */
+void area_resampler_push(struct AreaResampler *, const uint8_t *row,
+                         uint8_t *dest);
+
+/**
+ * Like area_resampler_push(), but takes the source row as one plane of
+ * src_width bytes per channel, as interleave_row() does: one channel is grey,
+ * two are grey and alpha, three are RGB and four are RGBA. Only the shrunk
+ * row is ever interleaved.
+ */
+void area_resampler_push_planes(struct AreaResampler *, const uint8_t *const planes[],
+                                int channels, uint8_t *dest);
+
+void area_resampler_free(struct AreaResampler *);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+#endif /* RESAMPLE_H */
@@ -114,6 +114,11 @@ const RGB_Node *rgb_closest_colour(uint8_t red, uint8_t green, uint8_t blue) {
 
 }
 
+/* The tree of every xterm 256 colour, for walking with rgb_foreach_df. */
+const RGB_Node *rgb_palette_tree(void) {
+    return &sample_tree[0];
+}
+
 /* Traversal functions. */
 static void foreach_df(const RGB_Node *node, NodeFunc func, int depth) {
     func(node, depth);
@@ -55,6 +55,7 @@ const RGB_Node *rgb_nearest(const RGB_Node *tree, RGB_Tuple *target, long *dist)
 void rgb_foreach_df(const RGB_Node *tree, void (*func)(const RGB_Node*, int));
 int rgb_colour_distance(const RGB_Tuple *p, const RGB_Tuple *q);
 const RGB_Node *rgb_closest_colour(uint8_t red, uint8_t green, uint8_t blue);
+const RGB_Node *rgb_palette_tree(void);
 void rgb_print_node(const RGB_Node *node, int depth);
 
 #endif /* RGBTREE_H */
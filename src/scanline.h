@@ -0,0 +1,62 @@
+/*
+ * Copyright (c) 2026 Eddie Antonio Santos <hello@eddieantonio.ca>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+
+/**
+ * @file scanline.h
+ * @brief The interface between streaming decoders and whatever keeps their
+ * rows.
+ *
+ * A streaming decoder never holds the whole image. Instead, once it has read
+ * the header, it asks the sink how big the image needs to be, and then hands
+ * over one row at a time, top to bottom.
+ */
+
+#ifndef SCANLINE_H
+#define SCANLINE_H
+
+#ifdef __cplusplus
+#include <cstdint>
+extern "C" {
+#else
+#include <stdbool.h>
+#include <stdint.h>
+#endif
+
+struct ScanlineSink {
+    /**
+     * Called with the image's full size, as stated in its header. Sets the
+     * smallest size that would still be useful, for decoders that can
+     * decode at reduced size. Returns false to stop decoding.
+     */
+    bool (*start)(void *context, int width, int height,
+                  int *min_width, int *min_height);
+    /**
+     * Called with the size that rows will actually be, before the first
+     * row. Returns false to stop decoding.
+     */
+    bool (*size)(void *context, int width, int height);
+    /**
+     * Called with each row, as 32bpp RGBA.
+     */
+    void (*row)(void *context, const uint8_t *row);
+    void *context;
+};
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+#endif /* SCANLINE_H */
@@ -0,0 +1,721 @@
+/*
+ * Copyright (c) 2026 Eddie Antonio Santos <hello@eddieantonio.ca>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+
+/**
+ * @file server.c
+ * @brief The --serve daemon, and the client half of its protocol.
+ *
+ * The protocol is for a client and server on the same machine (and built
+ * from the same source), so everything is sent in native byte order. Each
+ * request is a WireRequest followed by either a NUL-terminated path or the
+ * image itself; each response is a WireResponse followed by what to print.
+ *
+ * The main thread accepts connections and queues them; each worker takes
+ * one connection at a time, answers its requests until it hangs up, and
+ * keeps its libimgcat context warm for the next one.
+ */
+
+/* Feature-test macros for pselect(2), realpath(3), and sigaction(2). */
+#define _DEFAULT_SOURCE
+#define _XOPEN_SOURCE 700
+#include <errno.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "server.h"
+#include "libimgcat.h"
+#include "output.h"
+
+#ifndef MSG_NOSIGNAL
+/* Without it, SIGPIPE is ignored instead. */
+#define MSG_NOSIGNAL 0
+#endif
+
+enum {
+    /* "IMG", then the protocol version. */
+    WIRE_MAGIC = 0x494D4705,
+
+    REQUEST_RENDER = 1,
+    REQUEST_STATS = 2,
+
+    STATUS_PRINTED = 0,
+    STATUS_FAILED = 1,
+
+    /* Connections accepted, but not yet taken by a worker. */
+    MAX_QUEUED = 64,
+    LISTEN_BACKLOG = 64,
+    /* The largest image a client may send inline. */
+    MAX_INLINE_LENGTH = 1 << 30,
+    /* Bucket 0 counts requests that took under 1 µs; bucket b > 0, those
+     * that took [2^(b-1), 2^b) µs. The last bucket takes everything
+     * slower, too. */
+    LATENCY_BUCKETS = 32,
+    COPY_CHUNK_LEN = 64 * 1024,
+    STATS_TEXT_LEN = 4096,
+};
+
+struct WireRequest {
+    uint32_t magic;
+    uint32_t type;
+    int32_t max_width, max_height;
+    int32_t desired_width, desired_height;
+    int32_t format, quantizer, dither, emission, kitty_medium;
+    uint8_t blocks, preserve_aspect_ratio, compact_escapes, padding;
+    /* Exactly one of these is non-zero for REQUEST_RENDER. The path's
+     * length doesn't include its NUL terminator. */
+    uint32_t path_length;
+    uint64_t data_length;
+    uint64_t max_bytes;
+};
+
+struct WireResponse {
+    uint32_t magic;
+    uint32_t status;
+    uint64_t length;
+};
+
+struct Stats {
+    uint64_t requests, failures, bytes;
+    uint64_t latency[LATENCY_BUCKETS];
+};
+
+struct Server {
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    /* Accepted connections, in a ring buffer. */
+    int queue[MAX_QUEUED];
+    int queue_head, queued;
+    bool stopping;
+    struct Stats stats;
+    int64_t started_ns;
+};
+
+struct Worker {
+    struct Server *server;
+    pthread_t thread;
+    struct ImgcatContext *context;
+    /* Holds the path or image of the current request. */
+    uint8_t *input;
+    size_t input_capacity;
+    /* The connection being served, or -1; protected by server->lock, so
+     * that it can be shut down when the server stops. */
+    int fd;
+};
+
+struct ServerConnection {
+    int fd;
+    /* Set once the server stops making sense, after which everything is
+     * SERVER_UNAVAILABLE. */
+    bool broken;
+};
+
+static volatile sig_atomic_t stop_requested = 0;
+
+static int listen_on(const char *socket_path);
+static bool fill_address(struct sockaddr_un *address, const char *socket_path);
+static void on_stop(int signal);
+static void accept_connections(struct Server *, int listen_fd, const sigset_t *unblocked);
+static void *worker_main(void *arg);
+static void serve_connection(struct Worker *, int fd);
+static bool serve_render(struct Worker *, int fd, const struct WireRequest *);
+static bool serve_stats(struct Server *, int fd);
+static bool valid_request(const struct WireRequest *);
+static void record(struct Server *, bool success, size_t bytes, int64_t elapsed_ns);
+static int latency_bucket(int64_t elapsed_ns);
+static uint64_t bucket_limit(int bucket);
+static size_t format_stats(struct Server *, char *text, size_t size);
+static bool reserve_input(struct Worker *, size_t capacity);
+static bool read_exact(int fd, void *buffer, size_t length);
+static bool send_all(int fd, const void *buffer, size_t length);
+static bool copy_to(int from, int to, uint64_t length, size_t *bytes_written);
+static int64_t now_ns(void);
+
+
+bool server_run(const char *socket_path, int threads) {
+    struct Server server = {
+        .queue_head = 0,
+        .queued = 0,
+        .stopping = false,
+        .started_ns = now_ns(),
+    };
+
+    int listen_fd = listen_on(socket_path);
+    if (listen_fd == -1) {
+        return false;
+    }
+
+    /* Stop signals are only let in while waiting for connections, so that
+     * one can't slip in between checking for it and waiting. Workers
+     * inherit the mask, so they never see them. */
+    struct sigaction stop = { .sa_handler = on_stop }, ignore = { .sa_handler = SIG_IGN };
+    sigset_t stop_signals, unblocked;
+    sigemptyset(&stop_signals);
+    sigaddset(&stop_signals, SIGINT);
+    sigaddset(&stop_signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &stop_signals, &unblocked);
+    sigaction(SIGINT, &stop, NULL);
+    sigaction(SIGTERM, &stop, NULL);
+    /* Clients that hang up early are their own problem. */
+    sigaction(SIGPIPE, &ignore, NULL);
+    sigdelset(&unblocked, SIGINT);
+    sigdelset(&unblocked, SIGTERM);
+
+    pthread_mutex_init(&server.lock, NULL);
+    pthread_cond_init(&server.changed, NULL);
+
+    struct Worker *workers = calloc(threads, sizeof(struct Worker));
+    int started = 0;
+    for (; workers != NULL && started < threads; started++) {
+        struct Worker *worker = &workers[started];
+        worker->server = &server;
+        worker->fd = -1;
+        worker->context = imgcat_context_new();
+        if (worker->context == NULL
+                || pthread_create(&worker->thread, NULL, worker_main, worker) != 0) {
+            imgcat_context_free(worker->context);
+            break;
+        }
+    }
+
+    if (started > 0) {
+        accept_connections(&server, listen_fd, &unblocked);
+    }
+
+    /* Hang up on everybody, so that no worker waits for another request. */
+    close(listen_fd);
+    unlink(socket_path);
+    pthread_mutex_lock(&server.lock);
+    server.stopping = true;
+    for (; server.queued > 0; server.queued--) {
+        close(server.queue[server.queue_head]);
+        server.queue_head = (server.queue_head + 1) % MAX_QUEUED;
+    }
+    for (int i = 0; i < started; i++) {
+        if (workers[i].fd != -1) {
+            shutdown(workers[i].fd, SHUT_RDWR);
+        }
+    }
+    pthread_cond_broadcast(&server.changed);
+    pthread_mutex_unlock(&server.lock);
+
+    for (int i = 0; i < started; i++) {
+        pthread_join(workers[i].thread, NULL);
+        imgcat_context_free(workers[i].context);
+        free(workers[i].input);
+    }
+    free(workers);
+    pthread_cond_destroy(&server.changed);
+    pthread_mutex_destroy(&server.lock);
+
+    if (started == 0) {
+        errno = EAGAIN;
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Binds and listens on socket_path. A socket left behind by a server that
+ * has since died is replaced; a live server's is not. Only the server's own
+ * user may connect, since the server will read any file it can for them.
+ */
+static int listen_on(const char *socket_path) {
+    struct sockaddr_un address;
+    if (!fill_address(&address, socket_path)) {
+        return -1;
+    }
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd == -1) {
+        return -1;
+    }
+
+    int result = bind(fd, (struct sockaddr *) &address, sizeof(address));
+    if (result == -1 && errno == EADDRINUSE) {
+        struct ServerConnection *other = server_connect(socket_path);
+        if (other != NULL) {
+            server_disconnect(other);
+            close(fd);
+            errno = EADDRINUSE;
+            return -1;
+        }
+        unlink(socket_path);
+        result = bind(fd, (struct sockaddr *) &address, sizeof(address));
+    }
+
+    /* Nobody can connect until listen(), so there's no window before this. */
+    if (result == 0) {
+        result = chmod(socket_path, S_IRUSR | S_IWUSR);
+    }
+    if (result == -1 || listen(fd, LISTEN_BACKLOG) == -1) {
+        int error = errno;
+        close(fd);
+        errno = error;
+        return -1;
+    }
+    return fd;
+}
+
+static bool fill_address(struct sockaddr_un *address, const char *socket_path) {
+    memset(address, 0, sizeof(*address));
+    address->sun_family = AF_UNIX;
+    if (strlen(socket_path) >= sizeof(address->sun_path)) {
+        errno = ENAMETOOLONG;
+        return false;
+    }
+    strcpy(address->sun_path, socket_path);
+    return true;
+}
+
+static void on_stop(int signal) {
+    (void) signal;
+    stop_requested = 1;
+}
+
+/**
+ * Queues connections for the workers until asked to stop.
+ */
+static void accept_connections(struct Server *server, int listen_fd, const sigset_t *unblocked) {
+    while (!stop_requested) {
+        fd_set readable;
+        FD_ZERO(&readable);
+        FD_SET(listen_fd, &readable);
+        if (pselect(listen_fd + 1, &readable, NULL, NULL, NULL, unblocked) == -1) {
+            continue;
+        }
+
+        int fd = accept(listen_fd, NULL, NULL);
+        if (fd == -1) {
+            continue;
+        }
+
+        pthread_mutex_lock(&server->lock);
+        while (server->queued == MAX_QUEUED) {
+            pthread_cond_wait(&server->changed, &server->lock);
+        }
+        server->queue[(server->queue_head + server->queued) % MAX_QUEUED] = fd;
+        server->queued++;
+        pthread_cond_broadcast(&server->changed);
+        pthread_mutex_unlock(&server->lock);
+    }
+}
+
+static void *worker_main(void *arg) {
+    struct Worker *worker = arg;
+    struct Server *server = worker->server;
+
+    pthread_mutex_lock(&server->lock);
+    while (1) {
+        while (server->queued == 0 && !server->stopping) {
+            pthread_cond_wait(&server->changed, &server->lock);
+        }
+        if (server->stopping) {
+            break;
+        }
+
+        int fd = server->queue[server->queue_head];
+        server->queue_head = (server->queue_head + 1) % MAX_QUEUED;
+        server->queued--;
+        worker->fd = fd;
+        pthread_cond_broadcast(&server->changed);
+        pthread_mutex_unlock(&server->lock);
+
+        serve_connection(worker, fd);
+
+        pthread_mutex_lock(&server->lock);
+        worker->fd = -1;
+        close(fd);
+    }
+    pthread_mutex_unlock(&server->lock);
+
+    return NULL;
+}
+
+/**
+ * Answers requests until the client hangs up or stops making sense.
+ */
+static void serve_connection(struct Worker *worker, int fd) {
+    struct WireRequest wire;
+
+    while (read_exact(fd, &wire, sizeof(wire)) && wire.magic == WIRE_MAGIC) {
+        bool understood;
+        if (wire.type == REQUEST_RENDER) {
+            understood = serve_render(worker, fd, &wire);
+        } else if (wire.type == REQUEST_STATS) {
+            understood = serve_stats(worker->server, fd);
+        } else {
+            understood = false;
+        }
+
+        if (!understood) {
+            break;
+        }
+    }
+}
+
+static bool serve_render(struct Worker *worker, int fd, const struct WireRequest *wire) {
+    int64_t start = now_ns();
+
+    /* Read the path or the image, even if the request is no good, so that
+     * the next request starts in the right place. */
+    size_t length = wire->path_length > 0 ? (size_t) wire->path_length + 1 : wire->data_length;
+    if (wire->path_length > PATH_MAX || wire->data_length > MAX_INLINE_LENGTH
+            || !reserve_input(worker, length) || !read_exact(fd, worker->input, length)) {
+        return false;
+    }
+
+    const char *output = NULL;
+    size_t output_length = 0;
+    bool success = valid_request(wire);
+    if (success) {
+        PrintRequest request;
+        imgcat_request_init(&request, (Format) wire->format);
+        request.max_width = wire->max_width;
+        request.max_height = wire->max_height;
+        request.desired_width = wire->desired_width;
+        request.desired_height = wire->desired_height;
+        request.blocks = (Blocks) wire->blocks;
+        request.preserve_aspect_ratio = wire->preserve_aspect_ratio;
+        request.quantizer = (Quantizer) wire->quantizer;
+        request.dither = (Dither) wire->dither;
+        request.emission = (Emission) wire->emission;
+        request.kitty_medium = (KittyMedium) wire->kitty_medium;
+        request.compact_escapes = wire->compact_escapes;
+        request.max_bytes = wire->max_bytes;
+        if (wire->path_length > 0) {
+            worker->input[wire->path_length] = '\0';
+            request.filename = (const char *) worker->input;
+        } else {
+            request.filename = "(inline image)";
+            request.data = worker->input;
+            request.data_length = wire->data_length;
+        }
+
+        success = imgcat_render(worker->context, &request, &output, &output_length);
+    }
+
+    struct WireResponse response = {
+        .magic = WIRE_MAGIC,
+        .status = success ? STATUS_PRINTED : STATUS_FAILED,
+        .length = success ? output_length : 0,
+    };
+    bool sent = send_all(fd, &response, sizeof(response))
+        && send_all(fd, output, response.length);
+
+    record(worker->server, success && sent, response.length, now_ns() - start);
+    return sent;
+}
+
+static bool serve_stats(struct Server *server, int fd) {
+    char text[STATS_TEXT_LEN];
+    size_t length = format_stats(server, text, sizeof(text));
+
+    struct WireResponse response = {
+        .magic = WIRE_MAGIC,
+        .status = STATUS_PRINTED,
+        .length = length,
+    };
+    return send_all(fd, &response, sizeof(response)) && send_all(fd, text, length);
+}
+
+/**
+ * Whether the request has everything needed to render it, with every enum
+ * in range (the client might be a different version, after all).
+ */
+static bool valid_request(const struct WireRequest *wire) {
+    return (wire->path_length > 0) != (wire->data_length > 0)
+        && wire->format >= F_8_COLOR && wire->format <= F_KITTY
+        && wire->quantizer >= Q_EXACT && wire->quantizer <= Q_PERCEPTUAL
+        && wire->dither >= D_NONE && wire->dither <= D_DIFFUSION
+        && wire->emission >= E_FULL && wire->emission <= E_DELTA_REP
+        && wire->kitty_medium >= K_DIRECT && wire->kitty_medium <= K_SHARED_MEMORY
+        && wire->blocks <= B_SEXTANT
+        && wire->max_width >= 0 && wire->max_height >= 0
+        && wire->desired_width >= 0 && wire->desired_height >= 0;
+}
+
+static void record(struct Server *server, bool success, size_t bytes, int64_t elapsed_ns) {
+    pthread_mutex_lock(&server->lock);
+    server->stats.requests++;
+    server->stats.failures += !success;
+    server->stats.bytes += bytes;
+    server->stats.latency[latency_bucket(elapsed_ns)]++;
+    pthread_mutex_unlock(&server->lock);
+}
+
+static int latency_bucket(int64_t elapsed_ns) {
+    uint64_t us = elapsed_ns > 0 ? (uint64_t) elapsed_ns / 1000 : 0;
+    int bucket = 0;
+    while (us > 0 && bucket < LATENCY_BUCKETS - 1) {
+        us >>= 1;
+        bucket++;
+    }
+    return bucket;
+}
+
+/* The slowest latency (in µs) counted by the bucket. */
+static uint64_t bucket_limit(int bucket) {
+    return bucket == 0 ? 0 : (UINT64_C(1) << bucket) - 1;
+}
+
+/**
+ * Describes the server's counters, and the latency histogram's non-empty
+ * buckets. Percentiles are the upper bound of the bucket they fall in.
+ */
+static size_t format_stats(struct Server *server, char *text, size_t size) {
+    pthread_mutex_lock(&server->lock);
+    struct Stats stats = server->stats;
+    pthread_mutex_unlock(&server->lock);
+
+    double uptime = (now_ns() - server->started_ns) / 1e9;
+    size_t length = 0;
+#   define append(...) \
+        length += snprintf(text + length, length < size ? size - length : 0, __VA_ARGS__)
+
+    append("uptime: %.3f s\n", uptime);
+    append("requests: %" PRIu64 "\n", stats.requests);
+    append("failures: %" PRIu64 "\n", stats.failures);
+    append("bytes: %" PRIu64 "\n", stats.bytes);
+    append("throughput: %.1f requests/s, %.3f MiB/s\n",
+           stats.requests / uptime, stats.bytes / uptime / (1 << 20));
+
+    const double percentiles[] = { 50, 90, 99 };
+    for (size_t p = 0; p < sizeof(percentiles) / sizeof(percentiles[0]); p++) {
+        uint64_t seen = 0, wanted = (uint64_t) (stats.requests * percentiles[p] / 100.0 + 0.5);
+        int bucket = 0;
+        while (bucket < LATENCY_BUCKETS - 1 && seen + stats.latency[bucket] < wanted) {
+            seen += stats.latency[bucket++];
+        }
+        append("p%.0f: <= %" PRIu64 " us\n", percentiles[p],
+               stats.requests > 0 ? bucket_limit(bucket) : 0);
+    }
+
+    append("latency histogram (us):\n");
+    for (int bucket = 0; bucket < LATENCY_BUCKETS; bucket++) {
+        if (stats.latency[bucket] == 0) {
+            continue;
+        }
+        uint64_t low = bucket == 0 ? 0 : UINT64_C(1) << (bucket - 1);
+        if (bucket == LATENCY_BUCKETS - 1) {
+            append("  %" PRIu64 "+: %" PRIu64 "\n", low, stats.latency[bucket]);
+        } else {
+            append("  %" PRIu64 "-%" PRIu64 ": %" PRIu64 "\n",
+                   low, bucket_limit(bucket), stats.latency[bucket]);
+        }
+    }
+
+#   undef append
+    return length < size ? length : size - 1;
+}
+
+static bool reserve_input(struct Worker *worker, size_t capacity) {
+    if (capacity <= worker->input_capacity) {
+        return true;
+    }
+
+    uint8_t *input = realloc(worker->input, capacity);
+    if (input == NULL) {
+        return false;
+    }
+    worker->input = input;
+    worker->input_capacity = capacity;
+    return true;
+}
+
+
+/* The client. */
+
+struct ServerConnection *server_connect(const char *socket_path) {
+    struct sockaddr_un address;
+    if (!fill_address(&address, socket_path)) {
+        return NULL;
+    }
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd == -1) {
+        return NULL;
+    }
+    while (connect(fd, (struct sockaddr *) &address, sizeof(address)) == -1) {
+        if (errno != EINTR) {
+            close(fd);
+            return NULL;
+        }
+    }
+
+    struct ServerConnection *connection = malloc(sizeof(struct ServerConnection));
+    if (connection == NULL) {
+        close(fd);
+        return NULL;
+    }
+    *connection = (struct ServerConnection) { .fd = fd, .broken = false };
+    return connection;
+}
+
+void server_disconnect(struct ServerConnection *connection) {
+    close(connection->fd);
+    free(connection);
+}
+
+enum ServerResult server_print(struct ServerConnection *connection, PrintRequest *request) {
+    char path[PATH_MAX];
+    struct stat st;
+
+    if (connection->broken || request->animate) {
+        return SERVER_UNAVAILABLE;
+    }
+
+    struct WireRequest wire = {
+        .magic = WIRE_MAGIC,
+        .type = REQUEST_RENDER,
+        .max_width = request->max_width,
+        .max_height = request->max_height,
+        .desired_width = request->desired_width,
+        .desired_height = request->desired_height,
+        .format = request->format,
+        .quantizer = request->quantizer,
+        .dither = request->dither,
+        .emission = request->emission,
+        .kitty_medium = request->kitty_medium,
+        .blocks = request->blocks,
+        .preserve_aspect_ratio = request->preserve_aspect_ratio,
+        .compact_escapes = request->compact_escapes,
+        .max_bytes = request->max_bytes,
+    };
+    const void *body;
+    if (request->data != NULL) {
+        body = request->data;
+        wire.data_length = request->data_length;
+    } else if (realpath(request->filename, path) == NULL) {
+        return SERVER_FAILED;
+    } else if (stat(path, &st) == -1 || !S_ISREG(st.st_mode)) {
+        /* Pipes and the like can only be read by whoever has them open. */
+        return SERVER_UNAVAILABLE;
+    } else {
+        body = path;
+        wire.path_length = strlen(path);
+    }
+
+    struct WireResponse response;
+    if (!send_all(connection->fd, &wire, sizeof(wire))
+            || !send_all(connection->fd, body, wire.path_length ? wire.path_length + 1 : wire.data_length)
+            || !read_exact(connection->fd, &response, sizeof(response))
+            || response.magic != WIRE_MAGIC) {
+        connection->broken = true;
+        return SERVER_UNAVAILABLE;
+    }
+    if (response.status != STATUS_PRINTED) {
+        return SERVER_FAILED;
+    }
+
+    /* Anything already in stdio's buffer must go out before we write(2). */
+    fflush(stdout);
+    if (!copy_to(connection->fd, request->output_fd, response.length, &request->bytes_written)) {
+        connection->broken = true;
+        return SERVER_FAILED;
+    }
+    return SERVER_PRINTED;
+}
+
+bool server_print_stats(struct ServerConnection *connection, int fd) {
+    struct WireRequest wire = { .magic = WIRE_MAGIC, .type = REQUEST_STATS };
+    struct WireResponse response;
+    size_t bytes_written;
+
+    return !connection->broken
+        && send_all(connection->fd, &wire, sizeof(wire))
+        && read_exact(connection->fd, &response, sizeof(response))
+        && response.magic == WIRE_MAGIC
+        && copy_to(connection->fd, fd, response.length, &bytes_written);
+}
+
+
+/* Plumbing. */
+
+/**
+ * Reads exactly length bytes, or returns false.
+ */
+static bool read_exact(int fd, void *buffer, size_t length) {
+    uint8_t *pos = buffer;
+    while (length > 0) {
+        ssize_t got = read(fd, pos, length);
+        if (got < 0 && errno == EINTR) {
+            continue;
+        } else if (got <= 0) {
+            return false;
+        }
+        pos += got;
+        length -= got;
+    }
+    return true;
+}
+
+static bool send_all(int fd, const void *buffer, size_t length) {
+    const uint8_t *pos = buffer;
+    while (length > 0) {
+        ssize_t sent = send(fd, pos, length, MSG_NOSIGNAL);
+        if (sent < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        pos += sent;
+        length -= sent;
+    }
+    return true;
+}
+
+/**
+ * Copies length bytes from one file descriptor to another.
+ */
+static bool copy_to(int from, int to, uint64_t length, size_t *bytes_written) {
+    struct Output output;
+    bool success = true;
+
+    output_init(&output, to);
+    while (length > 0 && success) {
+        size_t chunk = length < COPY_CHUNK_LEN ? length : COPY_CHUNK_LEN;
+        success = output_reserve(&output, chunk)
+            && read_exact(from, output.data + output.length, chunk);
+        if (success) {
+            output.length += chunk;
+            length -= chunk;
+            success = output_flush(&output);
+        }
+    }
+
+    *bytes_written = output.bytes_written;
+    output_free(&output);
+    return success;
+}
+
+static int64_t now_ns(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t) now.tv_sec * 1000000000 + now.tv_nsec;
+}
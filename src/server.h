@@ -0,0 +1,74 @@
+/*
+ * Copyright (c) 2026 Eddie Antonio Santos <hello@eddieantonio.ca>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+
+/**
+ * @file server.h
+ * @brief A long-running imgcat that renders images for other imgcats.
+ *
+ * The server listens on a Unix domain socket. A client connects, sends
+ * one or more requests (a PrintRequest's parameters, plus the path to an
+ * image or the image itself), and gets back exactly what imgcat would have
+ * printed for each. The client is imgcat itself: it works out the terminal
+ * size and colour depth as usual, then asks the server to do the rest.
+ */
+
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <stdbool.h>
+
+#include "print_image.h"
+
+enum ServerResult {
+    /* The image was printed. */
+    SERVER_PRINTED,
+    /* The server couldn't print it (e.g., it's not an image). */
+    SERVER_FAILED,
+    /* There's no server, or it stopped answering before anything was
+     * printed: print the image some other way. */
+    SERVER_UNAVAILABLE,
+};
+
+/**
+ * Serves requests on socket_path with threads workers, until SIGINT or
+ * SIGTERM. Returns false (and sets errno) if the socket could not be
+ * listened on, including when another server is already listening.
+ */
+bool server_run(const char *socket_path, int threads);
+
+struct ServerConnection;
+
+/**
+ * Connects to the server on socket_path, or returns NULL if there isn't
+ * one.
+ */
+struct ServerConnection *server_connect(const char *socket_path);
+void server_disconnect(struct ServerConnection *connection);
+
+/**
+ * Has the server print the image in request to request->output_fd.
+ * Animations can't be played by the server, so they're SERVER_UNAVAILABLE.
+ * Once a request returns SERVER_UNAVAILABLE, so do all later ones.
+ */
+enum ServerResult server_print(struct ServerConnection *connection, PrintRequest *request);
+
+/**
+ * Writes the server's counters and latency histogram to fd, as text.
+ */
+bool server_print_stats(struct ServerConnection *connection, int fd);
+
+#endif /* SERVER_H */
@@ -0,0 +1,201 @@
+/*
+ * Copyright (c) 2026 Eddie Antonio Santos <hello@eddieantonio.ca>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+
+/**
+ * @file sixel.c
+ * @brief A sixel encoder that looks at each pixel once.
+ *
+ * Sixel data is written one colour at a time: for each colour in a band of
+ * six rows, a row of sixels saying which of the six pixels in each column
+ * are that colour. Rather than scanning the band again for every colour,
+ * each pixel sets its bit in its own colour's row, in a single pass. Only
+ * the colours that are in the band are written out, each from its first
+ * column to its last, with runs of the same sixel compressed with DECGRI
+ * ("!", the count, then the sixel).
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "output.h"
+#include "quantize.h"
+#include "sixel.h"
+
+enum {
+    /* Sixels are written as '?' (none of the six pixels) to '~' (all six). */
+    SIXEL_OFFSET = 63,
+    /* Shorter runs are no longer written out than as a repeat. */
+    MIN_REPEAT = 4,
+    /* The longest a colour's introduction can be: "$#255;2;100;100;100". */
+    MAX_COLOUR_LEN = 24,
+    /* The longest a repeat can be: "!", up to ten digits, and the sixel. */
+    MAX_REPEAT_LEN = 12,
+};
+
+bool sixel_encoder_init(struct SixelEncoder *encoder, int width) {
+    *encoder = (struct SixelEncoder) {
+        .width = width,
+        .bands = 0,
+        .n_registers = 0,
+        .sixels = calloc((size_t) SIXEL_COLOURS * width, sizeof(uint8_t)),
+    };
+    return encoder->sixels != NULL;
+}
+
+void sixel_encoder_free(struct SixelEncoder *encoder) {
+    free(encoder->sixels);
+    encoder->sixels = NULL;
+}
+
+static char *append_decimal(char *dest, unsigned value) {
+    char digits[10];
+    int n = 0;
+    do {
+        digits[n++] = '0' + value % 10;
+        value /= 10;
+    } while (value > 0);
+
+    while (n > 0) {
+        *dest++ = digits[--n];
+    }
+    return dest;
+}
+
+static char *append_run(char *dest, char sixel, int count) {
+    if (count >= MIN_REPEAT) {
+        *dest++ = '!';
+        dest = append_decimal(dest, count);
+        *dest++ = sixel;
+    } else {
+        while (count-- > 0) {
+            *dest++ = sixel;
+        }
+    }
+    return dest;
+}
+
+/**
+ * Selects the colour's register, defining it (as a percentage of each of
+ * red, green, and blue) the first time the colour is used.
+ */
+static char *select_colour(struct SixelEncoder *encoder, uint8_t colour, char *dest) {
+    *dest++ = '#';
+    if (encoder->registers[colour] != 0) {
+        return append_decimal(dest, encoder->registers[colour] - 1);
+    }
+
+    int reg = encoder->n_registers++;
+    encoder->registers[colour] = reg + 1;
+    dest = append_decimal(dest, reg);
+
+    uint8_t rgb[3];
+    palette_rgb_256(colour, rgb);
+    memcpy(dest, ";2", 2);
+    dest += 2;
+    for (int c = 0; c < 3; c++) {
+        *dest++ = ';';
+        dest = append_decimal(dest, (rgb[c] * 100 + 127) / 255);
+    }
+    return dest;
+}
+
+static char *append_sixels(const uint8_t *sixels, int first, int last, char *dest) {
+    /* Every row starts at the left edge. */
+    dest = append_run(dest, SIXEL_OFFSET, first);
+
+    for (int x = first; x <= last; ) {
+        uint8_t sixel = sixels[x];
+        int run = 1;
+        while (x + run <= last && sixels[x + run] == sixel) {
+            run++;
+        }
+        dest = append_run(dest, sixel + SIXEL_OFFSET, run);
+        x += run;
+    }
+    return dest;
+}
+
+void sixel_start(struct SixelEncoder *encoder, int height, struct Output *output) {
+    char header[sizeof("\033P0;1;0q\"1;1;2147483647;2147483647")];
+    char *dest = header;
+
+    /* DCS, with pixels that are left as 0 staying transparent, then the
+     * raster attributes: square pixels, and the size of the image. */
+    memcpy(dest, "\033P0;1;0q\"1;1;", 13);
+    dest += 13;
+    dest = append_decimal(dest, encoder->width);
+    *dest++ = ';';
+    dest = append_decimal(dest, height);
+    output_write(output, header, dest - header);
+}
+
+void sixel_band(struct SixelEncoder *encoder, const uint8_t *const rows[], int n_rows,
+                struct Output *output) {
+    const size_t width = encoder->width;
+    uint8_t *sixels = encoder->sixels;
+    memset(encoder->present, 0, sizeof(encoder->present));
+
+    /* Column by column, so that every colour's last column is simply the
+     * last one it was seen in. */
+    for (size_t x = 0; x < width; x++) {
+        for (int r = 0; r < n_rows; r++) {
+            uint8_t colour = rows[r][x];
+            uint64_t bit = UINT64_C(1) << (colour % 64);
+            sixels[colour * width + x] |= 1 << r;
+            if ((encoder->present[colour / 64] & bit) == 0) {
+                encoder->present[colour / 64] |= bit;
+                encoder->first[colour] = x;
+            }
+            encoder->last[colour] = x;
+        }
+    }
+
+    /* Graphics new line: down to the next band. */
+    if (encoder->bands++ > 0) {
+        output_puts(output, "-");
+    }
+
+    bool first_colour = true;
+    for (int word = 0; word < SIXEL_COLOURS / 64; word++) {
+        for (uint64_t bits = encoder->present[word]; bits != 0; bits &= bits - 1) {
+            uint8_t colour = word * 64 + __builtin_ctzll(bits);
+            uint8_t *row = sixels + colour * width;
+            int first = encoder->first[colour], last = encoder->last[colour];
+
+            if (output_reserve(output, MAX_COLOUR_LEN + MAX_REPEAT_LEN + width)) {
+                char *dest = output->data + output->length;
+                /* Graphics carriage return: back to the start of the band. */
+                if (!first_colour) {
+                    *dest++ = '$';
+                }
+                dest = select_colour(encoder, colour, dest);
+                dest = append_sixels(row, first, last, dest);
+                output->length = dest - output->data;
+            }
+            first_colour = false;
+
+            /* Ready for the next band. */
+            memset(row + first, 0, last - first + 1);
+        }
+    }
+}
+
+void sixel_finish(struct SixelEncoder *encoder, struct Output *output) {
+    (void) encoder;
+    /* ST, then a new line, like the iTerm2 format. */
+    output_puts(output, "\033\\\n");
+}
@@ -0,0 +1,87 @@
+/*
+ * Copyright (c) 2026 Eddie Antonio Santos <hello@eddieantonio.ca>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+
+/**
+ * @file sixel.h
+ * @brief Encodes rows of xterm 256 colour indices as DEC sixel graphics.
+ *
+ * Usage:
+ *
+ * Initialize a SixelEncoder with sixel_encoder_init(), then call
+ * sixel_start(), sixel_band() for every six rows of the image, top to bottom,
+ * and finally sixel_finish(). Free the encoder with sixel_encoder_free().
+ *
+ * Colour registers are defined the first time the image uses them, so the
+ * image can be encoded (and printed) one band at a time.
+ */
+
+#ifndef SIXEL_H
+#define SIXEL_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+enum {
+    /* A sixel is one column of six pixels. */
+    SIXEL_BAND_HEIGHT = 6,
+    SIXEL_COLOURS = 256,
+};
+
+struct Output;
+
+struct SixelEncoder {
+    int width;
+    /* How many bands have been encoded so far. */
+    int bands;
+    /* Each palette colour's register, plus one; zero if it hasn't been
+     * defined yet. */
+    uint16_t registers[SIXEL_COLOURS];
+    int n_registers;
+    /* For the band being encoded: which colours are in it, */
+    uint64_t present[SIXEL_COLOURS / 64];
+    /* the first and last column each one is in, */
+    int first[SIXEL_COLOURS], last[SIXEL_COLOURS];
+    /* and each one's sixel in every column: a row of width bits-of-six per
+     * colour. Every byte is zero between bands. */
+    uint8_t *sixels;
+};
+
+/**
+ * Initializes an encoder for images width pixels wide. Returns false if
+ * memory could not be allocated.
+ */
+bool sixel_encoder_init(struct SixelEncoder *encoder, int width);
+void sixel_encoder_free(struct SixelEncoder *encoder);
+
+/**
+ * Appends the start of a sixel image that is height pixels tall.
+ */
+void sixel_start(struct SixelEncoder *encoder, int height, struct Output *output);
+
+/**
+ * Appends one band: n_rows (at most SIXEL_BAND_HEIGHT) rows of palette
+ * indices, each as wide as the image. Only the last band may be shorter.
+ */
+void sixel_band(struct SixelEncoder *encoder, const uint8_t *const rows[], int n_rows,
+                struct Output *output);
+
+/**
+ * Appends the end of the image.
+ */
+void sixel_finish(struct SixelEncoder *encoder, struct Output *output);
+
+#endif /* SIXEL_H */
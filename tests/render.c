@@ -0,0 +1,194 @@
+/*
+ * Copyright (c) 2026 Eddie Antonio Santos <hello@eddieantonio.ca>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+
+
+/**
+ * @file render.c
+ * @brief Renders images with libimgcat, and prints what it rendered.
+ *
+ * Usage: tests/render [-d DEPTH] [-w COLUMNS] [-j JOBS] [-t THREADS] [-r] [-b SIZE] IMAGE...
+ *
+ * Each of THREADS threads renders every image with its own context; the
+ * output of the first is printed, and every other thread must agree with
+ * it. With -r, images are read through a file descriptor rather than by
+ * name; with -b, they're rendered into a buffer of SIZE bytes. -w and -j
+ * set the request's max_width and jobs.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../src/libimgcat.h"
+
+enum {
+    MAX_THREADS = 16,
+};
+
+static struct {
+    Format format;
+    int max_width;
+    int jobs;
+    bool read_fd;
+    size_t buffer_size;
+    char **images;
+    int count;
+} options = {
+    .format = F_256_COLOR,
+    .max_width = WIDTH_UNSET,
+    .jobs = 1,
+    .read_fd = false,
+    .buffer_size = 0,
+};
+
+struct Rendered {
+    pthread_t thread;
+    /* Every image's output, one after the other. */
+    char *output;
+    size_t length;
+    bool success;
+};
+
+static bool append(struct Rendered *rendered, const char *bytes, size_t length) {
+    char *output = realloc(rendered->output, rendered->length + length);
+    if (output == NULL) {
+        return false;
+    }
+    memcpy(output + rendered->length, bytes, length);
+    rendered->output = output;
+    rendered->length += length;
+    return true;
+}
+
+static bool render_one(struct ImgcatContext *context, const char *filename,
+                       struct Rendered *rendered) {
+    PrintRequest request;
+    imgcat_request_init(&request, options.format);
+    request.filename = filename;
+    request.max_width = options.max_width;
+    request.jobs = options.jobs;
+
+    if (options.read_fd) {
+        int fd = open(filename, O_RDONLY);
+        if (fd == -1) {
+            return false;
+        }
+        bool success = imgcat_read_image(context, fd, &request);
+        close(fd);
+        if (!success) {
+            return false;
+        }
+    }
+
+    const char *output;
+    size_t length;
+    if (options.buffer_size > 0) {
+        char *buffer = malloc(options.buffer_size);
+        bool success = buffer != NULL
+            && imgcat_render_into(&request, buffer, options.buffer_size, &length)
+            && append(rendered, buffer, length);
+        free(buffer);
+        return success;
+    }
+    return imgcat_render(context, &request, &output, &length)
+        && append(rendered, output, length);
+}
+
+static void *render_all(void *arg) {
+    struct Rendered *rendered = arg;
+    struct ImgcatContext *context = imgcat_context_new();
+
+    rendered->success = context != NULL;
+    for (int i = 0; i < options.count && rendered->success; i++) {
+        rendered->success = render_one(context, options.images[i], rendered);
+    }
+
+    imgcat_context_free(context);
+    return NULL;
+}
+
+int main(int argc, char **argv) {
+    int threads = 1, c;
+
+    while ((c = getopt(argc, argv, "d:w:j:t:rb:")) != -1) {
+        switch (c) {
+            case 'd':
+                options.format = strcmp(optarg, "8") == 0 ? F_8_COLOR
+                    : strcmp(optarg, "24bit") == 0 ? F_TRUE_COLOR
+                    : strcmp(optarg, "iterm2") == 0 ? F_ITERM2
+                    : strcmp(optarg, "sixel") == 0 ? F_SIXEL
+                    : strcmp(optarg, "kitty") == 0 ? F_KITTY
+                    : F_256_COLOR;
+                break;
+            case 'w':
+                options.max_width = atoi(optarg);
+                break;
+            case 'j':
+                options.jobs = atoi(optarg);
+                break;
+            case 't':
+                threads = atoi(optarg);
+                break;
+            case 'r':
+                options.read_fd = true;
+                break;
+            case 'b':
+                options.buffer_size = strtoul(optarg, NULL, 10);
+                break;
+            default:
+                return 2;
+        }
+    }
+    if (threads < 1 || threads > MAX_THREADS || optind == argc) {
+        fprintf(stderr, "Usage: %s [-d DEPTH] [-w COLUMNS] [-j JOBS] [-t THREADS] [-r] [-b SIZE] IMAGE...\n", argv[0]);
+        return 2;
+    }
+    options.images = argv + optind;
+    options.count = argc - optind;
+
+    struct Rendered rendered[MAX_THREADS] = { { 0 } };
+    for (int i = 0; i < threads; i++) {
+        if (pthread_create(&rendered[i].thread, NULL, render_all, &rendered[i]) != 0) {
+            return 1;
+        }
+    }
+
+    int status = 0;
+    for (int i = 0; i < threads; i++) {
+        pthread_join(rendered[i].thread, NULL);
+        if (!rendered[i].success) {
+            fprintf(stderr, "render: thread %d failed\n", i);
+            status = 1;
+        } else if (rendered[i].length != rendered[0].length
+                || memcmp(rendered[i].output, rendered[0].output, rendered[0].length) != 0) {
+            fprintf(stderr, "render: thread %d disagrees with thread 0\n", i);
+            status = 1;
+        }
+    }
+
+    if (status == 0) {
+        fwrite(rendered[0].output, 1, rendered[0].length, stdout);
+    }
+    for (int i = 0; i < threads; i++) {
+        free(rendered[i].output);
+    }
+    return status;
+}